@@ -0,0 +1,49 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <memory>
+#include <vector>
+#include "../src/broker/BrokerConfig.h"
+#include "../src/broker/ClientSession.h"
+#include "../src/broker/Shard.h"
+
+// heap allocations made by the process so far (operator new is replaced in main.cpp)
+uint64_t allocation_count();
+// marks the run failed: bench exits with status 1 once every benchmark ran
+void fail_check();
+
+// A broker shard on the default configuration plus sessions living on it.
+// Sessions made by idle_sessions() have an unopened socket: enough to sit in
+// the subscription table, not to receive anything.
+class BenchBroker {
+public:
+    BenchBroker() : shard_(0, config_) {}
+
+    ~BenchBroker() {
+        // sessions are never started, so they are not closed the usual way
+        for (auto& s : sessions_) s->closed_ = true;
+    }
+
+    Shard& shard() { return shard_; }
+    SubscriptionManager& subscriptions() { return shard_.subscriptions(); }
+    boost::asio::io_context& io_context() { return shard_.io_context(); }
+
+    std::vector<std::shared_ptr<ClientSession>> idle_sessions(size_t n) {
+        std::vector<std::shared_ptr<ClientSession>> out;
+        for (size_t i = 0; i < n; ++i) {
+            out.push_back(adopt(boost::asio::ip::tcp::socket(shard_.io_context())));
+        }
+        return out;
+    }
+
+    std::shared_ptr<ClientSession> adopt(boost::asio::ip::tcp::socket socket) {
+        auto session = ClientSession::create(std::move(socket), shard_);
+        sessions_.push_back(session);
+        return session;
+    }
+
+private:
+    BrokerConfig config_;
+    Shard shard_;
+    std::vector<std::shared_ptr<ClientSession>> sessions_;
+};
@@ -0,0 +1,105 @@
+#include <benchmark/benchmark.h>
+#include <random>
+#include <vector>
+#include "../src/common/codec.h"
+#include "../src/common/serializer.h"
+
+namespace {
+
+std::vector<TradeMessage> make_trades(size_t n) {
+    std::mt19937_64 rng(42);
+    std::uniform_real_distribution<double> price(100.0, 200.0), qty(0.1, 5.0);
+    std::vector<TradeMessage> trades(n);
+    for (size_t i = 0; i < n; ++i) {
+        trades[i] = TradeMessage{static_cast<int32_t>(i % 100), 1700000000000 + i, price(rng), qty(rng)};
+    }
+    return trades;
+}
+
+void BM_EncodeData(benchmark::State& state) {
+    TradeMessage msg = make_trades(1)[0];
+    uint8_t out[codec::DATA_FRAME_SIZE];
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg);
+        codec::encode_data(msg, out);
+        benchmark::DoNotOptimize(out);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_EncodeData);
+
+void BM_Decode(benchmark::State& state) {
+    uint8_t in[codec::DATA_FRAME_SIZE];
+    codec::encode_data(make_trades(1)[0], in);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(in);
+        TradeMessage m = codec::decode<TradeMessage>(in + 1);
+        benchmark::DoNotOptimize(m);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_Decode);
+
+// the bulk paths behind BATCH frames
+void BM_EncodeArray(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    auto trades = make_trades(n);
+    std::vector<uint8_t> out(n * sizeof(TradeMessage));
+    for (auto _ : state) {
+        codec::encode_array(trades.data(), n, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * out.size()));
+}
+BENCHMARK(BM_EncodeArray)->Arg(1)->Arg(16)->Arg(256)->Arg(MAX_BATCH_RECORDS);
+
+void BM_DecodeArray(benchmark::State& state) {
+    auto n = static_cast<size_t>(state.range(0));
+    std::vector<uint8_t> in(n * sizeof(TradeMessage));
+    codec::encode_array(make_trades(n).data(), n, in.data());
+    std::vector<TradeMessage> out(n);
+    for (auto _ : state) {
+        codec::decode_array(in.data(), n, out.data());
+        benchmark::DoNotOptimize(out.data());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * n));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * in.size()));
+}
+BENCHMARK(BM_DecodeArray)->Arg(1)->Arg(16)->Arg(256)->Arg(MAX_BATCH_RECORDS);
+
+// a DATA frame built field by field into a vector, as the clients build control frames
+void BM_SerializerWrite(benchmark::State& state) {
+    TradeMessage msg = make_trades(1)[0];
+    std::vector<uint8_t> out;
+    out.reserve(codec::DATA_FRAME_SIZE);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(msg);
+        out.clear();
+        serializer::write_uint8(out, static_cast<uint8_t>(MsgType::DATA));
+        serializer::write_int32_be(out, msg.topic_id);
+        serializer::write_uint64_be(out, msg.timestamp_ms);
+        serializer::write_double_be(out, msg.price);
+        serializer::write_double_be(out, msg.quantity);
+        benchmark::DoNotOptimize(out.data());
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SerializerWrite);
+
+void BM_SerializerRead(benchmark::State& state) {
+    uint8_t in[codec::DATA_FRAME_SIZE];
+    codec::encode_data(make_trades(1)[0], in);
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(in);
+        TradeMessage m{serializer::read_int32_be(in + 1), serializer::read_uint64_be(in + 5),
+                       serializer::read_double_be(in + 13), serializer::read_double_be(in + 21)};
+        benchmark::DoNotOptimize(m);
+    }
+    state.SetItemsProcessed(state.iterations());
+}
+BENCHMARK(BM_SerializerRead);
+
+}
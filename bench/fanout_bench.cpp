@@ -0,0 +1,287 @@
+#include <benchmark/benchmark.h>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <thread>
+#include <vector>
+#include "../src/broker/Frame.h"
+#include "../src/broker/SlowConsumer.h"
+#include "../src/common/codec.h"
+#include "../src/common/message.h"
+#include "../src/common/spsc_queue.h"
+#include "../src/common/trade_filter.h"
+#include "bench_support.h"
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+// Reads and discards everything arriving on the subscriber ends of the
+// connections, on its own thread, so the broker side never blocks on a full
+// socket buffer.
+class Drain {
+public:
+    ~Drain() {
+        io_.stop();
+        if (thread_.joinable()) thread_.join();
+    }
+
+    tcp::socket& add() {
+        peers_.push_back(std::make_unique<Peer>(io_));
+        return peers_.back()->socket;
+    }
+
+    void start() {
+        for (auto& p : peers_) read(*p);
+        thread_ = std::thread([this] { io_.run(); });
+    }
+
+private:
+    struct Peer {
+        explicit Peer(boost::asio::io_context& io) : socket(io) {}
+        tcp::socket socket;
+        std::array<uint8_t, 64 * 1024> buf;
+    };
+
+    void read(Peer& p) {
+        p.socket.async_read_some(boost::asio::buffer(p.buf), [this, &p](boost::system::error_code ec, std::size_t) {
+            if (!ec) read(p);
+        });
+    }
+
+    boost::asio::io_context io_;
+    std::vector<std::unique_ptr<Peer>> peers_;
+    std::thread thread_;
+};
+
+// N sessions on a broker shard, each connected over loopback TCP (the
+// portable socketpair) to a peer the Drain reads from.
+std::vector<std::shared_ptr<ClientSession>> connect_sessions(BenchBroker& broker, Drain& drain, size_t n) {
+    std::vector<std::shared_ptr<ClientSession>> sessions;
+    tcp::acceptor acceptor(broker.io_context(), tcp::endpoint(boost::asio::ip::make_address("127.0.0.1"), 0));
+    for (size_t i = 0; i < n; ++i) {
+        tcp::socket& peer = drain.add();
+        peer.connect(acceptor.local_endpoint());
+        tcp::socket server(broker.io_context());
+        acceptor.accept(server);
+        server.set_option(tcp::no_delay(true));
+        sessions.push_back(broker.adopt(std::move(server)));
+    }
+    drain.start();
+    return sessions;
+}
+
+MutableFramePtr data_frame(int topic) {
+    MutableFramePtr frame = Frame::allocate(codec::DATA_FRAME_SIZE);
+    codec::encode_data(TradeMessage{topic, 1700000000000, 101.25, 3.5}, frame->data());
+    frame->set_topic(topic);
+    return frame;
+}
+
+// A BATCH of trades on `topic` priced 100, 101, ...
+template <size_t N>
+MutableFramePtr batch_frame(int topic) {
+    static const std::array<uint8_t, N * codec::wire_size<TradeMessage>> encoded = [topic] {
+        std::array<TradeMessage, N> trades;
+        for (size_t i = 0; i < N; ++i) trades[i] = {topic, 1700000000000, 100.0 + static_cast<double>(i), 3.5};
+        std::array<uint8_t, N * codec::wire_size<TradeMessage>> out;
+        codec::encode_array(trades.data(), N, out.data());
+        return out;
+    }();
+    MutableFramePtr frame = Frame::allocate(BATCH_HEADER_SIZE + encoded.size());
+    uint8_t* p = frame->data();
+    p[0] = static_cast<uint8_t>(MsgType::BATCH);
+    p[1] = static_cast<uint8_t>(N >> 8);
+    p[2] = static_cast<uint8_t>(N & 0xFF);
+    std::memcpy(p + BATCH_HEADER_SIZE, encoded.data(), encoded.size());
+    frame->set_topic(topic);
+    return frame;
+}
+
+// Queues, handler state and frame pools grow to their working size during
+// this many rounds; what the measured loop allocates after that is per frame.
+constexpr int WARMUP_ROUNDS = 1000;
+
+void report(benchmark::State& state, size_t subs, uint64_t dropped_before, uint64_t allocations_before) {
+    uint64_t allocations = allocation_count() - allocations_before;
+    auto& stats = SlowConsumerStats::instance();
+    auto frames = static_cast<double>(state.iterations());
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * subs));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * subs * codec::DATA_FRAME_SIZE));
+    // frames the slow-consumer policy discarded because the writes fell behind
+    state.counters["dropped"] = static_cast<double>(stats.dropped_oldest.load() - dropped_before);
+    // heap allocations per routed frame; 0 in the steady state
+    state.counters["allocs"] = static_cast<double>(allocations) / frames;
+    if (allocations != 0) {
+        state.SkipWithError("the routing path allocated after the warm-up");
+        fail_check();
+    }
+}
+
+// One DATA frame handed to N subscriber sessions with deliver_raw, the
+// writes flushed by polling the shard's io_context.
+void BM_DeliverRaw(benchmark::State& state) {
+    auto subs = static_cast<size_t>(state.range(0));
+    BenchBroker broker;
+    Drain drain;
+    auto sessions = connect_sessions(broker, drain, subs);
+    FramePtr shared = data_frame(1);
+
+    boost::asio::io_context& io = broker.io_context();
+    for (int i = 0; i < WARMUP_ROUNDS; ++i) {
+        for (auto& s : sessions) s->deliver_raw(shared);
+        io.poll();
+    }
+    uint64_t dropped_before = SlowConsumerStats::instance().dropped_oldest.load();
+    uint64_t allocations_before = allocation_count();
+    for (auto _ : state) {
+        for (auto& s : sessions) s->deliver_raw(shared);
+        io.poll();
+    }
+    report(state, subs, dropped_before, allocations_before);
+
+    // let the writes in flight finish before the sessions go away
+    io.run_for(std::chrono::milliseconds(50));
+}
+BENCHMARK(BM_DeliverRaw)->ArgName("subs")->Arg(1)->Arg(8)->Arg(64)->UseRealTime();
+
+// The whole path of a published trade past decoding: a fresh frame from the
+// pool, Shard::publish looking up the N subscribers of its topic and queueing
+// it to each, the writes flushed by polling.
+void BM_PublishRoute(benchmark::State& state) {
+    auto subs = static_cast<size_t>(state.range(0));
+    BenchBroker broker;
+    Drain drain;
+    auto sessions = connect_sessions(broker, drain, subs);
+    for (auto& s : sessions) broker.subscriptions().subscribe(1, s);
+
+    Shard& shard = broker.shard();
+    boost::asio::io_context& io = broker.io_context();
+    for (int i = 0; i < WARMUP_ROUNDS; ++i) {
+        shard.publish(1, data_frame(1));
+        io.poll();
+    }
+    uint64_t dropped_before = SlowConsumerStats::instance().dropped_oldest.load();
+    uint64_t allocations_before = allocation_count();
+    for (auto _ : state) {
+        shard.publish(1, data_frame(1));
+        io.poll();
+    }
+    report(state, subs, dropped_before, allocations_before);
+
+    io.run_for(std::chrono::milliseconds(50));
+}
+BENCHMARK(BM_PublishRoute)->ArgName("subs")->Arg(1)->Arg(8)->Arg(64)->UseRealTime();
+
+// BM_PublishRoute with the frames allocated on another thread, as when the
+// publisher's session lives on another shard: this thread fills frames and
+// hands them over an SPSC inbox to the shard's thread, which routes them and
+// releases them when the writes complete.
+void BM_PublishRouteOtherThread(benchmark::State& state) {
+    auto subs = static_cast<size_t>(state.range(0));
+    BenchBroker broker;
+    Drain drain;
+    auto sessions = connect_sessions(broker, drain, subs);
+    for (auto& s : sessions) broker.subscriptions().subscribe(1, s);
+
+    SpscQueue<FramePtr> inbox(256);
+    std::atomic<bool> stop{false};
+    std::thread shard_thread([&] {
+        Shard& shard = broker.shard();
+        boost::asio::io_context& io = broker.io_context();
+        FramePtr frame;
+        while (!stop.load(std::memory_order_relaxed)) {
+            if (inbox.try_pop(frame)) shard.publish(1, std::move(frame));
+            io.poll();
+        }
+        io.run_for(std::chrono::milliseconds(50));
+    });
+    auto hand_over = [&inbox] {
+        FramePtr frame = data_frame(1);
+        while (!inbox.try_push(std::move(frame))) std::this_thread::yield();
+    };
+
+    // the queues of the two threads find their high-water marks by timing
+    // alone, so this warms up for a while instead of a number of rounds
+    auto warm = std::chrono::steady_clock::now() + std::chrono::milliseconds(500);
+    while (std::chrono::steady_clock::now() < warm) hand_over();
+    uint64_t dropped_before = SlowConsumerStats::instance().dropped_oldest.load();
+    uint64_t allocations_before = allocation_count();
+    for (auto _ : state) hand_over();
+    report(state, subs, dropped_before, allocations_before);
+
+    stop.store(true);
+    shard_thread.join();
+}
+BENCHMARK(BM_PublishRouteOtherThread)->ArgName("subs")->Arg(1)->Arg(8)->UseRealTime();
+
+// Shard::publish of a BATCH of 64 trades to N filtered subscribers of its
+// topic, subscriber i taking the eight trades priced from 100 + i % 57 on:
+// one pass over the trades for all filters, then a subset frame per filter.
+void BM_PublishFiltered(benchmark::State& state) {
+    constexpr size_t TRADES = 64;
+    auto subs = static_cast<size_t>(state.range(0));
+    BenchBroker broker;
+    Drain drain;
+    auto sessions = connect_sessions(broker, drain, subs);
+    Shard& shard = broker.shard();
+    for (size_t i = 0; i < sessions.size(); ++i) {
+        TradeFilter filter;
+        filter.price_lo = 100.0 + static_cast<double>(i % 57);
+        filter.price_hi = filter.price_lo + 7;
+        shard.subscribe_filtered(1, filter, sessions[i]);
+    }
+
+    boost::asio::io_context& io = broker.io_context();
+    for (int i = 0; i < WARMUP_ROUNDS; ++i) {
+        shard.publish(1, batch_frame<TRADES>(1));
+        io.poll();
+    }
+    uint64_t dropped_before = SlowConsumerStats::instance().dropped_oldest.load();
+    uint64_t allocations_before = allocation_count();
+    for (auto _ : state) {
+        shard.publish(1, batch_frame<TRADES>(1));
+        io.poll();
+    }
+    report(state, subs, dropped_before, allocations_before);
+    // trades tested, each against every filter
+    state.SetItemsProcessed(static_cast<int64_t>(state.iterations() * TRADES));
+    state.SetBytesProcessed(static_cast<int64_t>(state.iterations() * TRADES * codec::wire_size<TradeMessage>));
+
+    io.run_for(std::chrono::milliseconds(50));
+}
+BENCHMARK(BM_PublishFiltered)->ArgName("subs")->Arg(8)->Arg(64)->UseRealTime();
+
+// Shard::publish of a DATA frame to a topic whose only subscribers take its
+// 100 ms and 1 s bars: the per-trade aggregation, plus a BAR frame to each
+// whenever an interval ends.
+void BM_PublishBars(benchmark::State& state) {
+    BenchBroker broker;
+    Drain drain;
+    auto sessions = connect_sessions(broker, drain, 2);
+    Shard& shard = broker.shard();
+    shard.subscribe_bars(1, 100, sessions[0]);
+    shard.subscribe_bars(1, 1000, sessions[1]);
+
+    // until both intervals have ended once, so the BAR frames have pool blocks
+    boost::asio::io_context& io = broker.io_context();
+    auto warm = std::chrono::steady_clock::now() + std::chrono::milliseconds(1100);
+    while (std::chrono::steady_clock::now() < warm) {
+        shard.publish(1, data_frame(1));
+        io.poll();
+    }
+    uint64_t dropped_before = SlowConsumerStats::instance().dropped_oldest.load();
+    uint64_t allocations_before = allocation_count();
+    for (auto _ : state) {
+        shard.publish(1, data_frame(1));
+        io.poll();
+    }
+    report(state, 1, dropped_before, allocations_before);
+
+    io.run_for(std::chrono::milliseconds(50));
+}
+BENCHMARK(BM_PublishBars)->UseRealTime();
+
+}
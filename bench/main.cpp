@@ -0,0 +1,48 @@
+#include <benchmark/benchmark.h>
+#include <atomic>
+#include <cstdlib>
+#include <new>
+#include "../src/common/logger.h"
+#include "bench_support.h"
+
+// Every heap allocation in the process is counted, so a benchmark can report
+// how many its loop made (allocation_count() before and after).
+namespace {
+std::atomic<uint64_t> allocations{0};
+std::atomic<bool> failed{false};
+}
+
+uint64_t allocation_count() {
+    return allocations.load(std::memory_order_relaxed);
+}
+
+void fail_check() {
+    failed.store(true);
+}
+
+void* operator new(std::size_t size) {
+    allocations.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) return p;
+    throw std::bad_alloc();
+}
+
+void operator delete(void* p) noexcept {
+    std::free(p);
+}
+
+void operator delete(void* p, std::size_t) noexcept {
+    std::free(p);
+}
+
+// bench [--benchmark_filter=REGEX] [--benchmark_repetitions=N]
+//       [--benchmark_out=FILE --benchmark_out_format=json]
+int main(int argc, char* argv[]) {
+    // unsubscribe_all logs every call; keep the report readable
+    Logger::set_level(LogLevel::WARN);
+
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return failed.load() ? 1 : 0;
+}
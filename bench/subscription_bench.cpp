@@ -0,0 +1,124 @@
+#include <benchmark/benchmark.h>
+#include <memory>
+#include <vector>
+#include "../src/broker/Epoch.h"
+#include "bench_support.h"
+
+namespace {
+
+// Routing table with `subs` exact subscribers on each of `topics` topics.
+// Multi-threaded runs share one table: thread 0 builds it before the timed
+// loop (all threads meet at its start) and drops it after the loop.
+struct Table {
+    BenchBroker broker;
+    std::vector<std::shared_ptr<ClientSession>> subscribers;
+    std::shared_ptr<ClientSession> extra;
+    int topics;
+
+    Table(int topics, size_t subs) : subscribers(broker.idle_sessions(subs)), topics(topics) {
+        extra = broker.idle_sessions(1)[0];
+        SubscriptionManager& mgr = broker.subscriptions();
+        for (int t = 0; t < topics; ++t) {
+            for (auto& s : subscribers) mgr.subscribe(t, s);
+            Epoch::reclaim();
+        }
+    }
+};
+
+std::unique_ptr<Table> shared_table;
+
+void setup(const benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        shared_table = std::make_unique<Table>(static_cast<int>(state.range(0)), static_cast<size_t>(state.range(1)));
+    }
+}
+
+void teardown(const benchmark::State& state) {
+    if (state.thread_index() == 0) {
+        shared_table.reset();
+        Epoch::reclaim();
+    }
+}
+
+// one routing lookup plus the walk over its subscribers, as Shard::route_local does
+void BM_GetSubscribers(benchmark::State& state) {
+    setup(state);
+    int topic = state.thread_index();
+    for (auto _ : state) {
+        Table& table = *shared_table;
+        auto view = table.broker.subscriptions().get_subscribers(topic);
+        for (const auto& s : view) benchmark::DoNotOptimize(s.get());
+        if (++topic == table.topics) topic = 0;
+    }
+    state.SetItemsProcessed(state.iterations());
+    teardown(state);
+}
+BENCHMARK(BM_GetSubscribers)->ArgNames({"topics", "subs"})->ArgsProduct({{16, 1024, 4096}, {1, 16, 64}});
+BENCHMARK(BM_GetSubscribers)->ArgNames({"topics", "subs"})->Args({1024, 16})->ThreadRange(1, 8)->UseRealTime();
+
+// lookups while thread 0 keeps subscribing and unsubscribing, which swaps
+// lists under the readers and retires the old ones
+void BM_GetSubscribersContended(benchmark::State& state) {
+    setup(state);
+    bool writer = state.thread_index() == 0 && state.threads() > 1;
+    int topic = state.thread_index();
+    int64_t writes = 0;
+    for (auto _ : state) {
+        Table& table = *shared_table;
+        SubscriptionManager& mgr = table.broker.subscriptions();
+        if (writer) {
+            mgr.subscribe(topic, table.extra);
+            mgr.unsubscribe(topic, table.extra);
+            if (++writes % 1024 == 0) Epoch::reclaim();
+        } else {
+            auto view = mgr.get_subscribers(topic);
+            for (const auto& s : view) benchmark::DoNotOptimize(s.get());
+        }
+        if (++topic == table.topics) topic = 0;
+    }
+    if (!writer) state.SetItemsProcessed(state.iterations());
+    state.counters["writes"] = benchmark::Counter(static_cast<double>(writes * 2), benchmark::Counter::kIsRate);
+    teardown(state);
+}
+BENCHMARK(BM_GetSubscribersContended)->ArgNames({"topics", "subs"})->Args({1024, 16})->ThreadRange(2, 8)->UseRealTime();
+
+// subscribe + unsubscribe of one more session on a populated topic
+void BM_SubscribeUnsubscribe(benchmark::State& state) {
+    setup(state);
+    Table& table = *shared_table;
+    SubscriptionManager& mgr = table.broker.subscriptions();
+    int topic = 0;
+    int64_t ops = 0;
+    for (auto _ : state) {
+        mgr.subscribe(topic, table.extra);
+        mgr.unsubscribe(topic, table.extra);
+        if (++topic == table.topics) topic = 0;
+        if (++ops % 1024 == 0) Epoch::reclaim();
+    }
+    state.SetItemsProcessed(state.iterations() * 2);
+    teardown(state);
+}
+BENCHMARK(BM_SubscribeUnsubscribe)->ArgNames({"topics", "subs"})->ArgsProduct({{16, 1024, 4096}, {1, 16, 64}});
+
+// a disconnect: unsubscribe_all of a session holding 8 topics (the 8
+// subscribes are part of each iteration)
+void BM_UnsubscribeAll(benchmark::State& state) {
+    setup(state);
+    Table& table = *shared_table;
+    SubscriptionManager& mgr = table.broker.subscriptions();
+    int topic = 0;
+    int64_t ops = 0;
+    for (auto _ : state) {
+        for (int i = 0; i < 8; ++i) {
+            mgr.subscribe(topic, table.extra);
+            if (++topic == table.topics) topic = 0;
+        }
+        mgr.unsubscribe_all(table.extra);
+        if (++ops % 128 == 0) Epoch::reclaim();
+    }
+    state.SetItemsProcessed(state.iterations());
+    teardown(state);
+}
+BENCHMARK(BM_UnsubscribeAll)->ArgNames({"topics", "subs"})->ArgsProduct({{16, 1024, 4096}, {1, 16, 64}});
+
+}
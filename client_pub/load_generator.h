@@ -0,0 +1,293 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../src/common/codec.h"
+#include "../src/common/logger.h"
+
+// Load-generator mode of the publisher (--load). N connections spread over
+// M io threads send pre-encoded DATA_TS frames either open-loop on a fixed
+// schedule (--rate, optionally in bursts) or closed-loop (next write when the
+// previous one completed). Right before the write every frame gets its send
+// time twice: as the publish stamp (trace_clock_ns()) and in timestamp_ms
+// (wall clock, milliseconds). Open-loop frames carry their scheduled time,
+// so a stalled broker shows up as latency instead of silently lowering the
+// offered load.
+// Every connection numbers its frames in the DATA_TS stream id and sequence
+// fields (a random id, and a per-topic sequence starting at 1), so a
+// subscriber can count what went missing on the way; price and quantity are
+// ordinary random trades.
+struct LoadOptions {
+    enum class Dist { UNIFORM, ZIPF, HOT };
+
+    uint64_t rate = 0;          // frames per second over all connections (open loop)
+    bool closed_loop = false;
+    unsigned connections = 1;
+    unsigned threads = 1;
+    int topics = 3;             // topic ids 1..topics
+    Dist dist = Dist::UNIFORM;
+    double zipf_s = 1.0;
+    double hot_share = 0.9;     // share of frames on topic 1 under Dist::HOT
+    uint64_t burst_frames = 0;  // open loop: send in bursts of this many frames...
+    std::chrono::milliseconds burst_period{0}; // ...every burst_period
+    size_t write_frames = 256;  // most frames handed to one write
+    std::chrono::seconds duration{10};
+
+    // "uniform", "zipf[:S]" or "hot[:SHARE]"
+    void parse_dist(const std::string& v) {
+        auto colon = v.find(':');
+        std::string kind = v.substr(0, colon);
+        bool has_arg = colon != std::string::npos;
+        if (kind == "uniform") {
+            dist = Dist::UNIFORM;
+        } else if (kind == "zipf") {
+            dist = Dist::ZIPF;
+            if (has_arg) zipf_s = std::stod(v.substr(colon + 1));
+        } else if (kind == "hot") {
+            dist = Dist::HOT;
+            if (has_arg) hot_share = std::stod(v.substr(colon + 1));
+        } else {
+            throw std::invalid_argument("unknown topic distribution " + v);
+        }
+    }
+
+    // "FRAMES/PERIOD_MS"
+    void parse_burst(const std::string& v) {
+        auto slash = v.find('/');
+        if (slash == std::string::npos) throw std::invalid_argument("expected FRAMES/PERIOD_MS for --burst");
+        burst_frames = std::stoull(v.substr(0, slash));
+        burst_period = std::chrono::milliseconds(std::stoll(v.substr(slash + 1)));
+    }
+
+    void validate() const {
+        if (connections == 0 || threads == 0 || topics < 1 || write_frames == 0) {
+            throw std::invalid_argument("--connections, --threads, --topics and --write-frames must be positive");
+        }
+        bool bursts = burst_frames > 0 && burst_period.count() > 0;
+        if (!closed_loop && rate == 0 && !bursts) {
+            throw std::invalid_argument("--load needs --rate N, --burst FRAMES/PERIOD_MS or --closed-loop");
+        }
+        if (!closed_loop && bursts && burst_frames < connections) {
+            throw std::invalid_argument("--burst needs at least one frame per connection");
+        }
+    }
+};
+
+// Draws topic ids 1..topics from the configured distribution.
+class TopicPicker {
+public:
+    TopicPicker(const LoadOptions& opts, uint64_t seed) : opts_(opts), rng_(seed) {
+        if (opts.dist != LoadOptions::Dist::ZIPF) return;
+        cdf_.reserve(opts.topics);
+        double sum = 0;
+        for (int k = 1; k <= opts.topics; ++k) {
+            sum += 1.0 / std::pow(k, opts.zipf_s);
+            cdf_.push_back(sum);
+        }
+        for (double& c : cdf_) c /= sum;
+    }
+
+    int32_t next() {
+        switch (opts_.dist) {
+            case LoadOptions::Dist::ZIPF: {
+                double u = unit_(rng_);
+                auto it = std::lower_bound(cdf_.begin(), cdf_.end(), u);
+                return static_cast<int32_t>(std::min<size_t>(it - cdf_.begin(), cdf_.size() - 1) + 1);
+            }
+            case LoadOptions::Dist::HOT:
+                if (opts_.topics == 1 || unit_(rng_) < opts_.hot_share) return 1;
+                return std::uniform_int_distribution<int32_t>(2, opts_.topics)(rng_);
+            case LoadOptions::Dist::UNIFORM:
+                break;
+        }
+        return std::uniform_int_distribution<int32_t>(1, opts_.topics)(rng_);
+    }
+
+private:
+    const LoadOptions& opts_;
+    std::mt19937_64 rng_;
+    std::uniform_real_distribution<double> unit_{0.0, 1.0};
+    std::vector<double> cdf_;
+};
+
+class LoadConnection : public std::enable_shared_from_this<LoadConnection> {
+public:
+    // frames encoded up front and sent round-robin
+    static constexpr size_t POOL_FRAMES = 64 * 1024;
+    static constexpr size_t FRAME_SIZE = DATA_TS_FRAME_SIZE;
+    static constexpr size_t TOPIC_OFFSET = FRAME_SIZE - codec::wire_size<TradeMessage>;
+    static constexpr size_t TS_OFFSET = TOPIC_OFFSET + 4;
+
+    LoadConnection(boost::asio::io_context& io, const LoadOptions& opts, double rate, uint64_t burst_frames,
+                   uint64_t seed)
+        : opts_(opts), socket_(io), timer_(io), rate_(rate), burst_frames_(burst_frames),
+          topic_seq_(static_cast<size_t>(opts.topics) + 1) {
+        TopicPicker topics(opts, seed);
+        std::mt19937_64 rng(seed ^ 0x9e3779b97f4a7c15ull);
+        std::uniform_real_distribution<double> price(100.0, 200.0);
+        std::uniform_real_distribution<double> qty(0.1, 5.0);
+        uint32_t stream_id = std::uniform_int_distribution<uint32_t>(1, UINT32_MAX)(rng);
+        pool_.resize(POOL_FRAMES * FRAME_SIZE);
+        for (size_t i = 0; i < POOL_FRAMES; ++i) {
+            TradeMessage msg{topics.next(), 0, price(rng), qty(rng)};
+            uint8_t* frame = pool_.data() + i * FRAME_SIZE;
+            frame[0] = static_cast<uint8_t>(MsgType::DATA_TS);
+            codec::store_be(frame + TRACE_STREAM_OFFSET, stream_id);
+            codec::encode(msg, frame + TOPIC_OFFSET);
+        }
+    }
+
+    void start(const boost::asio::ip::tcp::resolver::results_type& endpoints,
+               std::chrono::steady_clock::time_point start, std::chrono::steady_clock::time_point stop) {
+        start_ = start;
+        stop_ = stop;
+        auto self = shared_from_this();
+        boost::asio::async_connect(socket_, endpoints,
+            [this, self](boost::system::error_code ec, const boost::asio::ip::tcp::endpoint&) {
+                if (ec) {
+                    Logger::error("Load connection failed: " + ec.message());
+                    return;
+                }
+                socket_.set_option(boost::asio::ip::tcp::no_delay(true));
+                next();
+            });
+    }
+
+    uint64_t sent() const { return sent_.load(std::memory_order_relaxed); }
+
+private:
+    // frames the schedule wants sent by `now` (open loop)
+    uint64_t due(std::chrono::steady_clock::time_point now) const {
+        double t = std::chrono::duration<double>(now - start_).count();
+        if (t < 0) return 0;
+        if (burst_frames_ > 0) {
+            double period = std::chrono::duration<double>(opts_.burst_period).count();
+            return (static_cast<uint64_t>(t / period) + 1) * burst_frames_;
+        }
+        return static_cast<uint64_t>(t * rate_) + 1;
+    }
+
+    // scheduled send time of frame k, relative to the start (open loop)
+    std::chrono::nanoseconds scheduled(uint64_t k) const {
+        if (burst_frames_ > 0) return opts_.burst_period * static_cast<int64_t>(k / burst_frames_);
+        return std::chrono::nanoseconds(static_cast<int64_t>(static_cast<double>(k) * 1e9 / rate_));
+    }
+
+    void next() {
+        auto now = std::chrono::steady_clock::now();
+        if (now >= stop_) {
+            boost::system::error_code ignored;
+            socket_.shutdown(boost::asio::ip::tcp::socket::shutdown_both, ignored);
+            return;
+        }
+        uint64_t count = opts_.write_frames;
+        if (!opts_.closed_loop) {
+            uint64_t want = due(now);
+            uint64_t have = sent_.load(std::memory_order_relaxed);
+            if (want <= have) {
+                // sleep until the next frame is due
+                timer_.expires_at(start_ + std::chrono::duration_cast<std::chrono::steady_clock::duration>(scheduled(have)));
+                auto self = shared_from_this();
+                timer_.async_wait([this, self](boost::system::error_code ec) {
+                    if (!ec) next();
+                });
+                return;
+            }
+            count = std::min<uint64_t>(count, want - have);
+        }
+        send(count);
+    }
+
+    // one write of up to count consecutive pool frames, stamped just before it
+    void send(uint64_t count) {
+        size_t first = cursor_;
+        count = std::min<uint64_t>(count, POOL_FRAMES - first);
+        uint64_t base = sent_.load(std::memory_order_relaxed);
+        auto now = std::chrono::steady_clock::now();
+        auto wall_now = std::chrono::system_clock::now();
+        for (size_t i = 0; i < count; ++i) {
+            // the same instant on both clocks
+            auto offset = opts_.closed_loop
+                ? std::chrono::nanoseconds(0)
+                : std::chrono::duration_cast<std::chrono::nanoseconds>(start_ - now) + scheduled(base + i);
+            auto published = std::chrono::duration_cast<std::chrono::nanoseconds>(now.time_since_epoch() + offset);
+            auto wall = std::chrono::duration_cast<std::chrono::milliseconds>(wall_now.time_since_epoch() + offset);
+            uint8_t* frame = pool_.data() + (first + i) * FRAME_SIZE;
+            codec::store_be(frame + TRACE_PUBLISH_OFFSET, static_cast<uint64_t>(published.count()));
+            codec::store_be(frame + TS_OFFSET, static_cast<uint64_t>(wall.count()));
+            auto topic = static_cast<size_t>(codec::load_be<int32_t>(frame + TOPIC_OFFSET));
+            codec::store_be(frame + TRACE_SEQ_OFFSET, ++topic_seq_[topic]);
+        }
+        cursor_ = (first + count) % POOL_FRAMES;
+
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_,
+            boost::asio::buffer(pool_.data() + first * FRAME_SIZE, count * FRAME_SIZE),
+            [this, self, count](boost::system::error_code ec, std::size_t) {
+                if (ec) {
+                    Logger::error("Load send error: " + ec.message());
+                    return;
+                }
+                sent_.fetch_add(count, std::memory_order_relaxed);
+                next();
+            });
+    }
+
+    const LoadOptions& opts_;
+    boost::asio::ip::tcp::socket socket_;
+    boost::asio::steady_timer timer_;
+    double rate_;
+    uint64_t burst_frames_;
+    std::vector<uint8_t> pool_;
+    size_t cursor_ = 0;
+    std::vector<uint64_t> topic_seq_;
+    std::atomic<uint64_t> sent_{0};
+    std::chrono::steady_clock::time_point start_, stop_;
+};
+
+inline int run_load(const LoadOptions& opts, const std::string& host, const std::string& port) {
+    opts.validate();
+    boost::asio::io_context io;
+    boost::asio::ip::tcp::resolver resolver(io);
+    auto endpoints = resolver.resolve(host, port);
+
+    // every connection gets an equal share of the rate and of each burst
+    std::vector<std::shared_ptr<LoadConnection>> conns;
+    for (unsigned i = 0; i < opts.connections; ++i) {
+        double rate = static_cast<double>(opts.rate) / opts.connections;
+        uint64_t burst = opts.burst_frames / opts.connections + (i < opts.burst_frames % opts.connections ? 1 : 0);
+        conns.push_back(std::make_shared<LoadConnection>(io, opts, rate, burst, std::random_device{}()));
+    }
+
+    auto start = std::chrono::steady_clock::now() + std::chrono::milliseconds(100);
+    auto stop = start + opts.duration;
+    for (auto& c : conns) c->start(endpoints, start, stop);
+    Logger::info("Load: " + std::to_string(opts.connections) + " connections on " + std::to_string(opts.threads) +
+                 " threads for " + std::to_string(opts.duration.count()) + " s");
+
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < opts.threads; ++i) threads.emplace_back([&io] { io.run(); });
+    for (auto& t : threads) t.join();
+
+    uint64_t total = 0;
+    for (auto& c : conns) total += c->sent();
+    double secs = std::chrono::duration<double>(opts.duration).count();
+    std::string offered = "closed loop";
+    if (!opts.closed_loop && opts.burst_frames > 0) {
+        offered = std::to_string(opts.burst_frames) + " every " + std::to_string(opts.burst_period.count()) + " ms";
+    } else if (!opts.closed_loop) {
+        offered = std::to_string(opts.rate) + "/s";
+    }
+    std::printf("load: sent %llu frames in %.1f s (%.0f frames/s, offered %s)\n",
+                static_cast<unsigned long long>(total), secs, total / secs, offered.c_str());
+    return 0;
+}
@@ -4,15 +4,35 @@
 #include <chrono>
 #include <random>
 #include "../src/common/message.h"
-#include "../src/common/serializer.h"
+#include "../src/common/codec.h"
 #include "../src/common/logger.h" 
+#include "../src/common/shm_ring.h"
+#include "../src/common/low_latency.h"
+#include "load_generator.h"
+#include <cstdio>
+#include <algorithm>
+#include <optional>
+#include <string>
+#include <stdexcept>
 
 using boost::asio::ip::tcp;
 
+struct PublisherOptions {
+    bool use_shm = false;
+    std::chrono::microseconds interval{std::chrono::seconds(1)};
+    // batching mode: up to batch_max trades per BATCH frame, none waiting
+    // longer than batch_linger (batch_max 0 sends one DATA frame per trade)
+    size_t batch_max = 0;
+    std::chrono::microseconds batch_linger{1000};
+    // every Nth trade goes out as DATA_TS to trace its hops (0: none)
+    unsigned trace_every = 0;
+};
+
 class PublisherClient : public std::enable_shared_from_this<PublisherClient> {
 public:
-    PublisherClient(boost::asio::io_context& io) 
-        : socket_(io), resolver_(io), timer_(io), message_count_(0) {
+    PublisherClient(boost::asio::io_context& io, const PublisherOptions& opts)
+        : socket_(io), resolver_(io), timer_(io), message_count_(0), use_shm_(opts.use_shm),
+          opts_(opts), batch_timer_(io) {
     }
     void start(const std::string& host, const std::string& port) {
         do_resolve(host, port);
@@ -28,6 +48,15 @@ private:
     std::uniform_real_distribution<double> price_dist {100.0, 200.0};
     std::uniform_real_distribution<double> qty_dist {0.1, 5.0};
     std::uniform_int_distribution<int32_t> topic_dist {1, 3};
+    bool use_shm_;
+    std::optional<shm::Segment> segment_;
+    shm::Ring shm_tx_;
+
+    PublisherOptions opts_;
+    std::vector<TradeMessage> pending_;
+    std::chrono::steady_clock::time_point batch_deadline_;
+    boost::asio::steady_timer batch_timer_;
+    bool writing_ = false;
 
     void do_resolve(const std::string& host, const std::string& port) {
         auto self = shared_from_this();
@@ -47,6 +76,9 @@ private:
             [this, self](boost::system::error_code ec, const tcp::endpoint& ) {
                 if (!ec) {
                     Logger::info("Publisher connected to broker");
+                    std::string refused = low_latency::apply(socket_, SocketTuning{});
+                    if (!refused.empty()) Logger::warn("Socket options refused: " + refused);
+                    if (use_shm_ && !attach_shm()) return;
                     start_send_loop(); 
                 } else {
                     Logger::error("Publisher Connect error: " + ec.message());
@@ -54,10 +86,41 @@ private:
             });
     }
 
+    // Hands the broker a shared-memory segment; DATA frames then go through its
+    // client-to-broker ring instead of the socket.
+    bool attach_shm() {
+        try {
+            char name[shm::NAME_SIZE];
+            std::snprintf(name, sizeof(name), "/llpsb-pub-%08x", std::random_device{}());
+            segment_.emplace(shm::Segment::create(name));
+            auto attach = shm::attach_frame(segment_->name());
+            boost::asio::write(socket_, boost::asio::buffer(attach));
+            if (!segment_->wait_attached(std::chrono::seconds(2))) {
+                Logger::error("Broker did not attach the shared memory segment");
+                return false;
+            }
+            segment_->unlink();
+            shm_tx_ = segment_->to_broker();
+            Logger::info("Publisher switched to shared memory");
+            return true;
+        } catch (std::exception& e) {
+            Logger::error("Shared memory error: " + std::string(e.what()));
+            return false;
+        }
+    }
+
+    void send_shm() {
+        // a full ring means the broker is behind; wait for it to make room
+        while (!shm_tx_.try_write(out_message_.data(), out_message_.size())) {
+            segment_->header()->client_bell.wait(shm::Doorbell::SPACE,
+                [&] { return shm_tx_.has_space(out_message_.size()); }, std::chrono::milliseconds(100));
+        }
+    }
+
     void start_send_loop() {
         if (message_count_ >= 2000) return; 
 
-        timer_.expires_after(std::chrono::seconds(1)); 
+        timer_.expires_after(opts_.interval);
         
         auto self = shared_from_this();
         timer_.async_wait(
@@ -79,12 +142,31 @@ private:
         msg.price = price_dist(rng_);
         msg.quantity = qty_dist(rng_);
 
-        out_message_.clear(); 
-        out_message_.push_back(static_cast<uint8_t>(MsgType::DATA));
-        serializer::write_int32_be(out_message_, msg.topic_id);
-        serializer::write_uint64_be(out_message_, msg.timestamp_ms);
-        serializer::write_double_be(out_message_, msg.price);
-        serializer::write_double_be(out_message_, msg.quantity);
+        if (opts_.batch_max > 0) {
+            add_to_batch(msg);
+            start_send_loop();
+            return;
+        }
+
+        if (opts_.trace_every > 0 && message_count_ % opts_.trace_every == 0) {
+            out_message_.assign(DATA_TS_FRAME_SIZE, 0);
+            out_message_[0] = static_cast<uint8_t>(MsgType::DATA_TS);
+            codec::encode(msg, out_message_.data() + DATA_TS_FRAME_SIZE - codec::wire_size<TradeMessage>);
+            codec::store_be(out_message_.data() + TRACE_PUBLISH_OFFSET, trace_clock_ns());
+        } else {
+            out_message_.resize(codec::DATA_FRAME_SIZE);
+            codec::encode_data(msg, out_message_.data());
+        }
+
+        if (use_shm_) {
+            send_shm();
+            message_count_++;
+            if (message_count_ % 10 == 0) {
+                Logger::info("Published message " + std::to_string(message_count_) + " to topic " + std::to_string(msg.topic_id));
+            }
+            start_send_loop();
+            return;
+        }
 
         auto self = shared_from_this();
         boost::asio::async_write(socket_, boost::asio::buffer(out_message_.data(), out_message_.size()),
@@ -100,15 +182,121 @@ private:
                 start_send_loop(); 
             });
     }
+
+    void add_to_batch(const TradeMessage& msg) {
+        pending_.push_back(msg);
+        message_count_++;
+        if (pending_.size() == 1) {
+            batch_deadline_ = std::chrono::steady_clock::now() + opts_.batch_linger;
+            batch_timer_.expires_at(batch_deadline_);
+            auto self = shared_from_this();
+            batch_timer_.async_wait([this, self](const boost::system::error_code& ec) {
+                if (!ec) flush_batch();
+            });
+        }
+        if (pending_.size() >= opts_.batch_max) flush_batch();
+    }
+
+    // One BATCH frame, trades grouped by topic so the broker routes each
+    // topic once. A write in flight picks the batch up when it completes.
+    void flush_batch() {
+        if (pending_.empty() || writing_) return;
+        batch_timer_.cancel();
+        std::stable_sort(pending_.begin(), pending_.end(),
+            [](const TradeMessage& a, const TradeMessage& b) { return a.topic_id < b.topic_id; });
+
+        size_t count = pending_.size();
+        out_message_.resize(BATCH_HEADER_SIZE + count * codec::wire_size<TradeMessage>);
+        out_message_[0] = static_cast<uint8_t>(MsgType::BATCH);
+        out_message_[1] = static_cast<uint8_t>(count >> 8);
+        out_message_[2] = static_cast<uint8_t>(count & 0xFF);
+        codec::encode_array(pending_.data(), count, out_message_.data() + BATCH_HEADER_SIZE);
+        pending_.clear();
+
+        if (use_shm_) {
+            send_shm();
+            Logger::info("Published batch of " + std::to_string(count) + " trades");
+            return;
+        }
+
+        writing_ = true;
+        auto self = shared_from_this();
+        boost::asio::async_write(socket_, boost::asio::buffer(out_message_.data(), out_message_.size()),
+            [this, self, count](boost::system::error_code ec, std::size_t ) {
+                writing_ = false;
+                if (ec) {
+                    Logger::error("Publish send error: " + ec.message());
+                    return;
+                }
+                Logger::info("Published batch of " + std::to_string(count) + " trades");
+                if (!pending_.empty() && (pending_.size() >= opts_.batch_max ||
+                                          std::chrono::steady_clock::now() >= batch_deadline_)) {
+                    flush_batch();
+                }
+            });
+    }
 };
 
-int main() {
+int main(int argc, char* argv[]) {
     try {
+        // publisher [--port N] [--shm] [--interval-us N] [--batch N] [--batch-us N] [--trace-every N]
+        // publisher --load [--rate N | --burst FRAMES/PERIOD_MS | --closed-loop] [--connections N]
+        //           [--threads N] [--topics N] [--dist uniform|zipf[:S]|hot[:SHARE]]
+        //           [--write-frames N] [--duration S]
+        PublisherOptions opts;
+        LoadOptions load;
+        bool load_mode = false;
+        std::string port = "8080";
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            bool has_value = i + 1 < argc;
+            if (arg == "--load") {
+                load_mode = true;
+            } else if (arg == "--rate" && has_value) {
+                load.rate = std::stoull(argv[++i]);
+            } else if (arg == "--closed-loop") {
+                load.closed_loop = true;
+            } else if (arg == "--connections" && has_value) {
+                load.connections = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--threads" && has_value) {
+                load.threads = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else if (arg == "--topics" && has_value) {
+                load.topics = std::stoi(argv[++i]);
+            } else if (arg == "--dist" && has_value) {
+                load.parse_dist(argv[++i]);
+            } else if (arg == "--burst" && has_value) {
+                load.parse_burst(argv[++i]);
+            } else if (arg == "--write-frames" && has_value) {
+                load.write_frames = std::stoul(argv[++i]);
+            } else if (arg == "--duration" && has_value) {
+                load.duration = std::chrono::seconds(std::stoll(argv[++i]));
+            } else if (arg == "--port" && has_value) {
+                port = argv[++i];
+            } else if (arg == "--shm") {
+                opts.use_shm = true;
+            } else if (arg == "--interval-us" && i + 1 < argc) {
+                opts.interval = std::chrono::microseconds(std::stoll(argv[++i]));
+            } else if (arg == "--batch" && i + 1 < argc) {
+                opts.batch_max = std::min<size_t>(std::stoul(argv[++i]), MAX_BATCH_RECORDS);
+            } else if (arg == "--batch-us" && i + 1 < argc) {
+                opts.batch_linger = std::chrono::microseconds(std::stoll(argv[++i]));
+            } else if (arg == "--trace-every" && i + 1 < argc) {
+                opts.trace_every = static_cast<unsigned>(std::stoul(argv[++i]));
+            } else {
+                throw std::invalid_argument("unknown option " + arg);
+            }
+        }
+
+        if (load_mode) return run_load(load, "127.0.0.1", port);
+        if (opts.trace_every > 0 && opts.batch_max > 0) {
+            throw std::invalid_argument("--trace-every sends single frames, drop --batch");
+        }
+
         boost::asio::io_context io;
         
-        auto publisher = std::make_shared<PublisherClient>(io);
+        auto publisher = std::make_shared<PublisherClient>(io, opts);
 
-        publisher->start("127.0.0.1", "8080");
+        publisher->start("127.0.0.1", port);
 
         io.run();
 
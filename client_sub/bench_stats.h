@@ -0,0 +1,147 @@
+#pragma once
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <stdexcept>
+#include <string>
+#include <unordered_map>
+#include "../src/common/histogram.h"
+#include "../src/common/message.h"
+
+// Benchmark mode of the subscriber (--bench): instead of printing, every trade
+// feeds an end-to-end latency histogram (receive time minus send time, which
+// the caller takes from the publish stamp of a DATA_TS frame or, at
+// millisecond resolution, from timestamp_ms). DATA_TS frames additionally feed
+// one histogram per hop and, when numbered by the load generator, per-stream
+// loss counters.
+// Intervals and the whole run are reported as text, CSV or JSON lines.
+class BenchStats {
+public:
+    enum class Format { TEXT, CSV, JSON };
+
+    static Format parse_format(const std::string& v) {
+        if (v == "text") return Format::TEXT;
+        if (v == "csv") return Format::CSV;
+        if (v == "json") return Format::JSON;
+        throw std::invalid_argument("unknown report format " + v);
+    }
+
+    BenchStats(Format format, std::chrono::milliseconds interval)
+        : format_(format), interval_(interval), start_(std::chrono::steady_clock::now()),
+          last_report_(start_), next_report_(start_ + interval) {
+        if (format_ == Format::CSV) {
+            std::printf("kind,elapsed_s,frames,rate,lost,reordered,min_ns,p50_ns,p99_ns,p999_ns,max_ns,mean_ns,"
+                        "traced,pub_broker_p50_ns,pub_broker_p99_ns,broker_p50_ns,broker_p99_ns,"
+                        "broker_sub_p50_ns,broker_sub_p99_ns\n");
+        }
+    }
+
+    void record(uint64_t latency) {
+        window_.record(latency);
+        total_.record(latency);
+    }
+
+    // stream id (not 0) and sequence number of a numbered DATA_TS frame
+    void record_sequence(uint32_t stream, int32_t topic, uint64_t seq) {
+        uint64_t key = (static_cast<uint64_t>(stream) << 32) | static_cast<uint32_t>(topic);
+        uint64_t& next = next_seq_[key];
+        if (next != 0 && seq > next) {
+            window_lost_ += seq - next;
+            lost_ += seq - next;
+        } else if (next != 0 && seq < next) {
+            ++window_reordered_;
+            ++reordered_;
+            return;
+        }
+        next = seq + 1;
+    }
+
+    // hop latencies of one DATA_TS frame, publisher->broker, in the broker,
+    // broker->subscriber
+    void record_hops(uint64_t to_broker, uint64_t in_broker, uint64_t to_subscriber) {
+        uint64_t hops[HOPS] = {to_broker, in_broker, to_subscriber};
+        for (size_t i = 0; i < HOPS; ++i) {
+            window_hops_[i].record(hops[i]);
+            total_hops_[i].record(hops[i]);
+        }
+    }
+
+    // prints an interval line when one is due
+    void tick(std::chrono::steady_clock::time_point now) {
+        if (now < next_report_) return;
+        report("interval", window_, window_hops_, now - last_report_, window_lost_, window_reordered_);
+        window_.reset();
+        for (auto& h : window_hops_) h.reset();
+        window_lost_ = window_reordered_ = 0;
+        last_report_ = now;
+        next_report_ = now + interval_;
+    }
+
+    void finish() {
+        if (finished_) return;
+        finished_ = true;
+        report("total", total_, total_hops_, std::chrono::steady_clock::now() - start_, lost_, reordered_);
+    }
+
+private:
+    static constexpr size_t HOPS = 3;
+    using Hops = std::array<Histogram, HOPS>;
+
+    void report(const char* kind, const Histogram& h, const Hops& hops, std::chrono::steady_clock::duration span,
+                uint64_t lost, uint64_t reordered) {
+        double secs = std::chrono::duration<double>(span).count();
+        double elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - start_).count();
+        double rate = secs > 0 ? static_cast<double>(h.count()) / secs : 0.0;
+        auto frames = static_cast<unsigned long long>(h.count());
+        auto p = [&](double q) { return static_cast<unsigned long long>(h.percentile(q)); };
+        auto us = [&](double q) { return static_cast<double>(h.percentile(q)) / 1000.0; };
+        auto traced = static_cast<unsigned long long>(hops[0].count());
+        auto hop = [&](size_t i, double q) { return static_cast<unsigned long long>(hops[i].percentile(q)); };
+
+        switch (format_) {
+            case Format::TEXT:
+                std::printf("[bench %s] t=%.1fs frames=%llu (%.0f/s) lost=%llu reordered=%llu latency us: "
+                            "p50=%.1f p99=%.1f p99.9=%.1f max=%.1f\n",
+                            kind, elapsed, frames, rate, static_cast<unsigned long long>(lost),
+                            static_cast<unsigned long long>(reordered), us(50), us(99), us(99.9), h.max() / 1000.0);
+                if (traced > 0) {
+                    std::printf("[bench %s] traced=%llu hop us p50/p99: pub->broker=%.1f/%.1f broker=%.1f/%.1f "
+                                "broker->sub=%.1f/%.1f\n",
+                                kind, traced, hop(0, 50) / 1000.0, hop(0, 99) / 1000.0, hop(1, 50) / 1000.0,
+                                hop(1, 99) / 1000.0, hop(2, 50) / 1000.0, hop(2, 99) / 1000.0);
+                }
+                break;
+            case Format::CSV:
+                std::printf("%s,%.3f,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%llu,%.0f,%llu,%llu,%llu,%llu,%llu,%llu,%llu\n",
+                            kind, elapsed, frames, rate, static_cast<unsigned long long>(lost),
+                            static_cast<unsigned long long>(reordered), static_cast<unsigned long long>(h.min()), p(50),
+                            p(99), p(99.9), static_cast<unsigned long long>(h.max()), h.mean(), traced, hop(0, 50),
+                            hop(0, 99), hop(1, 50), hop(1, 99), hop(2, 50), hop(2, 99));
+                break;
+            case Format::JSON:
+                std::printf("{\"kind\":\"%s\",\"elapsed_s\":%.3f,\"frames\":%llu,\"rate\":%.0f,\"lost\":%llu,"
+                            "\"reordered\":%llu,\"min_ns\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,"
+                            "\"max_ns\":%llu,\"mean_ns\":%.0f,\"traced\":%llu,\"pub_broker_p50_ns\":%llu,"
+                            "\"pub_broker_p99_ns\":%llu,\"broker_p50_ns\":%llu,\"broker_p99_ns\":%llu,"
+                            "\"broker_sub_p50_ns\":%llu,\"broker_sub_p99_ns\":%llu}\n",
+                            kind, elapsed, frames, rate, static_cast<unsigned long long>(lost),
+                            static_cast<unsigned long long>(reordered), static_cast<unsigned long long>(h.min()),
+                            p(50), p(99), p(99.9), static_cast<unsigned long long>(h.max()), h.mean(), traced,
+                            hop(0, 50), hop(0, 99), hop(1, 50), hop(1, 99), hop(2, 50), hop(2, 99));
+                break;
+        }
+        std::fflush(stdout);
+    }
+
+    Format format_;
+    std::chrono::milliseconds interval_;
+    std::chrono::steady_clock::time_point start_, last_report_, next_report_;
+    Histogram window_, total_;
+    Hops window_hops_, total_hops_;
+    uint64_t window_lost_ = 0, window_reordered_ = 0;
+    uint64_t lost_ = 0, reordered_ = 0;
+    // (stream id << 32 | topic) -> next expected sequence number
+    std::unordered_map<uint64_t, uint64_t> next_seq_;
+    bool finished_ = false;
+};
@@ -5,19 +5,136 @@
 #include <memory>
 #include <array>
 #include <vector> 
+#include <string>
+#include <stdexcept>
 #include "../src/common/message.h"
 #include "../src/common/serializer.h"
+#include "../src/common/codec.h"
 #include "../src/common/logger.h" 
+#include "../src/common/recv_buffer.h"
+#include "../src/common/shm_ring.h"
+#include "../src/common/topic_pattern.h"
+#include "../src/common/trade_filter.h"
+#include "../src/common/low_latency.h"
+#include <random>
+#include <cstdio>
+#include <unordered_map>
+#include <map>
+#include <deque>
+#include <functional>
+#include <csignal>
+#include <optional>
+#include "bench_stats.h"
 
 using boost::asio::ip::tcp;
+using boost::asio::ip::udp;
+
+// set by SIGINT/SIGTERM in bench mode so the final report still gets printed
+volatile std::sig_atomic_t stop_requested = 0;
+
+// Subscription spec from the command line: "5" (one topic), "100-199"
+// (inclusive range), "0x1200/0xff00" (value/mask) or "all". Returns the
+// subscribe frame; *match receives the equivalent filter.
+std::vector<uint8_t> build_subscribe(const std::string& spec, TopicPattern* match = nullptr) {
+    std::vector<uint8_t> msg;
+    TopicPattern pattern;
+    auto num = [](const std::string& s) { return static_cast<int32_t>(std::stoll(s, nullptr, 0)); };
+
+    if (spec == "all") {
+        msg.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE_ALL));
+        pattern = TopicPattern::all();
+    } else if (auto slash = spec.find('/'); slash != std::string::npos) {
+        msg.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE_MASK));
+        serializer::write_int32_be(msg, num(spec.substr(0, slash)));
+        serializer::write_int32_be(msg, num(spec.substr(slash + 1)));
+        pattern = TopicPattern::masked(num(spec.substr(0, slash)), num(spec.substr(slash + 1)));
+    } else if (auto dash = spec.find('-', 1); dash != std::string::npos) {
+        msg.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE_RANGE));
+        serializer::write_int32_be(msg, num(spec.substr(0, dash)));
+        serializer::write_int32_be(msg, num(spec.substr(dash + 1)));
+        pattern = TopicPattern::range(num(spec.substr(0, dash)), num(spec.substr(dash + 1)));
+    } else {
+        msg.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE));
+        serializer::write_int32_be(msg, num(spec));
+        pattern = TopicPattern::range(num(spec), num(spec));
+    }
+    if (match) *match = pattern;
+    return msg;
+}
+
+// "LO:HI" for --price/--qty into *lo and *hi; an empty side stays open ("2:")
+void parse_band(const std::string& v, double* lo, double* hi) {
+    auto colon = v.find(':');
+    if (colon == std::string::npos) throw std::invalid_argument("expected LO:HI, got " + v);
+    if (colon > 0) *lo = std::stod(v.substr(0, colon));
+    if (colon + 1 < v.size()) *hi = std::stod(v.substr(colon + 1));
+}
+
+struct SubscriberOptions {
+    std::string spec = "1";
+    bool use_shm = false;
+    // spin instead of sleeping: on the shared-memory ring, or on the event
+    // loop with SO_BUSY_POLL and TCP_QUICKACK over TCP
+    bool busy_poll = false;
+    // multicast group to receive the broker's multicast topics from (empty: TCP only)
+    std::string mcast_group;
+    uint16_t mcast_port = 0;
+    std::string mcast_interface = "0.0.0.0";
+    // frames per topic the broker keeps for retransmit (its --mcast-retransmit)
+    uint64_t mcast_window = 4096;
+    // replay the topic from the broker's journal before live data
+    bool replay = false;
+    uint8_t replay_mode = 0; // 0: from sequence number, 1: from timestamp_ms
+    uint64_t replay_from = 0;
+    // measure instead of printing (see bench_stats.h)
+    bool bench = false;
+    std::chrono::milliseconds report_interval{1000};
+    BenchStats::Format report_format = BenchStats::Format::TEXT;
+    // send UNSUBSCRIBE for the spec after this many trades (0: never)
+    uint64_t unsubscribe_after = 0;
+    // have the broker send only the trades passing this (--price, --qty)
+    std::optional<TradeFilter> filter;
+    // receive the topic's bars of this interval instead of its trades (0: trades)
+    uint32_t bars_ms = 0;
+};
 
 class SubscriberClient : public std::enable_shared_from_this<SubscriberClient> {
 public:
     static constexpr size_t PAYLOAD_SIZE = sizeof(TradeMessage);
+    // JOURNAL_DATA / RETRANSMIT body: uint64 seq + DATA frame
+    static constexpr size_t SEQ_FRAME_SIZE = 8 + 1 + PAYLOAD_SIZE;
 
-    SubscriberClient(boost::asio::io_context& io, const std::string& host, const std::string& port, int topic_id)
-        : socket_(io), resolver_(io), topic_id_(topic_id) {
-
+    SubscriberClient(boost::asio::io_context& io, const std::string& host, const std::string& port, const SubscriberOptions& opts)
+        : socket_(io), resolver_(io), spec_(opts.spec), use_shm_(opts.use_shm), busy_poll_(opts.busy_poll),
+          opts_(opts), udp_socket_(io), report_timer_(io), in_(64 * 1024) {
+        if (opts.bench) bench_.emplace(opts.report_format, opts.report_interval);
+        sub_message_ = build_subscribe(opts.spec, &match_);
+        if (opts.filter) {
+            if (sub_message_[0] != static_cast<uint8_t>(MsgType::SUBSCRIBE) || opts.replay) {
+                throw std::invalid_argument("--price/--qty need a single topic and no replay");
+            }
+            if (!opts.filter->valid()) throw std::invalid_argument("--price/--qty band is empty");
+            sub_message_[0] = static_cast<uint8_t>(MsgType::SUBSCRIBE_FILTER);
+            sub_message_.resize(sub_message_.size() + TradeFilter::WIRE_SIZE);
+            opts.filter->encode(sub_message_.data() + sub_message_.size() - TradeFilter::WIRE_SIZE);
+        }
+        if (opts.bars_ms > 0) {
+            if (sub_message_[0] != static_cast<uint8_t>(MsgType::SUBSCRIBE) || opts.replay) {
+                throw std::invalid_argument("--bars needs a single topic and no replay or filter");
+            }
+            sub_message_[0] = static_cast<uint8_t>(MsgType::SUBSCRIBE_BARS);
+            serializer::write_int32_be(sub_message_, static_cast<int32_t>(opts.bars_ms));
+        }
+        unsub_message_ = sub_message_;
+        unsub_message_.insert(unsub_message_.begin(), static_cast<uint8_t>(MsgType::UNSUBSCRIBE));
+        if (opts.replay) {
+            if (sub_message_[0] != static_cast<uint8_t>(MsgType::SUBSCRIBE)) {
+                throw std::invalid_argument("replay needs a single topic");
+            }
+            sub_message_[0] = static_cast<uint8_t>(MsgType::SUBSCRIBE_REPLAY);
+            sub_message_.push_back(opts.replay_mode);
+            serializer::write_uint64_be(sub_message_, opts.replay_from);
+        }
     }
 
     void start(const std::string& host, const std::string& port) {
@@ -40,89 +157,490 @@ private:
                             return;
                         }
                         Logger::info("Subscriber connected to broker.");
-                        do_send_subscribe();
+                        std::string refused = low_latency::apply(socket_, tuning());
+                        if (!refused.empty()) Logger::warn("Socket options refused: " + refused);
+                        if (use_shm_) {
+                            run_shm();
+                        } else {
+                            if (!opts_.mcast_group.empty()) start_multicast();
+                            do_send_subscribe();
+                        }
                     });
             });
     }
 
     void do_send_subscribe() {
-        // Priprema bafera za asinkrono slanje
-        sub_message_.reserve(1 + sizeof(int32_t));
-        sub_message_.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE));
-        serializer::write_int32_be(sub_message_, static_cast<int32_t>(topic_id_));
+        send_control(sub_message_, "Subscribe", [this] {
+            Logger::info("Subscribed to " + spec_);
+            if (bench_) start_report_timer();
+            do_read();
+        });
+    }
 
+    // Subscribe, unsubscribe and retransmit requests share the socket, so
+    // they are written one at a time in the order sent; done runs once the
+    // frame is out.
+    void send_control(std::vector<uint8_t> frame, std::string what, std::function<void()> done = nullptr) {
+        control_queue_.push_back({std::move(frame), std::move(what), std::move(done)});
+        if (control_queue_.size() == 1) write_control();
+    }
+
+    void write_control() {
         auto self = shared_from_this();
-        boost::asio::async_write(socket_, boost::asio::buffer(sub_message_.data(), sub_message_.size()),
-            [this, self](boost::system::error_code ec, std::size_t ) {
+        boost::asio::async_write(socket_, boost::asio::buffer(control_queue_.front().frame),
+            [this, self](boost::system::error_code ec, std::size_t) {
+                ControlWrite sent = std::move(control_queue_.front());
+                control_queue_.pop_front();
                 if (ec) {
-                    Logger::error("Subscribe send error: " + ec.message());
+                    Logger::error(sent.what + " send error: " + ec.message());
+                    control_queue_.clear();
                     return;
                 }
-                Logger::info("Subscribed to topic " + std::to_string(topic_id_));
-                
-                do_read_header();
+                if (!control_queue_.empty()) write_control();
+                if (sent.done) sent.done();
             });
     }
 
-    void do_read_header() {
+    // --busy-poll over TCP: the kernel spins on the device queue this long
+    // before a read sleeps, and every ACK goes out at once
+    static constexpr int SOCKET_BUSY_POLL_US = 50;
+    SocketTuning tuning() const {
+        SocketTuning t;
+        if (busy_poll_ && !use_shm_) {
+            t.busy_poll_us = SOCKET_BUSY_POLL_US;
+            t.quickack = true;
+        }
+        return t;
+    }
+
+    // Bulk reads into one buffer; every complete frame in it is handled before
+    // the next read, so a burst costs one completion instead of two per frame.
+    void do_read() {
         auto self = shared_from_this();
-        boost::asio::async_read(socket_, boost::asio::buffer(&msg_type_, 1),
-            [this, self](boost::system::error_code ec, std::size_t) {
+        socket_.async_read_some(boost::asio::buffer(in_.write_ptr(), in_.writable()),
+            [this, self](boost::system::error_code ec, std::size_t n) {
                 if (ec) {
                     Logger::error("Connection closed or read error: " + ec.message());
+                    if (!opts_.mcast_group.empty()) {
+                        Logger::info("Multicast gaps: " + std::to_string(gaps_) + " frames missed, " +
+                                     std::to_string(recovered_) + " recovered by retransmit");
+                    }
+                    udp_socket_.close();
+                    report_timer_.cancel();
+                    if (bench_) bench_->finish();
                     return;
                 }
-                if (msg_type_ == static_cast<uint8_t>(MsgType::DATA)) {
-                    do_read_data();
-                } else {
-                    Logger::warn("Received unexpected message type: " + std::to_string(static_cast<int>(msg_type_)));
-                }
+                in_.commit(n);
+                if (busy_poll_) low_latency::rearm_quickack(socket_);
+                if (!consume_frames(in_)) return;
+                in_.compact();
+                do_read();
             });
     }
 
-    void do_read_data() {
+    // Handles every complete frame in the buffer; false on a frame type this
+    // client does not understand.
+    bool consume_frames(RecvBuffer& in) {
+        while (in.readable() > 0) {
+            const uint8_t* p = in.read_ptr();
+            size_t avail = in.readable();
+            if (p[0] == static_cast<uint8_t>(MsgType::DATA)) {
+                if (avail < 1 + PAYLOAD_SIZE) break;
+                if (replayed_ > 0) {
+                    Logger::info("Replayed " + std::to_string(replayed_) + " frames up to journal seq " +
+                                 std::to_string(last_journal_seq_) + ", now live");
+                    replayed_ = 0;
+                }
+                print(p + 1);
+                in.consume(1 + PAYLOAD_SIZE);
+            } else if (p[0] == static_cast<uint8_t>(MsgType::DATA_TS)) {
+                if (avail < DATA_TS_FRAME_SIZE) break;
+                print_traced(p);
+                in.consume(DATA_TS_FRAME_SIZE);
+            } else if (p[0] == static_cast<uint8_t>(MsgType::BATCH)) {
+                // uint16 count, then count trades of one topic
+                if (avail < BATCH_HEADER_SIZE) break;
+                size_t count = batch_count(p);
+                if (avail < BATCH_HEADER_SIZE + count * PAYLOAD_SIZE) break;
+                codec::decode_array(p + BATCH_HEADER_SIZE, count, batch_msgs_.data());
+                for (size_t i = 0; i < count; ++i) print(batch_msgs_[i]);
+                in.consume(BATCH_HEADER_SIZE + count * PAYLOAD_SIZE);
+            } else if (p[0] == static_cast<uint8_t>(MsgType::BAR)) {
+                if (avail < codec::BAR_FRAME_SIZE) break;
+                print_bar(codec::decode<BarMessage>(p + 1));
+                in.consume(codec::BAR_FRAME_SIZE);
+            } else if (p[0] == static_cast<uint8_t>(MsgType::JOURNAL_DATA)) {
+                // one replayed frame: uint64 journal seq + DATA frame
+                if (avail < 1 + SEQ_FRAME_SIZE) break;
+                last_journal_seq_ = serializer::read_uint64_be(p + 1);
+                ++replayed_;
+                print(p + 1 + 8 + 1);
+                in.consume(1 + SEQ_FRAME_SIZE);
+            } else if (p[0] == static_cast<uint8_t>(MsgType::RETRANSMIT)) {
+                if (avail < 1 + SEQ_FRAME_SIZE) break;
+                uint64_t seq = serializer::read_uint64_be(p + 1);
+                const uint8_t* payload = p + 1 + 8 + 1;
+                int32_t topic_id = serializer::read_int32_be(payload);
+                if (take_missing(topic_id, seq)) {
+                    ++recovered_;
+                    print(payload);
+                }
+                in.consume(1 + SEQ_FRAME_SIZE);
+            } else {
+                Logger::warn("Received unexpected message type: " + std::to_string(static_cast<int>(p[0])));
+                return false;
+            }
+        }
+        return true;
+    }
+
+    void start_report_timer() {
         auto self = shared_from_this();
-        boost::asio::async_read(socket_, boost::asio::buffer(payload_buf_.data(), PAYLOAD_SIZE),
-            [this, self](boost::system::error_code ec, std::size_t) {
+        report_timer_.expires_after(std::chrono::milliseconds(100));
+        report_timer_.async_wait([this, self](boost::system::error_code ec) {
+            if (ec) return;
+            if (stop_requested) {
+                bench_->finish();
+                socket_.close();
+                udp_socket_.close();
+                return;
+            }
+            bench_->tick(std::chrono::steady_clock::now());
+            start_report_timer();
+        });
+    }
+
+    // Multicast mode: the broker's multicast topics arrive in datagrams on the
+    // group; MCAST_JOIN (sent ahead of the subscribe) keeps them off TCP.
+    // Sequence gaps are requested again over TCP.
+    void start_multicast() {
+        auto group = boost::asio::ip::make_address(opts_.mcast_group);
+        udp::endpoint listen(boost::asio::ip::address_v4::any(), opts_.mcast_port);
+        udp_socket_.open(listen.protocol());
+        udp_socket_.set_option(udp::socket::reuse_address(true));
+        udp_socket_.bind(listen);
+        udp_socket_.set_option(boost::asio::ip::multicast::join_group(
+            group.to_v4(), boost::asio::ip::make_address_v4(opts_.mcast_interface)));
+
+        std::vector<uint8_t> join{static_cast<uint8_t>(MsgType::MCAST_JOIN)};
+        sub_message_.insert(sub_message_.begin(), join.begin(), join.end());
+        Logger::info("Joined multicast group " + opts_.mcast_group + ":" + std::to_string(opts_.mcast_port));
+        do_receive_datagram();
+    }
+
+    void do_receive_datagram() {
+        auto self = shared_from_this();
+        udp_socket_.async_receive_from(boost::asio::buffer(datagram_), datagram_sender_,
+            [this, self](boost::system::error_code ec, std::size_t len) {
                 if (ec) {
-                    Logger::error("Data read error: " + ec.message());
+                    Logger::error("Multicast receive error: " + ec.message());
                     return;
                 }
-                
-                const uint8_t* p = payload_buf_.data();
-                int32_t topic_id = serializer::read_int32_be(p); p += 4;
-                uint64_t ts = serializer::read_uint64_be(p); p += 8;
-                double price = serializer::read_double_be(p); p += 8;
-                double qty = serializer::read_double_be(p);
-
-                std::cout << "[SUB: " << topic_id_ << "] topic=" << topic_id 
-                          << " price=" << price << " qty=" << qty << "\n";
-                
-                do_read_header();
+                on_datagram(datagram_.data(), len);
+                do_receive_datagram();
             });
     }
 
+    void on_datagram(const uint8_t* p, size_t len) {
+        if (len < 2) return;
+        size_t count = (static_cast<size_t>(p[0]) << 8) | p[1];
+        p += 2;
+        len -= 2;
+        for (size_t i = 0; i < count && len >= MCAST_RECORD_SIZE; ++i, p += MCAST_RECORD_SIZE, len -= MCAST_RECORD_SIZE) {
+            uint64_t seq = serializer::read_uint64_be(p);
+            const uint8_t* payload = p + 8 + 1;
+            int32_t topic_id = serializer::read_int32_be(payload);
+            if (!match_.matches(topic_id)) continue;
+
+            auto it = next_seq_.find(topic_id);
+            if (it != next_seq_.end()) {
+                uint64_t expected = it->second;
+                if (seq + opts_.mcast_window < expected) {
+                    // far older than anything a late duplicate could be: the
+                    // broker restarted and numbers the topic from 1 again
+                    Logger::warn("Topic " + std::to_string(topic_id) + " went back from seq " +
+                                 std::to_string(expected - 1) + " to " + std::to_string(seq) + ", starting over");
+                    missing_.erase(topic_id);
+                } else if (seq < expected) {
+                    continue; // duplicate
+                } else if (seq > expected) {
+                    request_retransmit(topic_id, expected, seq);
+                }
+            }
+            next_seq_[topic_id] = seq + 1;
+            print(payload);
+        }
+    }
+
+    // Asks for [first, end) of a topic over TCP. The broker keeps only the
+    // topic's last mcast_window frames, the one at end included, so anything
+    // older is lost at once; so are earlier gaps that fell out of the window.
+    void request_retransmit(int32_t topic_id, uint64_t first, uint64_t end) {
+        gaps_ += end - first;
+        uint64_t oldest = end + 1 > opts_.mcast_window ? end + 1 - opts_.mcast_window : 0;
+        auto& missing = missing_[topic_id];
+        while (!missing.empty() && missing.begin()->second <= oldest) missing.erase(missing.begin());
+        if (!missing.empty() && missing.begin()->first < oldest) {
+            uint64_t missing_end = missing.begin()->second;
+            missing.erase(missing.begin());
+            missing.emplace(oldest, missing_end);
+        }
+        Logger::warn("Gap of " + std::to_string(end - first) + " frames on topic " + std::to_string(topic_id) +
+                     (first < oldest ? ", " + std::to_string(oldest - first) + " beyond the retransmit window" : "") +
+                     ", requesting retransmit");
+        first = std::max(first, oldest);
+        if (first >= end) return;
+        missing.emplace(first, end);
+
+        std::vector<uint8_t> req{static_cast<uint8_t>(MsgType::RETRANSMIT_REQ)};
+        serializer::write_int32_be(req, topic_id);
+        serializer::write_uint64_be(req, first);
+        serializer::write_int32_be(req, static_cast<int32_t>(end - first));
+        send_control(std::move(req), "Retransmit request");
+    }
+
+    // removes seq from the topic's missing ranges; false if it was not missing
+    bool take_missing(int32_t topic_id, uint64_t seq) {
+        auto t = missing_.find(topic_id);
+        if (t == missing_.end()) return false;
+        auto& ranges = t->second;
+        auto it = ranges.upper_bound(seq);
+        if (it == ranges.begin()) return false;
+        --it;
+        uint64_t first = it->first, end = it->second;
+        if (seq >= end) return false;
+        ranges.erase(it);
+        if (first < seq) ranges.emplace(first, seq);
+        if (seq + 1 < end) ranges.emplace(seq + 1, end);
+        return true;
+    }
+
+    void print(const uint8_t* p) {
+        print(codec::decode<TradeMessage>(p));
+    }
+    // DATA_TS: the trade plus how long each hop took, publisher to broker,
+    // through the broker and broker to here (same-host clocks only)
+    void print_traced(const uint8_t* frame) {
+        uint64_t now = trace_clock_ns();
+        uint64_t published = serializer::read_uint64_be(frame + TRACE_PUBLISH_OFFSET);
+        uint64_t ingress = serializer::read_uint64_be(frame + TRACE_INGRESS_OFFSET);
+        uint64_t egress = serializer::read_uint64_be(frame + TRACE_EGRESS_OFFSET);
+        auto hop = [](uint64_t from, uint64_t to) { return from != 0 && to > from ? to - from : 0; };
+        auto trade = codec::decode<TradeMessage>(frame + DATA_TS_FRAME_SIZE - PAYLOAD_SIZE);
+        print(trade, hop(published, now));
+        if (bench_) {
+            bench_->record_hops(hop(published, ingress), hop(ingress, egress), hop(egress, now));
+            if (uint32_t stream = codec::load_be<uint32_t>(frame + TRACE_STREAM_OFFSET)) {
+                bench_->record_sequence(stream, trade.topic_id, codec::load_be<uint64_t>(frame + TRACE_SEQ_OFFSET));
+            }
+            return;
+        }
+        std::cout << "[SUB: " << spec_ << "] trace us: pub->broker=" << hop(published, ingress) / 1000.0
+                  << " broker=" << hop(ingress, egress) / 1000.0 << " broker->sub=" << hop(egress, now) / 1000.0 << "\n";
+    }
+
+    // latency: from the publish stamp of a DATA_TS frame; otherwise the
+    // wall clock against timestamp_ms
+    void print(const TradeMessage& msg, std::optional<uint64_t> latency = std::nullopt) {
+        if (++received_ == opts_.unsubscribe_after) send_unsubscribe();
+        if (bench_) {
+            if (!latency) {
+                auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                    std::chrono::system_clock::now().time_since_epoch()).count();
+                uint64_t sent = msg.timestamp_ms * 1'000'000;
+                latency = static_cast<uint64_t>(now) > sent ? static_cast<uint64_t>(now) - sent : 0;
+            }
+            bench_->record(*latency);
+            return;
+        }
+        std::cout << "[SUB: " << spec_ << "] topic=" << msg.topic_id 
+                  << " price=" << msg.price << " qty=" << msg.quantity << "\n";
+    }
+
+    void print_bar(const BarMessage& bar) {
+        if (++received_ == opts_.unsubscribe_after) send_unsubscribe();
+        std::cout << "[SUB: " << spec_ << "] bar topic=" << bar.topic_id << " " << bar.interval_ms
+                  << "ms start=" << bar.start_ms << " o=" << bar.open << " h=" << bar.high << " l=" << bar.low
+                  << " c=" << bar.close << " v=" << bar.volume << " vwap=" << bar.vwap << " n=" << bar.trades
+                  << "\n";
+    }
+
+    // The broker stops routing the spec's topics; frames it queued before
+    // still arrive.
+    void send_unsubscribe() {
+        send_control(unsub_message_, "Unsubscribe", [this] {
+            Logger::info("Unsubscribed from " + spec_ + " after " + std::to_string(received_) + " trades");
+        });
+    }
+
+    // Shared-memory mode: hand the broker a segment over TCP, then subscribe and
+    // receive through its rings on this thread. The socket stays open only so
+    // each side notices when the other goes away.
+    void run_shm() {
+        try {
+            char name[shm::NAME_SIZE];
+            std::snprintf(name, sizeof(name), "/llpsb-sub-%08x", std::random_device{}());
+            shm::Segment segment = shm::Segment::create(name);
+            auto attach = shm::attach_frame(segment.name());
+            boost::asio::write(socket_, boost::asio::buffer(attach));
+            if (!segment.wait_attached(std::chrono::seconds(2))) {
+                Logger::error("Broker did not attach the shared memory segment");
+                return;
+            }
+            segment.unlink();
+
+            shm::Ring tx = segment.to_broker();
+            shm::Ring rx = segment.to_client();
+            tx.try_write(sub_message_.data(), sub_message_.size());
+            Logger::info("Subscribed to " + spec_ + " over shared memory");
+
+            RecvBuffer in(64 * 1024);
+            shm::Doorbell& bell = segment.header()->client_bell;
+            socket_.non_blocking(true);
+            uint64_t idle_spins = 0;
+            for (;;) {
+                if (bench_) {
+                    if (stop_requested) break;
+                    bench_->tick(std::chrono::steady_clock::now());
+                }
+                size_t n = rx.read(in.write_ptr(), in.writable());
+                if (n == 0) {
+                    if (busy_poll_) {
+                        shm::cpu_relax();
+                        if (++idle_spins % (1 << 20) == 0 && broker_gone()) break;
+                        continue;
+                    }
+                    bell.wait(shm::Doorbell::DATA, [&] { return rx.readable(); }, std::chrono::milliseconds(100));
+                    if (!rx.readable() && broker_gone()) break;
+                    continue;
+                }
+                in.commit(n);
+                if (!consume_frames(in)) break;
+                in.compact();
+            }
+        } catch (std::exception& e) {
+            Logger::error("Shared memory error: " + std::string(e.what()));
+        }
+        if (bench_) bench_->finish();
+    }
+
+    bool broker_gone() {
+        boost::system::error_code ec;
+        uint8_t probe;
+        socket_.read_some(boost::asio::buffer(&probe, 1), ec);
+        if (ec == boost::asio::error::would_block) return false;
+        Logger::error("Connection to broker closed");
+        return true;
+    }
+
 private:
     tcp::socket socket_;
     tcp::resolver resolver_;
-    int topic_id_;
-    uint8_t msg_type_; 
-    std::array<uint8_t, PAYLOAD_SIZE> payload_buf_;
+    std::string spec_;
+    std::array<TradeMessage, MAX_BATCH_RECORDS> batch_msgs_;
     std::vector<uint8_t> sub_message_; 
+    std::vector<uint8_t> unsub_message_;
+    uint64_t received_ = 0;
+    bool use_shm_;
+    bool busy_poll_;
+
+    SubscriberOptions opts_;
+    TopicPattern match_;
+    udp::socket udp_socket_;
+    udp::endpoint datagram_sender_;
+    std::array<uint8_t, 65536> datagram_;
+    std::unordered_map<int32_t, uint64_t> next_seq_;
+    // per topic, the sequence numbers still expected by retransmit as
+    // [first, end) ranges keyed by first
+    std::unordered_map<int32_t, std::map<uint64_t, uint64_t>> missing_;
+    uint64_t gaps_ = 0;
+    uint64_t recovered_ = 0;
+    uint64_t replayed_ = 0;
+    uint64_t last_journal_seq_ = 0;
+    struct ControlWrite {
+        std::vector<uint8_t> frame;
+        std::string what;
+        std::function<void()> done;
+    };
+    std::deque<ControlWrite> control_queue_;
+    boost::asio::steady_timer report_timer_;
+    RecvBuffer in_;
+    std::optional<BenchStats> bench_;
 };
 
 int main(int argc, char* argv[]) {
     try {
-        int topic = 1;
-        if (argc >= 2) topic = std::atoi(argv[1]);
+        // subscriber [SPEC] [--port N] [--shm] [--busy-poll] [--mcast GROUP:PORT] [--mcast-if ADDR] [--mcast-window N]
+        //            [--replay-from-seq N | --replay-from-ts MS]
+        //            [--bench [--report-ms N] [--format text|csv|json]] [--unsubscribe-after N]
+        //            [--price LO:HI] [--qty LO:HI] [--bars MS]
+        SubscriberOptions opts;
+        std::string port = "8080";
+        for (int i = 1; i < argc; ++i) {
+            std::string arg = argv[i];
+            if (arg == "--port" && i + 1 < argc) {
+                port = argv[++i];
+            } else if (arg == "--shm") {
+                opts.use_shm = true;
+            } else if (arg == "--busy-poll") {
+                opts.busy_poll = true;
+            } else if (arg == "--mcast" && i + 1 < argc) {
+                std::string v = argv[++i];
+                auto colon = v.rfind(':');
+                if (colon == std::string::npos) throw std::invalid_argument("expected GROUP:PORT for --mcast");
+                opts.mcast_group = v.substr(0, colon);
+                opts.mcast_port = static_cast<uint16_t>(std::stoi(v.substr(colon + 1)));
+            } else if (arg == "--mcast-if" && i + 1 < argc) {
+                opts.mcast_interface = argv[++i];
+            } else if (arg == "--mcast-window" && i + 1 < argc) {
+                opts.mcast_window = std::stoull(argv[++i]);
+                if (opts.mcast_window == 0) throw std::invalid_argument("--mcast-window must be positive");
+            } else if ((arg == "--replay-from-seq" || arg == "--replay-from-ts") && i + 1 < argc) {
+                opts.replay = true;
+                opts.replay_mode = arg == "--replay-from-ts" ? 1 : 0;
+                opts.replay_from = std::stoull(argv[++i]);
+            } else if (arg == "--bench") {
+                opts.bench = true;
+            } else if (arg == "--report-ms" && i + 1 < argc) {
+                opts.report_interval = std::chrono::milliseconds(std::stoll(argv[++i]));
+                if (opts.report_interval.count() <= 0) throw std::invalid_argument("--report-ms must be positive");
+            } else if (arg == "--format" && i + 1 < argc) {
+                opts.report_format = BenchStats::parse_format(argv[++i]);
+            } else if (arg == "--unsubscribe-after" && i + 1 < argc) {
+                opts.unsubscribe_after = std::stoull(argv[++i]);
+            } else if (arg == "--price" && i + 1 < argc) {
+                if (!opts.filter) opts.filter.emplace();
+                parse_band(argv[++i], &opts.filter->price_lo, &opts.filter->price_hi);
+            } else if (arg == "--bars" && i + 1 < argc) {
+                opts.bars_ms = static_cast<uint32_t>(std::stoul(argv[++i]));
+                if (opts.bars_ms == 0) throw std::invalid_argument("--bars must be positive");
+            } else if (arg == "--qty" && i + 1 < argc) {
+                if (!opts.filter) opts.filter.emplace();
+                parse_band(argv[++i], &opts.filter->qty_lo, &opts.filter->qty_hi);
+            } else {
+                opts.spec = arg;
+            }
+        }
+        if (opts.use_shm && !opts.mcast_group.empty()) throw std::invalid_argument("--mcast needs the TCP connection, drop --shm");
+        if (opts.use_shm && opts.replay) throw std::invalid_argument("replay needs the TCP connection, drop --shm");
+        if (opts.bars_ms > 0 && opts.filter) throw std::invalid_argument("--bars cannot be combined with --price/--qty");
+        if (opts.bars_ms > 0 && opts.bench) throw std::invalid_argument("--bench measures trades, drop --bars");
+        if (opts.use_shm && opts.unsubscribe_after > 0) {
+            throw std::invalid_argument("--unsubscribe-after needs the TCP connection, drop --shm");
+        }
+
+        if (opts.bench) {
+            std::signal(SIGINT, [](int) { stop_requested = 1; });
+            std::signal(SIGTERM, [](int) { stop_requested = 1; });
+        }
 
         boost::asio::io_context io;
 
-        auto client = std::make_shared<SubscriberClient>(io, "127.0.0.1", "8080", topic);
-        client->start("127.0.0.1", "8080");
-        Logger::info("Subscriber started for Topic " + std::to_string(topic));
+        auto client = std::make_shared<SubscriberClient>(io, "127.0.0.1", port, opts);
+        client->start("127.0.0.1", port);
+        Logger::info("Subscriber started for " + opts.spec);
 
-        io.run();
+        low_latency::run(io, opts.busy_poll && !opts.use_shm);
 
     } catch (std::exception& e) {
         Logger::error("Subscriber Fatal Error: " + std::string(e.what()));
@@ -0,0 +1,66 @@
+#include "AdminServer.h"
+#include <string>
+#include "Metrics.h"
+#include "../common/logger.h"
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+// one request line, then the report
+struct AdminConnection : std::enable_shared_from_this<AdminConnection> {
+    static constexpr size_t MAX_REQUEST = 1024;
+
+    explicit AdminConnection(tcp::socket s) : socket(std::move(s)), request(MAX_REQUEST) {}
+
+    void start() {
+        auto self = shared_from_this();
+        boost::asio::async_read_until(socket, request, '\n',
+            [this, self](boost::system::error_code ec, std::size_t) {
+                // a client that only half-closes without a newline still gets the text report
+                if (ec && ec != boost::asio::error::eof) return;
+                std::string line(boost::asio::buffers_begin(request.data()), boost::asio::buffers_end(request.data()));
+                respond(line.substr(0, line.find_first_of("\r\n")));
+            });
+    }
+
+    void respond(const std::string& line) {
+        bool http = line.rfind("GET ", 0) == 0;
+        bool json = http ? line.find("json") != std::string::npos : line == "json";
+        std::string body = json ? Metrics::report_json() : Metrics::report_text();
+        if (http) {
+            reply = std::string("HTTP/1.0 200 OK\r\nContent-Type: ") + (json ? "application/json" : "text/plain") +
+                    "\r\nContent-Length: " + std::to_string(body.size()) + "\r\nConnection: close\r\n\r\n" + body;
+        } else {
+            reply = std::move(body);
+        }
+        auto self = shared_from_this();
+        boost::asio::async_write(socket, boost::asio::buffer(reply), [this, self](boost::system::error_code, std::size_t) {
+            boost::system::error_code ignored;
+            socket.shutdown(tcp::socket::shutdown_both, ignored);
+        });
+    }
+
+    tcp::socket socket;
+    boost::asio::streambuf request;
+    std::string reply;
+};
+
+}
+
+AdminServer::AdminServer(boost::asio::io_context& io, uint16_t port)
+    : acceptor_(io, tcp::endpoint(boost::asio::ip::address_v4::loopback(), port)) {
+    do_accept();
+}
+
+void AdminServer::do_accept() {
+    acceptor_.async_accept([this](boost::system::error_code ec, tcp::socket socket) {
+        if (ec) {
+            LOG_ERROR("Admin accept error: {}", ec.message());
+            if (ec == boost::asio::error::operation_aborted) return;
+        } else {
+            std::make_shared<AdminConnection>(std::move(socket))->start();
+        }
+        do_accept();
+    });
+}
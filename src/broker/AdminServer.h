@@ -0,0 +1,23 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <cstdint>
+#include <memory>
+
+// Local admin endpoint (--admin-port), bound to 127.0.0.1 only. A client
+// connects, sends one line and receives the Metrics report, then the
+// connection is closed:
+//
+//   "text" or an empty line   one "name value" line per metric
+//   "json"                    one JSON object
+//   "GET /..." (HTTP)         the same over HTTP/1.0, JSON when the path
+//                             contains "json", so curl works too
+class AdminServer {
+public:
+    // throws boost::system::system_error when the port cannot be bound
+    AdminServer(boost::asio::io_context& io, uint16_t port);
+
+private:
+    void do_accept();
+
+    boost::asio::ip::tcp::acceptor acceptor_;
+};
@@ -0,0 +1,115 @@
+#include "BarSeries.h"
+#include "ClientSession.h"
+#include <algorithm>
+#include <chrono>
+#include "../common/codec.h"
+
+namespace {
+
+constexpr size_t TRADE_SIZE = codec::wire_size<TradeMessage>;
+constexpr size_t PRICE_OFFSET = offsetof(TradeMessage, price);
+constexpr size_t QTY_OFFSET = offsetof(TradeMessage, quantity);
+
+}
+
+uint64_t BarSeries::now_ms() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::milliseconds>(
+        std::chrono::system_clock::now().time_since_epoch()).count());
+}
+
+void BarSeries::add(const Frame& frame, uint64_t now_ms) {
+    const uint8_t* p = frame.data();
+    const uint8_t* trades = p + frame.size() - TRADE_SIZE;
+    size_t n = 1;
+    if (p[0] == static_cast<uint8_t>(MsgType::BATCH)) {
+        n = batch_count(p);
+        trades = p + BATCH_HEADER_SIZE;
+    }
+
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& s : streams_) {
+        roll(s, now_ms);
+        BarMessage& bar = s.bar;
+        const uint8_t* t = trades;
+        for (size_t i = 0; i < n; ++i, t += TRADE_SIZE) {
+            double price = codec::load_be<double>(t + PRICE_OFFSET);
+            double qty = codec::load_be<double>(t + QTY_OFFSET);
+            if (bar.trades++ == 0) {
+                bar.open = bar.high = bar.low = price;
+            } else {
+                bar.high = std::max(bar.high, price);
+                bar.low = std::min(bar.low, price);
+            }
+            bar.close = price;
+            bar.volume += qty;
+            s.notional += price * qty;
+        }
+    }
+}
+
+void BarSeries::flush(uint64_t now_ms) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    for (auto& s : streams_) roll(s, now_ms);
+}
+
+void BarSeries::roll(Stream& s, uint64_t now_ms) {
+    if (now_ms < s.start_ms + s.interval_ms) return;
+    if (s.bar.trades > 0) {
+        BarMessage& bar = s.bar;
+        bar.topic_id = topic_id_;
+        bar.interval_ms = s.interval_ms;
+        bar.start_ms = s.start_ms;
+        bar.vwap = bar.volume != 0 ? s.notional / bar.volume : bar.close;
+        MutableFramePtr frame = Frame::allocate(codec::BAR_FRAME_SIZE);
+        codec::encode_bar(bar, frame->data());
+        frame->set_topic(topic_id_);
+        for (auto& session : s.sessions) session->deliver_raw(frame);
+    }
+    s.start_ms = now_ms - now_ms % s.interval_ms;
+    s.bar = BarMessage{};
+    s.notional = 0;
+}
+
+bool BarSeries::subscribe(uint32_t interval_ms, std::shared_ptr<ClientSession> session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = std::find_if(streams_.begin(), streams_.end(), [&](const Stream& s) { return s.interval_ms == interval_ms; });
+    if (it == streams_.end()) {
+        it = streams_.insert(streams_.end(), Stream{});
+        it->interval_ms = interval_ms;
+        uint64_t now = now_ms();
+        it->start_ms = now - now % interval_ms;
+    }
+    if (std::find(it->sessions.begin(), it->sessions.end(), session) != it->sessions.end()) return false;
+    it->sessions.push_back(std::move(session));
+    return true;
+}
+
+bool BarSeries::unsubscribe(uint32_t interval_ms, const ClientSession* session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = std::find_if(streams_.begin(), streams_.end(), [&](const Stream& s) { return s.interval_ms == interval_ms; });
+    if (it == streams_.end()) return false;
+    if (std::erase_if(it->sessions, [&](const auto& s) { return s.get() == session; }) == 0) return false;
+    // nobody left for the bar being built
+    if (it->sessions.empty()) streams_.erase(it);
+    return true;
+}
+
+bool BarSeries::unsubscribe_all(const ClientSession* session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    size_t erased = 0;
+    for (auto& s : streams_) erased += std::erase_if(s.sessions, [&](const auto& p) { return p.get() == session; });
+    std::erase_if(streams_, [](const Stream& s) { return s.sessions.empty(); });
+    return erased > 0;
+}
+
+bool BarSeries::holds(const ClientSession* session) const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return std::any_of(streams_.begin(), streams_.end(), [&](const Stream& s) {
+        return std::any_of(s.sessions.begin(), s.sessions.end(), [&](const auto& p) { return p.get() == session; });
+    });
+}
+
+bool BarSeries::empty() const {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return streams_.empty();
+}
@@ -0,0 +1,66 @@
+#pragma once
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <vector>
+#include "Frame.h"
+#include "../common/message.h"
+
+class ClientSession;
+
+// Bars (open/high/low/close, volume, VWAP) of one topic for every interval
+// someone subscribed to with SUBSCRIBE_BARS. Each trade the shard routes
+// updates the bar being built for every interval in O(1); when an interval
+// ends the bar goes out as one BAR frame shared by its subscribers, either on
+// the first trade after the end or on the shard's next bar tick, whichever
+// comes first. Intervals are aligned to the broker's wall clock, so a bar
+// covers [start_ms, start_ms + interval_ms); intervals without trades send
+// nothing, and the first bar of a new interval length covers only the trades
+// since it was subscribed.
+//
+// Owned by the topic's SubscriptionManager slot for as long as the slot lives;
+// subscriptions change under the manager's lock, trades and ticks arrive from
+// any thread of the shard. An internal mutex orders them.
+class BarSeries {
+public:
+    static constexpr uint32_t MIN_INTERVAL_MS = 10;
+    static constexpr uint32_t MAX_INTERVAL_MS = 24 * 60 * 60 * 1000;
+
+    explicit BarSeries(int topic_id) : topic_id_(topic_id) {}
+
+    static bool valid_interval(uint32_t interval_ms) {
+        return interval_ms >= MIN_INTERVAL_MS && interval_ms <= MAX_INTERVAL_MS;
+    }
+    // the clock bars are aligned to: system_clock in milliseconds
+    static uint64_t now_ms();
+
+    // every trade of a DATA, DATA_TS or BATCH frame of the topic, received at now_ms
+    void add(const Frame& frame, uint64_t now_ms);
+    // sends the bars whose interval ended by now_ms
+    void flush(uint64_t now_ms);
+
+    // false when the session already had / did not have that interval
+    bool subscribe(uint32_t interval_ms, std::shared_ptr<ClientSession> session);
+    bool unsubscribe(uint32_t interval_ms, const ClientSession* session);
+    // every interval of the session; false when it had none
+    bool unsubscribe_all(const ClientSession* session);
+    bool holds(const ClientSession* session) const;
+    bool empty() const;
+
+private:
+    struct Stream {
+        uint32_t interval_ms = 0;
+        uint64_t start_ms = 0;
+        BarMessage bar{};     // bar.trades == 0 until the interval's first trade
+        double notional = 0;  // sum of price * quantity
+        std::vector<std::shared_ptr<ClientSession>> sessions;
+    };
+
+    // mtx_ held: sends the stream's bar once its interval has ended and
+    // starts the interval containing now_ms
+    void roll(Stream& s, uint64_t now_ms);
+
+    int topic_id_;
+    mutable std::mutex mtx_;
+    std::vector<Stream> streams_;
+};
@@ -0,0 +1,139 @@
+#include "BrokerConfig.h"
+#include <algorithm>
+#include <random>
+#include <sstream>
+#include <stdexcept>
+#include <thread>
+
+namespace {
+
+unsigned long parse_number(const std::string& opt, const std::string& value) {
+    try {
+        size_t used = 0;
+        unsigned long v = std::stoul(value, &used);
+        if (used == value.size()) return v;
+    } catch (const std::exception&) {
+    }
+    throw std::invalid_argument("invalid value for " + opt + ": " + value);
+}
+
+std::vector<int> parse_list(const std::string& opt, const std::string& value) {
+    std::vector<int> out;
+    std::stringstream ss(value);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        out.push_back(static_cast<int>(parse_number(opt, item)));
+    }
+    return out;
+}
+
+}
+
+BrokerConfig BrokerConfig::from_args(int argc, char* argv[]) {
+    BrokerConfig cfg;
+    for (int i = 1; i < argc; ++i) {
+        std::string opt = argv[i];
+        auto value = [&]() -> std::string {
+            if (i + 1 >= argc) throw std::invalid_argument("missing value for " + opt);
+            return argv[++i];
+        };
+
+        if (opt == "--port") {
+            cfg.port = static_cast<uint16_t>(parse_number(opt, value()));
+        } else if (opt == "--threads") {
+            cfg.threads = static_cast<unsigned>(parse_number(opt, value()));
+        } else if (opt == "--shards") {
+            cfg.shards = static_cast<unsigned>(parse_number(opt, value()));
+        } else if (opt == "--cpus") {
+            cfg.cpus = parse_list(opt, value());
+        } else if (opt == "--busy-poll") {
+            cfg.busy_poll = true;
+        } else if (opt == "--socket-busy-poll-us") {
+            cfg.socket_tuning.busy_poll_us = static_cast<int>(parse_number(opt, value()));
+        } else if (opt == "--quickack") {
+            cfg.socket_tuning.quickack = true;
+        } else if (opt == "--sndbuf") {
+            cfg.socket_tuning.send_buffer = static_cast<int>(parse_number(opt, value()));
+        } else if (opt == "--rcvbuf") {
+            cfg.socket_tuning.receive_buffer = static_cast<int>(parse_number(opt, value()));
+        } else if (opt == "--log-overflow") {
+            std::string v = value();
+            if (v == "drop") cfg.log_overflow = LogOverflow::DROP;
+            else if (v == "block") cfg.log_overflow = LogOverflow::BLOCK;
+            else throw std::invalid_argument("invalid value for " + opt + ": " + v);
+        } else if (opt == "--max-queue-frames") {
+            cfg.slow_consumer.max_frames = parse_number(opt, value());
+        } else if (opt == "--max-queue-bytes") {
+            cfg.slow_consumer.max_bytes = parse_number(opt, value());
+        } else if (opt == "--slow-policy") {
+            cfg.slow_consumer.policy = SlowConsumerConfig::parse_policy(value());
+        } else if (opt == "--slow-policy-topic") {
+            std::string v = value();
+            auto eq = v.find('=');
+            if (eq == std::string::npos) throw std::invalid_argument("expected TOPIC=POLICY for " + opt);
+            int topic = static_cast<int>(parse_number(opt, v.substr(0, eq)));
+            cfg.slow_consumer.topic_policy[topic] = SlowConsumerConfig::parse_policy(v.substr(eq + 1));
+        } else if (opt == "--disconnect-grace-ms") {
+            cfg.slow_consumer.disconnect_grace = std::chrono::milliseconds(parse_number(opt, value()));
+        } else if (opt == "--no-lvc") {
+            cfg.lvc = false;
+        } else if (opt == "--shm-busy-poll") {
+            cfg.shm_busy_poll = true;
+        } else if (opt == "--mcast-group") {
+            std::string v = value();
+            auto colon = v.rfind(':');
+            if (colon == std::string::npos) throw std::invalid_argument("expected ADDR:PORT for " + opt);
+            cfg.mcast_group = v.substr(0, colon);
+            cfg.mcast_port = static_cast<uint16_t>(parse_number(opt, v.substr(colon + 1)));
+        } else if (opt == "--mcast-topics") {
+            cfg.mcast_topics = parse_list(opt, value());
+        } else if (opt == "--mcast-interface") {
+            cfg.mcast_interface = value();
+        } else if (opt == "--mcast-retransmit") {
+            cfg.mcast_retransmit_frames = parse_number(opt, value());
+        } else if (opt == "--mcast-linger-us") {
+            cfg.mcast_linger_us = std::chrono::microseconds(parse_number(opt, value()));
+        } else if (opt == "--journal-dir") {
+            cfg.journal_dir = value();
+        } else if (opt == "--journal-segment-mb") {
+            cfg.journal_segment_bytes = parse_number(opt, value()) * 1024 * 1024;
+        } else if (opt == "--journal-max-segments") {
+            cfg.journal_max_segments = parse_number(opt, value());
+        } else if (opt == "--journal-sync") {
+            cfg.journal_sync = true;
+        } else if (opt == "--admin-port") {
+            cfg.admin_port = static_cast<uint16_t>(parse_number(opt, value()));
+        } else if (opt == "--peer") {
+            std::string v = value();
+            auto colon = v.rfind(':');
+            if (colon == std::string::npos) throw std::invalid_argument("expected HOST:PORT for " + opt);
+            parse_number(opt, v.substr(colon + 1));
+            if (std::find(cfg.peers.begin(), cfg.peers.end(), v) == cfg.peers.end()) cfg.peers.push_back(v);
+        } else if (opt == "--broker-id") {
+            cfg.broker_id = static_cast<uint32_t>(parse_number(opt, value()));
+        } else if (opt == "--lvc-dense-topics") {
+            cfg.lvc_dense_topics = parse_number(opt, value());
+        } else {
+            throw std::invalid_argument("unknown option " + opt + "\n" + usage());
+        }
+    }
+
+    while (cfg.broker_id == 0) cfg.broker_id = std::random_device{}();
+    if (cfg.threads == 0) cfg.threads = std::max(1u, std::thread::hardware_concurrency());
+    if (!cfg.cpus.empty() && cfg.cpus.size() < cfg.shards) {
+        throw std::invalid_argument("--cpus lists fewer cores than --shards");
+    }
+    return cfg;
+}
+
+std::string BrokerConfig::usage() {
+    return "usage: broker [--port N] [--threads N] [--shards N] [--cpus a,b,...] [--log-overflow drop|block]\n"
+           "              [--busy-poll] [--socket-busy-poll-us N] [--quickack] [--sndbuf N] [--rcvbuf N]\n"
+           "              [--max-queue-frames N] [--max-queue-bytes N] [--slow-policy drop-oldest|conflate|disconnect]\n"
+           "              [--slow-policy-topic T=POLICY]... [--disconnect-grace-ms N]\n"
+           "              [--no-lvc] [--lvc-dense-topics N] [--shm-busy-poll]\n"
+           "              [--mcast-group ADDR:PORT --mcast-topics a,b,...] [--mcast-interface ADDR]\n"
+           "              [--mcast-retransmit N] [--mcast-linger-us N]\n"
+           "              [--journal-dir DIR] [--journal-segment-mb N] [--journal-max-segments N] [--journal-sync]\n"
+           "              [--admin-port N] [--peer HOST:PORT]... [--broker-id N]";
+}
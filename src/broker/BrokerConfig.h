@@ -0,0 +1,90 @@
+#pragma once
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "SlowConsumer.h"
+#include "../common/logger.h"
+#include "../common/low_latency.h"
+
+// Command-line settings of the broker process.
+//
+//   --port N        listening port (default 8080)
+//   --threads N     io threads of the shared io_context in the default mode
+//                   (default: hardware concurrency)
+//   --shards N      thread-per-core mode: N io_contexts, one pinned thread each
+//   --cpus a,b,c    cores to pin shard threads to (default 0..N-1); in the
+//                   default mode the io threads are pinned to them round-robin
+//   --busy-poll     io threads spin on the reactor instead of sleeping in epoll
+//   --socket-busy-poll-us N
+//                   SO_BUSY_POLL on client sockets (Linux)
+//   --quickack      TCP_QUICKACK on client sockets, re-armed per read (Linux)
+//   --sndbuf N, --rcvbuf N
+//                   socket buffer sizes of client sockets in bytes
+//   --log-overflow drop|block
+//                   what a thread does when its log ring is full (default drop)
+//   --max-queue-frames N, --max-queue-bytes N
+//                   outbound budget of each subscriber session
+//   --slow-policy drop-oldest|conflate|disconnect
+//                   what to do when a session exceeds its budget
+//   --slow-policy-topic T=POLICY
+//                   per-topic override, may be repeated
+//   --disconnect-grace-ms N
+//                   how long a session may stay over budget under "disconnect"
+//   --no-lvc        do not keep a last-value cache / send snapshots on subscribe
+//   --lvc-dense-topics N
+//                   topic ids below N are cached in a flat array (default 65536)
+//   --shm-busy-poll shared-memory pollers spin instead of sleeping
+//   --mcast-group ADDR:PORT, --mcast-topics a,b,c
+//                   send these topics once to a UDP multicast group
+//   --mcast-interface ADDR
+//                   local interface for the group (127.0.0.1 for loopback)
+//   --mcast-retransmit N
+//                   frames per topic kept for retransmit requests (default 4096)
+//   --mcast-linger-us N
+//                   longest a partly filled datagram waits (default 50, 0 = none)
+//   --journal-dir DIR
+//                   keep every DATA frame in a memory-mapped journal under DIR
+//   --journal-segment-mb N
+//                   size of one journal segment file (default 64)
+//   --journal-max-segments N
+//                   delete the oldest segment beyond N (default 0 = keep all)
+//   --journal-sync  msync every group commit before it becomes replayable
+//   --admin-port N  serve metrics on 127.0.0.1:N (default 0 = off)
+//   --peer HOST:PORT
+//                   link to another broker, may be repeated (see Federation)
+//   --broker-id N   id of this broker among its peers (default: random)
+struct BrokerConfig {
+    uint16_t port = 8080;
+    unsigned threads = 0;
+    unsigned shards = 0;
+    std::vector<int> cpus;
+    bool busy_poll = false;
+    SocketTuning socket_tuning;
+    LogOverflow log_overflow = LogOverflow::DROP;
+    SlowConsumerConfig slow_consumer;
+    bool lvc = true;
+    size_t lvc_dense_topics = 64 * 1024;
+    bool shm_busy_poll = false;
+    std::string mcast_group;
+    uint16_t mcast_port = 0;
+    std::string mcast_interface;
+    std::vector<int> mcast_topics;
+    size_t mcast_retransmit_frames = 4096;
+    std::chrono::microseconds mcast_linger_us{50};
+    std::string journal_dir;
+    size_t journal_segment_bytes = 64 * 1024 * 1024;
+    size_t journal_max_segments = 0;
+    bool journal_sync = false;
+    uint16_t admin_port = 0;
+    std::vector<std::string> peers;
+    uint32_t broker_id = 0;
+
+    bool sharded() const { return shards > 0; }
+    bool multicast() const { return !mcast_group.empty() && !mcast_topics.empty(); }
+    bool journal() const { return !journal_dir.empty(); }
+
+    // throws std::invalid_argument on unknown options or bad values
+    static BrokerConfig from_args(int argc, char* argv[]);
+    static std::string usage();
+};
@@ -1,13 +1,151 @@
 #include "ClientSession.h"
 #include "SubscriptionManager.h"
+#include "Shard.h"
+#include "SlowConsumer.h"
+#include "Metrics.h"
+#include "Federation.h"
+#include <algorithm>
 #include <iostream>
 #include <cstring>
 #include "../common/logger.h"
 
 using boost::asio::ip::tcp;
 
-ClientSession::ClientSession(tcp::socket socket, SubscriptionManager& mgr)
-    : socket_(std::move(socket)), manager_(mgr), msg_type_(0) {
+namespace {
+std::atomic<uint64_t> next_session_id{1};
+
+// Freed session blocks, all of one size, kept for the next connection. Sessions
+// die on whichever thread drops the last reference, hence the lock; this is
+// once per connection, not per frame. Never destroyed, so sessions released
+// during shutdown still have somewhere to go.
+class SessionBlocks {
+public:
+    static constexpr size_t LIMIT = 1024;
+
+    static SessionBlocks& instance() {
+        static auto* blocks = new SessionBlocks;
+        return *blocks;
+    }
+
+    void* take(size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (size == block_size_ && !free_.empty()) {
+                void* p = free_.back();
+                free_.pop_back();
+                return p;
+            }
+        }
+        return ::operator new(size);
+    }
+
+    void give(void* p, size_t size) {
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            if (block_size_ == 0) block_size_ = size;
+            if (size == block_size_ && free_.size() < LIMIT) {
+                free_.push_back(p);
+                return;
+            }
+        }
+        ::operator delete(p);
+    }
+
+private:
+    std::mutex mtx_;
+    size_t block_size_ = 0;
+    std::vector<void*> free_;
+};
+
+template <typename T>
+struct SessionAllocator {
+    using value_type = T;
+
+    SessionAllocator() = default;
+    template <typename U>
+    SessionAllocator(const SessionAllocator<U>&) noexcept {}
+
+    T* allocate(size_t n) { return static_cast<T*>(SessionBlocks::instance().take(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { SessionBlocks::instance().give(p, n * sizeof(T)); }
+
+    template <typename U>
+    bool operator==(const SessionAllocator<U>&) const noexcept { return true; }
+    template <typename U>
+    bool operator!=(const SessionAllocator<U>&) const noexcept { return false; }
+};
+
+// body of a SUBSCRIBE_RANGE, SUBSCRIBE_MASK or SUBSCRIBE_ALL frame
+TopicPattern read_pattern(MsgType type, const uint8_t* body) {
+    if (type == MsgType::SUBSCRIBE_RANGE) {
+        return TopicPattern::range(serializer::read_int32_be(body), serializer::read_int32_be(body + 4));
+    }
+    if (type == MsgType::SUBSCRIBE_MASK) {
+        return TopicPattern::masked(static_cast<uint32_t>(serializer::read_int32_be(body)),
+                                    static_cast<uint32_t>(serializer::read_int32_be(body + 4)));
+    }
+    return TopicPattern::all();
+}
+
+FramePtr hello_frame(uint32_t broker_id) {
+    auto frame = Frame::allocate(1 + 4);
+    frame->data()[0] = static_cast<uint8_t>(MsgType::PEER_HELLO);
+    for (int i = 0; i < 4; ++i) frame->data()[1 + i] = static_cast<uint8_t>(broker_id >> (24 - 8 * i));
+    return frame;
+}
+
+// PEER_HELLO and the SUBSCRIBE*/UNSUBSCRIBE interest frames sent over links
+bool is_control(const Frame& frame) {
+    uint8_t type = frame.data()[0];
+    return type == static_cast<uint8_t>(MsgType::PEER_HELLO) || type == static_cast<uint8_t>(MsgType::UNSUBSCRIBE) ||
+           subscribe_frame_size(type) != 0;
+}
+
+bool is_data(const Frame& frame) {
+    return frame.data()[0] == static_cast<uint8_t>(MsgType::DATA);
+}
+
+// DATA, DATA_TS or BATCH: the frames the journal numbers
+bool is_trade(const Frame& frame) {
+    uint8_t type = frame.data()[0];
+    return type == static_cast<uint8_t>(MsgType::DATA) || type == static_cast<uint8_t>(MsgType::DATA_TS) ||
+           type == static_cast<uint8_t>(MsgType::BATCH);
+}
+
+void log_pattern(const char* verb, const TopicPattern& pattern) {
+    switch (pattern.kind) {
+        case TopicPattern::Kind::RANGE: LOG_INFO("Client {} topics {}-{}", verb, pattern.lo, pattern.hi); break;
+        case TopicPattern::Kind::MASK:  LOG_INFO("Client {} topics matching {}/{}", verb, pattern.value, pattern.mask); break;
+        case TopicPattern::Kind::ALL:   LOG_INFO("Client {} all topics", verb); break;
+    }
+}
+
+// write_bufs_ by reference: async_write keeps its own copy of the buffer
+// sequence for the whole write, for a vector that copy is an allocation
+struct BufferRange {
+    using value_type = boost::asio::const_buffer;
+    using const_iterator = const boost::asio::const_buffer*;
+
+    const_iterator first;
+    const_iterator last;
+
+    explicit BufferRange(const std::vector<boost::asio::const_buffer>& bufs)
+        : first(bufs.data()), last(bufs.data() + bufs.size()) {}
+    const_iterator begin() const { return first; }
+    const_iterator end() const { return last; }
+};
+}
+
+std::shared_ptr<ClientSession> ClientSession::create(tcp::socket socket, Shard& shard) {
+    return std::allocate_shared<ClientSession>(SessionAllocator<ClientSession>(), std::move(socket), shard);
+}
+
+ClientSession::ClientSession(tcp::socket socket, Shard& shard)
+    : socket_(std::move(socket)), shard_(shard), id_(next_session_id.fetch_add(1, std::memory_order_relaxed)),
+      manager_(shard.subscriptions()),
+      grace_timer_(socket_.get_executor()), rx_(RECV_BUFFER_SIZE), replay_timer_(socket_.get_executor()) {
+    boost::system::error_code ec;
+    auto remote = socket_.remote_endpoint(ec);
+    peer_ = ec ? "-" : remote.address().to_string() + ":" + std::to_string(remote.port());
 }
 
 ClientSession::~ClientSession() {
@@ -17,124 +155,727 @@ ClientSession::~ClientSession() {
 }
 
 void ClientSession::handle_error_and_close() {
-    if (closed_) return;
+    if (closed_.exchange(true)) return;
+
+    if (shm_) {
+        shm_->stop();
+        if (!shm_served_.exchange(true)) shm_poller_->release();
+        auto self = shared_from_this();
+        boost::asio::post(socket_.get_executor(), [this, self] {
+            boost::system::error_code ignored;
+            socket_.close(ignored);
+        });
+    }
 
-    closed_ = true;
     Logger::warn("Client disconnected/error, auto-unsubscribing.");
-    
+    if (Federation* federation = shard_.federation()) {
+        if (is_link()) {
+            federation->link_down(this);
+        } else {
+            federation->drop_interest(this);
+        }
+    }
+
     manager_.unsubscribe_all(shared_from_this()); 
 }
 
 void ClientSession::start() {
-    do_read_header();
+    Metrics::add_session(shared_from_this());
+    std::string refused = low_latency::apply(socket_, shard_.config().socket_tuning);
+    if (!refused.empty()) LOG_WARN("Socket options refused: {}", refused);
+    do_read();
 }
 
-void ClientSession::do_read_header() {
+void ClientSession::start_link(uint32_t broker_id) {
+    link_.store(true, std::memory_order_relaxed);
+    dialed_ = true;
+    deliver_raw(hello_frame(broker_id));
+    start();
+}
+
+void ClientSession::disconnect() {
     auto self = shared_from_this();
-    boost::asio::async_read(socket_, boost::asio::buffer(&msg_type_, 1),
-        [this, self](boost::system::error_code ec, std::size_t) {
+    boost::asio::post(socket_.get_executor(), [this, self] {
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+    });
+}
+
+ClientSession::QueueDepth ClientSession::queue_depth() {
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    return {queued_frames(), queued_bytes_, queued_peak_};
+}
+
+// Reads whatever the socket has (up to the free space in rx_) and decodes every
+// complete frame in it before issuing the next read. A frame cut off at the
+// end of the read stays in rx_ and is completed by the following one.
+void ClientSession::do_read() {
+    auto self = shared_from_this();
+    socket_.async_read_some(boost::asio::buffer(rx_.write_ptr(), rx_.writable()), bind_memory(read_memory_,
+        [this, self](boost::system::error_code ec, std::size_t len) {
             if (ec) {
-                handle_error_and_close(); 
+                handle_error_and_close();
                 return;
             }
-            // Logika za čitanje ovisno o tipu poruke
-            if (msg_type_ == static_cast<uint8_t>(MsgType::SUBSCRIBE)) {
-                do_read_subscribe();
-            } else if (msg_type_ == static_cast<uint8_t>(MsgType::DATA)) {
-                do_read_data();
-            } else {
-                Logger::error("Received unknown msg type: " + std::to_string(static_cast<int>(msg_type_)));
+            rx_.commit(len);
+            if (shard_.config().socket_tuning.quickack) low_latency::rearm_quickack(socket_);
+            if (!process_frames()) {
                 handle_error_and_close();
                 return;
             }
-        });
+            if (shm_) {
+                start_shm();
+                return;
+            }
+            do_read();
+        }));
 }
 
-void ClientSession::do_read_subscribe() {
-    auto self = shared_from_this();
-    // read 4-byte topic id (big-endian) u prvih 4 bajta payload_buf_
-    boost::asio::async_read(socket_, boost::asio::buffer(payload_buf_.data(), 4),
-        [this, self](boost::system::error_code ec, std::size_t /*len*/) {
-            if (ec) {
-                handle_error_and_close();
-                return;
+bool ClientSession::process_frames() {
+    while (rx_.readable() > 0) {
+        const uint8_t* p = rx_.read_ptr();
+        size_t frame_len = 0;
+        switch (static_cast<MsgType>(p[0])) {
+            case MsgType::SUBSCRIBE:       frame_len = 1 + sizeof(int32_t); break;
+            case MsgType::DATA:            frame_len = 1 + PAYLOAD_SIZE; break;
+            case MsgType::DATA_TS:         frame_len = DATA_TS_FRAME_SIZE; break;
+            case MsgType::SUBSCRIBE_RANGE:
+            case MsgType::SUBSCRIBE_MASK:  frame_len = 1 + 2 * sizeof(int32_t); break;
+            case MsgType::SUBSCRIBE_ALL:   frame_len = 1; break;
+            case MsgType::SHM_ATTACH:      frame_len = 1 + shm::NAME_SIZE; break;
+            case MsgType::MCAST_JOIN:      frame_len = 1; break;
+            case MsgType::RETRANSMIT_REQ:  frame_len = 1 + 4 + 8 + 4; break;
+            case MsgType::SUBSCRIBE_REPLAY: frame_len = 1 + 4 + 1 + 8; break;
+            case MsgType::PEER_HELLO:      frame_len = 1 + 4; break;
+            case MsgType::SUBSCRIBE_FILTER:
+            case MsgType::SUBSCRIBE_BARS:  frame_len = subscribe_frame_size(p[0]); break;
+            case MsgType::UNSUBSCRIBE:
+                frame_len = 2;
+                if (rx_.readable() < frame_len) break;
+                if (subscribe_frame_size(p[1]) == 0) {
+                    LOG_ERROR("Received UNSUBSCRIBE of msg type {}", p[1]);
+                    return false;
+                }
+                frame_len = 1 + subscribe_frame_size(p[1]);
+                break;
+            case MsgType::BATCH:
+                frame_len = BATCH_HEADER_SIZE;
+                if (rx_.readable() < frame_len) break;
+                if (batch_count(p) == 0 || batch_count(p) > MAX_BATCH_RECORDS) {
+                    LOG_ERROR("Received BATCH of {} records", batch_count(p));
+                    return false;
+                }
+                frame_len += batch_count(p) * PAYLOAD_SIZE;
+                break;
+            default:
+                LOG_ERROR("Received unknown msg type: {}", p[0]);
+                return false;
+        }
+        if (rx_.readable() < frame_len) break;
+
+        bool first = first_frame_;
+        first_frame_ = false;
+        if (static_cast<MsgType>(p[0]) == MsgType::SHM_ATTACH) {
+            // only as the very first frame, and nothing may follow it on the socket
+            if (!first || !on_shm_attach(p + 1)) return false;
+            rx_.consume(frame_len);
+            if (rx_.readable() > 0) {
+                LOG_ERROR("Client sent frames after SHM_ATTACH before the broker acknowledged it");
+                return false;
             }
-            int32_t topic = serializer::read_int32_be(payload_buf_.data());
-            manager_.subscribe(topic, self);
-            Logger::info("Client subscribed to topic " + std::to_string(topic));
-            
-            // continue reading next messages
-            do_read_header();
-        });
+            break;
+        }
+
+        switch (static_cast<MsgType>(p[0])) {
+            case MsgType::DATA:
+            case MsgType::DATA_TS:        Metrics::received(frame_len); on_data(p, frame_len); break;
+            case MsgType::BATCH:          Metrics::received(frame_len); on_batch(p); break;
+            case MsgType::SUBSCRIBE:      on_subscribe(p + 1); break;
+            case MsgType::MCAST_JOIN:     on_mcast_join(); break;
+            case MsgType::RETRANSMIT_REQ: on_retransmit_request(p + 1); break;
+            case MsgType::SUBSCRIBE_REPLAY: on_subscribe_replay(p + 1); break;
+            case MsgType::UNSUBSCRIBE:    on_unsubscribe(p + 1); break;
+            case MsgType::PEER_HELLO:
+                if (!on_peer_hello(p + 1)) return false;
+                break;
+            case MsgType::SUBSCRIBE_FILTER:
+                if (!on_subscribe_filter(p + 1)) return false;
+                break;
+            case MsgType::SUBSCRIBE_BARS:
+                if (!on_subscribe_bars(p + 1)) return false;
+                break;
+            default:                      on_subscribe_pattern(static_cast<MsgType>(p[0]), p + 1); break;
+        }
+        rx_.consume(frame_len);
+    }
+    rx_.compact();
+    return true;
+}
+
+void ClientSession::on_subscribe(const uint8_t* body) {
+    int32_t topic = serializer::read_int32_be(body);
+    run_on_shard([this, topic] { shard_.subscribe(topic, shared_from_this()); });
+    if (Federation* federation = interest()) federation->add_interest(this, topic);
+    LOG_INFO("Client subscribed to topic {}", topic);
+}
+
+void ClientSession::on_subscribe_pattern(MsgType type, const uint8_t* body) {
+    TopicPattern pattern = read_pattern(type, body);
+    log_pattern("subscribed to", pattern);
+    run_on_shard([this, pattern] { shard_.subscribe_pattern(pattern, shared_from_this()); });
+    if (Federation* federation = interest()) federation->add_interest(this, pattern);
+}
+
+// `sub` is the subscribe frame being cancelled. Frames of the topics that
+// were queued to the session before still go out.
+void ClientSession::on_unsubscribe(const uint8_t* sub) {
+    auto type = static_cast<MsgType>(sub[0]);
+    if (type == MsgType::SUBSCRIBE_FILTER) {
+        int32_t topic = serializer::read_int32_be(sub + 1);
+        TradeFilter filter = TradeFilter::decode(sub + 1 + 4);
+        LOG_INFO("Client unsubscribed from filtered topic {}", topic);
+        run_on_shard([this, topic, filter] { manager_.unsubscribe_filtered(topic, filter, shared_from_this()); });
+        if (Federation* federation = interest()) federation->remove_interest(this, topic, filter);
+        return;
+    }
+    if (type == MsgType::SUBSCRIBE_BARS) {
+        int32_t topic = serializer::read_int32_be(sub + 1);
+        auto interval_ms = static_cast<uint32_t>(serializer::read_int32_be(sub + 1 + 4));
+        LOG_INFO("Client unsubscribed from {} ms bars of topic {}", interval_ms, topic);
+        run_on_shard([this, topic, interval_ms] { manager_.unsubscribe_bars(topic, interval_ms, shared_from_this()); });
+        if (Federation* federation = interest()) federation->remove_interest(this, topic, interval_ms);
+        return;
+    }
+    if (type == MsgType::SUBSCRIBE) {
+        int32_t topic = serializer::read_int32_be(sub + 1);
+        LOG_INFO("Client unsubscribed from topic {}", topic);
+        run_on_shard([this, topic] { manager_.unsubscribe(topic, shared_from_this()); });
+        if (Federation* federation = interest()) federation->remove_interest(this, topic);
+        return;
+    }
+    TopicPattern pattern = read_pattern(type, sub + 1);
+    log_pattern("unsubscribed from", pattern);
+    run_on_shard([this, pattern] { manager_.unsubscribe_pattern(pattern, shared_from_this()); });
+    if (Federation* federation = interest()) federation->remove_interest(this, pattern);
+}
+
+bool ClientSession::on_subscribe_filter(const uint8_t* body) {
+    int32_t topic = serializer::read_int32_be(body);
+    TradeFilter filter = TradeFilter::decode(body + 4);
+    if (!filter.valid()) {
+        LOG_ERROR("Received SUBSCRIBE_FILTER for topic {} with an empty or NaN band", topic);
+        return false;
+    }
+    run_on_shard([this, topic, filter] { shard_.subscribe_filtered(topic, filter, shared_from_this()); });
+    if (Federation* federation = interest()) federation->add_interest(this, topic, filter);
+    LOG_INFO("Client subscribed to topic {} with price {}..{} qty {}..{}", topic, filter.price_lo, filter.price_hi,
+             filter.qty_lo, filter.qty_hi);
+    return true;
+}
+
+bool ClientSession::on_subscribe_bars(const uint8_t* body) {
+    int32_t topic = serializer::read_int32_be(body);
+    auto interval_ms = static_cast<uint32_t>(serializer::read_int32_be(body + 4));
+    if (!BarSeries::valid_interval(interval_ms)) {
+        LOG_ERROR("Received SUBSCRIBE_BARS for topic {} with an interval of {} ms", topic, interval_ms);
+        return false;
+    }
+    run_on_shard([this, topic, interval_ms] { shard_.subscribe_bars(topic, interval_ms, shared_from_this()); });
+    if (Federation* federation = interest()) federation->add_interest(this, topic, interval_ms);
+    LOG_INFO("Client subscribed to {} ms bars of topic {}", interval_ms, topic);
+    return true;
+}
+
+// The dialing side sent PEER_HELLO first and waits for ours. The other side
+// answers before the link is registered, so the dialer learns which broker
+// it reached even when the link is refused right after.
+bool ClientSession::on_peer_hello(const uint8_t* body) {
+    Federation* federation = shard_.federation();
+    if (!federation) {
+        LOG_ERROR("PEER_HELLO from {} but this broker does not link to peers", peer_);
+        return false;
+    }
+    auto peer_id = static_cast<uint32_t>(serializer::read_int32_be(body));
+    if (!dialed_) {
+        if (is_link()) {
+            LOG_ERROR("Second PEER_HELLO from {}", peer_);
+            return false;
+        }
+        link_.store(true, std::memory_order_relaxed);
+        deliver_raw(hello_frame(federation->id()));
+    }
+    return federation->link_up(shared_from_this(), peer_id);
+}
+
+// Local clients' subscriptions become interest sent to peer brokers; a
+// link's own subscriptions are not passed on (split horizon).
+Federation* ClientSession::interest() {
+    return is_link() ? nullptr : shard_.federation();
 }
 
-void ClientSession::do_read_data() {
+void ClientSession::on_mcast_join() {
+    if (!shard_.multicast()) {
+        LOG_WARN("Client asked for multicast but no multicast topics are configured, staying on TCP");
+        return;
+    }
+    multicast_.store(true, std::memory_order_relaxed);
+    LOG_INFO("Client receives multicast topics over UDP");
+}
+
+void ClientSession::on_retransmit_request(const uint8_t* body) {
+    MulticastPublisher* mcast = shard_.multicast();
+    if (!mcast) return;
+    int32_t topic = serializer::read_int32_be(body);
+    uint64_t first = serializer::read_uint64_be(body + 4);
+    auto count = static_cast<uint32_t>(serializer::read_int32_be(body + 12));
+    mcast->retransmit(topic, first, count, shared_from_this());
+}
+
+void ClientSession::on_subscribe_replay(const uint8_t* body) {
+    int32_t topic = serializer::read_int32_be(body);
+    auto mode = body[4] == 1 ? Journal::ReplayFrom::TIMESTAMP : Journal::ReplayFrom::SEQ;
+    uint64_t from = serializer::read_uint64_be(body + 5);
+
+    Journal* journal = shard_.journal();
+    bool held = false;
+    if (journal && !shm_) {
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        held = !replay_hold_;
+        replay_hold_ = true;
+    }
+    if (!held) {
+        LOG_WARN("Replay of topic {} is not available on this session, subscribing live", topic);
+        on_subscribe(body);
+        return;
+    }
+
+    replay_topic_ = topic;
+    replay_mode_ = mode;
+    replay_from_ = from;
+    shard_.subscribe(topic, shared_from_this());
+    if (Federation* federation = interest()) federation->add_interest(this, topic);
+    // everything published before this point comes from the journal, the rest live
+    replay_end_ = journal->peek_next_seq();
+    LOG_INFO("Client subscribed to topic {} with replay from {} {}", topic,
+             mode == Journal::ReplayFrom::SEQ ? "seq" : "timestamp", from);
+    wait_for_journal();
+}
+
+// The replay starts once the journal thread has written every frame below
+// replay_end_ and the write that was in flight when the hold began is done.
+void ClientSession::wait_for_journal() {
+    bool ready = false;
+    {
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        if (closed_) return;
+        ready = !writing_ && shard_.journal()->written_below() >= replay_end_;
+    }
+    if (ready) {
+        replay_cursor_ = shard_.journal()->open_cursor(replay_topic_, replay_mode_, replay_from_, replay_end_);
+        stream_replay();
+        return;
+    }
+    replay_timer_.expires_after(std::chrono::milliseconds(1));
+    auto self = shared_from_this();
+    replay_timer_.async_wait([this, self](boost::system::error_code ec) {
+        if (!ec) wait_for_journal();
+    });
+}
+
+// Records go out of the journal mapping as they are, a chunk per write.
+void ClientSession::stream_replay() {
+    if (closed_) return;
+    write_bufs_.clear();
+    bool more = shard_.journal()->read(replay_cursor_, write_bufs_, REPLAY_CHUNK_RECORDS);
     auto self = shared_from_this();
-    // read payload (28 bytes) direktno u fiksni bafer
-    boost::asio::async_read(socket_, boost::asio::buffer(payload_buf_.data(), PAYLOAD_SIZE),
-        [this, self](boost::system::error_code ec, std::size_t) {
+    if (write_bufs_.empty()) {
+        // the scan budget ran out between matches; let other sessions in first
+        if (more) {
+            boost::asio::post(socket_.get_executor(), [this, self] { stream_replay(); });
+        } else {
+            finish_replay();
+        }
+        return;
+    }
+    boost::asio::async_write(socket_, BufferRange(write_bufs_), bind_memory(write_memory_,
+        [this, self, more](boost::system::error_code ec, std::size_t /*len*/) {
             if (ec) {
+                Logger::error("Subscriber replay error: " + ec.message());
                 handle_error_and_close();
                 return;
             }
-            
-            const uint8_t* p = payload_buf_.data();
-            int32_t topic = serializer::read_int32_be(p); p += 4;
-            uint64_t ts = serializer::read_uint64_be(p); p += 8;
-            double price = serializer::read_double_be(p); p += 8;
-            double qty = serializer::read_double_be(p); // 
-
-            auto subscribers = manager_.get_subscribers(topic);
-
-            if (!subscribers.empty()) {
-                Logger::info("Broker: Received DATA for Topic " + std::to_string(topic) + 
-                             ", routing to " + std::to_string(subscribers.size()) + " subscribers.");
+            if (more) {
+                stream_replay();
             } else {
-                Logger::info("Broker: Received DATA for Topic " + std::to_string(topic) + 
-                             ", but found 0 subscribers.");
+                finish_replay();
             }
+        }));
+}
 
-            std::vector<uint8_t> out;
-            out.reserve(1 + PAYLOAD_SIZE);
-            out.push_back(static_cast<uint8_t>(MsgType::DATA));
-            out.insert(out.end(), payload_buf_.begin(), payload_buf_.end()); 
+void ClientSession::finish_replay() {
+    replay_cursor_ = Journal::Cursor();
+    {
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        replay_hold_ = false;
+        // live trades of the topic that the replay already sent (and the
+        // last-value snapshot) carry a sequence number below replay_end_;
+        // anything else queued meanwhile, such as a bar, goes out as it is
+        auto replayed = [this](const FramePtr& f) {
+            return is_trade(*f) && f->topic() == replay_topic_ && f->seq() < replay_end_;
+        };
+        for (size_t i = write_head_; i < write_queue_.size(); ++i) {
+            if (replayed(write_queue_[i])) queued_bytes_ -= write_queue_[i]->size();
+        }
+        write_queue_.erase(std::remove_if(write_queue_.begin() + write_head_, write_queue_.end(), replayed),
+                           write_queue_.end());
+        if (writing_ || queued_frames() == 0) return;
+        writing_ = true;
+    }
+    do_write();
+}
 
-            for (auto &sub : subscribers) {
-                if (sub) sub->deliver_raw(out);
-            }
-            do_read_header();
-        });
+// DATA, or DATA_TS which additionally gets its ingress stamp here
+void ClientSession::on_data(const uint8_t* wire, size_t len) {
+    Metrics::Timer decode(Metrics::Stage::DECODE);
+    int32_t topic = serializer::read_int32_be(wire + len - PAYLOAD_SIZE);
+
+    // encode once, every subscriber queues the same frame by reference
+    auto frame = Frame::allocate(len);
+    std::memcpy(frame->data(), wire, len);
+    if (wire[0] == static_cast<uint8_t>(MsgType::DATA_TS)) {
+        serializer::write_uint64_be(frame->data() + TRACE_INGRESS_OFFSET, trace_clock_ns());
+    }
+    frame->set_topic(topic);
+    if (is_link()) frame->set_from_link();
+    if (Journal* journal = shard_.journal()) frame->set_seq(journal->next_seq());
+    decode.stop();
+    Metrics::published(topic, 1);
+    run_on_shard([this, topic, frame = FramePtr(std::move(frame))] { shard_.publish(topic, frame); });
+}
+
+// Every run of one topic in the batch becomes one frame with one routing
+// lookup; subscribers receive the run as a contiguous BATCH slice.
+void ClientSession::on_batch(const uint8_t* wire) {
+    size_t count = batch_count(wire);
+    const uint8_t* records = wire + BATCH_HEADER_SIZE;
+    Journal* journal = shard_.journal();
+
+    for (size_t first = 0, end = 0; first < count; first = end) {
+        Metrics::Timer decode(Metrics::Stage::DECODE);
+        int32_t topic = serializer::read_int32_be(records + first * PAYLOAD_SIZE);
+        end = first + 1;
+        while (end < count && serializer::read_int32_be(records + end * PAYLOAD_SIZE) == topic) ++end;
+        size_t n = end - first;
+
+        MutableFramePtr frame;
+        if (n == 1) {
+            frame = Frame::allocate(1 + PAYLOAD_SIZE);
+            frame->data()[0] = static_cast<uint8_t>(MsgType::DATA);
+            std::memcpy(frame->data() + 1, records + first * PAYLOAD_SIZE, PAYLOAD_SIZE);
+        } else {
+            frame = Frame::allocate(BATCH_HEADER_SIZE + n * PAYLOAD_SIZE);
+            uint8_t* p = frame->data();
+            p[0] = static_cast<uint8_t>(MsgType::BATCH);
+            p[1] = static_cast<uint8_t>(n >> 8);
+            p[2] = static_cast<uint8_t>(n & 0xFF);
+            std::memcpy(p + BATCH_HEADER_SIZE, records + first * PAYLOAD_SIZE, n * PAYLOAD_SIZE);
+        }
+        frame->set_topic(topic);
+        if (is_link()) frame->set_from_link();
+        if (journal) frame->set_seq(journal->next_seq(n));
+        decode.stop();
+        Metrics::published(topic, n);
+        run_on_shard([this, topic, frame = FramePtr(std::move(frame))] { shard_.publish(topic, frame); });
+    }
+}
+
+// A sharded shard may only be entered from its own thread; the shared-memory
+// poller hands the call over to it instead.
+template <typename Fn>
+void ClientSession::run_on_shard(Fn&& fn) {
+    if (shm_ && shard_.config().sharded()) {
+        boost::asio::post(shard_.io_context(), [self = shared_from_this(), fn = std::forward<Fn>(fn)]() mutable { fn(); });
+        return;
+    }
+    fn();
 }
-void ClientSession::deliver_raw(const std::vector<uint8_t>& msg) {
-    std::vector<uint8_t> buffer_copy = msg;
-    
+
+bool ClientSession::on_shm_attach(const uint8_t* body) {
+    if (!shm::Segment::supported()) {
+        LOG_ERROR("Shared memory transport is not supported on this platform");
+        return false;
+    }
+    const char* raw = reinterpret_cast<const char*>(body);
+    std::string name(raw, strnlen(raw, shm::NAME_SIZE));
+    // refused here, before the client is acknowledged, rather than leaving
+    // a link nobody polls
+    ShmPoller* poller = shard_.reserve_shm_poller();
+    if (!poller) {
+        LOG_WARN("Shared memory attach refused: every link of shard {} is taken", shard_.index());
+        return false;
+    }
+    try {
+        auto link = std::make_unique<ShmLink>(name);
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        shm_ = std::move(link);
+        shm_poller_ = poller;
+    } catch (const std::exception& e) {
+        poller->release();
+        LOG_ERROR("Shared memory attach failed: {}", e.what());
+        return false;
+    }
+    LOG_INFO("Client switched to shared memory segment {}", name);
+    return true;
+}
+
+void ClientSession::start_shm() {
+    // a close that got here first has given the reservation back
+    if (shm_served_.exchange(true)) return;
+    shm_poller_->add(*shm_, [this] { return poll_shm(); }, shared_from_this());
+    watch_socket();
+}
+
+// The socket of a shared-memory session only tells us when the client is gone.
+void ClientSession::watch_socket() {
     auto self = shared_from_this();
+    socket_.async_read_some(boost::asio::buffer(&socket_probe_, 1), bind_memory(read_memory_,
+        [this, self](boost::system::error_code ec, std::size_t /*len*/) {
+            if (!ec) LOG_ERROR("Unexpected bytes on the socket of a shared memory session");
+            handle_error_and_close();
+        }));
+}
 
-    boost::asio::async_write(socket_, boost::asio::buffer(buffer_copy.data(), buffer_copy.size()),
-        [this, self, buffer_copy](boost::system::error_code ec, std::size_t /*len*/) {
-            if (ec) {
-                Logger::error("Subscriber deliver error: " + ec.message());
-                handle_error_and_close(); 
+// One pass of the poller over this link: parse what the client wrote, then move queued
+// output into the outbound ring.
+ShmLink::PollResult ClientSession::poll_shm() {
+    ShmLink::PollResult r;
+    if (closed_) return r;
+
+    size_t n = shm_->inbound().read(rx_.write_ptr(), rx_.writable());
+    if (n > 0) {
+        rx_.commit(n);
+        if (!process_frames()) {
+            handle_error_and_close();
+            return r;
+        }
+        r.progress = true;
+    }
+
+    std::lock_guard<std::mutex> lock(write_mtx_);
+    if (flush_shm()) r.progress = true;
+    if (queued_frames() > 0) r.backlog = write_queue_[write_head_]->size();
+    return r;
+}
+
+// write_mtx_ held
+// DATA_TS frames are shared by all subscribers; each gets its egress stamp
+// on a copy
+bool ClientSession::shm_write(const Frame& frame) {
+    if (frame.data()[0] != static_cast<uint8_t>(MsgType::DATA_TS)) {
+        return shm_->outbound().try_write(frame.data(), frame.size());
+    }
+    std::array<uint8_t, DATA_TS_FRAME_SIZE> stamped;
+    std::memcpy(stamped.data(), frame.data(), stamped.size());
+    serializer::write_uint64_be(stamped.data() + TRACE_EGRESS_OFFSET, trace_clock_ns());
+    return shm_->outbound().try_write(stamped.data(), stamped.size());
+}
+
+bool ClientSession::flush_shm() {
+    bool wrote = false;
+    while (queued_frames() > 0) {
+        const FramePtr& frame = write_queue_[write_head_];
+        if (!shm_write(*frame)) break;
+        Metrics::written(1, frame->size());
+        queued_bytes_ -= frame->size();
+        write_queue_[write_head_++].reset();
+        wrote = true;
+    }
+    if (queued_frames() == 0 && !write_queue_.empty()) {
+        write_queue_.clear();
+        write_head_ = 0;
+        if (grace_armed_) {
+            grace_armed_ = false;
+            grace_timer_.cancel();
+        }
+    }
+    return wrote;
+}
+
+void ClientSession::deliver_raw(const FramePtr& frame) {
+    {
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        if (closed_) return;
+        if (shm_) {
+            // straight into the ring unless older frames are still waiting for room
+            if (queued_frames() == 0 && shm_write(*frame)) {
+                Metrics::written(1, frame->size());
+                return;
             }
-        });
+            if (!admit(frame)) return;
+            write_queue_.push_back(frame);
+            queued_bytes_ += frame->size();
+            queued_peak_ = std::max(queued_peak_, queued_frames());
+            // the poller flushes the backlog; make sure it is looking
+            if (queued_frames() == 1) shm_->wake();
+            return;
+        }
+        if (!admit(frame)) return;
+        write_queue_.push_back(frame);
+        queued_bytes_ += frame->size();
+        queued_peak_ = std::max(queued_peak_, queued_frames());
+        // a flush is already running, it will pick this frame up when it
+        // completes; during a replay the frame waits for the replay to finish
+        if (writing_ || replay_hold_) return;
+        writing_ = true;
+    }
+    do_write();
 }
 
-void ClientSession::do_write() {
+void ClientSession::fence_snapshot(int topic_id, uint64_t version) {
+    uint64_t& fence = snapshot_fences_[topic_id];
+    fence = std::max(fence, version);
+}
+
+bool ClientSession::behind_snapshot(int topic_id, uint64_t version) {
+    if (snapshot_fences_.empty()) return false;
+    auto it = snapshot_fences_.find(topic_id);
+    if (it == snapshot_fences_.end()) return false;
+    if (version <= it->second) return true;
+    snapshot_fences_.erase(it);
+    return false;
+}
+
+// Applies the outbound budget before a frame is queued (write_mtx_ held).
+// Returns false when the frame must not be appended. Control frames on a
+// link to a peer broker (its hello and interest) are always queued and never
+// dropped to make room; the data forwarded over it is budgeted like any
+// subscriber's.
+bool ClientSession::admit(const FramePtr& frame) {
+    bool link = is_link();
+    if (link && is_control(*frame)) return true;
+    const SlowConsumerConfig& limits = shard_.config().slow_consumer;
+    auto over_budget = [&](size_t extra) {
+        return queued_frames() + 1 > limits.max_frames || queued_bytes_ + extra > limits.max_bytes;
+    };
+    if (!over_budget(frame->size())) return true;
+
+    auto& stats = SlowConsumerStats::instance();
+    switch (limits.policy_for(frame->topic())) {
+        case SlowConsumerPolicy::CONFLATE:
+            // only a trade replaces a trade: bars, batches, retransmits and
+            // control frames are never conflated
+            for (size_t i = write_queue_.size(); is_data(*frame) && i-- > write_head_; ) {
+                if (!is_data(*write_queue_[i]) || write_queue_[i]->topic() != frame->topic()) continue;
+                queued_bytes_ = queued_bytes_ - write_queue_[i]->size() + frame->size();
+                write_queue_[i] = frame;
+                stats.conflated.fetch_add(1, std::memory_order_relaxed);
+                return false;
+            }
+            // no queued trade of this topic to replace; make room like drop-oldest
+            [[fallthrough]];
+        case SlowConsumerPolicy::DROP_OLDEST:
+            while (queued_frames() > 0 && over_budget(frame->size())) {
+                if (link && is_control(*write_queue_[write_head_])) {
+                    // an interest frame is next; drop the new frame instead
+                    stats.dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                queued_bytes_ -= write_queue_[write_head_]->size();
+                write_queue_[write_head_++].reset();
+                stats.dropped_oldest.fetch_add(1, std::memory_order_relaxed);
+            }
+            return true;
+        case SlowConsumerPolicy::DISCONNECT:
+            stats.dropped_in_grace.fetch_add(1, std::memory_order_relaxed);
+            if (!grace_armed_) start_grace_timer(limits.disconnect_grace);
+            return false;
+    }
+    return true;
+}
+
+void ClientSession::start_grace_timer(std::chrono::milliseconds grace) {
+    grace_armed_ = true;
+    grace_timer_.expires_after(grace);
     auto self = shared_from_this();
-    std::lock_guard<std::mutex> lock(write_mtx_);
-    if (write_queue_.empty()) return;
+    grace_timer_.async_wait([this, self](boost::system::error_code ec) {
+        if (ec) return;
+        {
+            std::lock_guard<std::mutex> lock(write_mtx_);
+            if (!grace_armed_) return;
+            grace_armed_ = false;
+        }
+        LOG_WARN("Subscriber stayed over its outbound budget, disconnecting.");
+        SlowConsumerStats::instance().disconnects.fetch_add(1, std::memory_order_relaxed);
+        boost::system::error_code ignored;
+        socket_.close(ignored);
+        handle_error_and_close();
+    });
+}
 
-    auto &buf = write_queue_.front();
-    boost::asio::async_write(socket_, boost::asio::buffer(buf.data(), buf.size()),
-        [this, self](boost::system::error_code ec, std::size_t /*len*/) {
+// Sends everything queued so far as one gathered write. Frames delivered while
+// it is in flight accumulate in write_queue_ and go out with the next flush,
+// so there is never more than one async_write outstanding on the socket.
+void ClientSession::do_write() {
+    size_t first = 0;
+    {
+        std::lock_guard<std::mutex> lock(write_mtx_);
+        if (queued_frames() == 0 || closed_ || replay_hold_) {
+            writing_ = false;
+            return;
+        }
+        in_flight_.swap(write_queue_);
+        first = write_head_;
+        write_head_ = 0;
+        queued_bytes_ = 0;
+        // the queue just emptied, so a pending disconnect no longer applies
+        if (grace_armed_) {
+            grace_armed_ = false;
+            grace_timer_.cancel();
+        }
+    }
+
+    write_bufs_.clear();
+    egress_stamps_.clear();
+    uint64_t egress = 0;
+    for (size_t i = first; i < in_flight_.size(); ++i) {
+        const Frame& f = *in_flight_[i];
+        if (f.data()[0] != static_cast<uint8_t>(MsgType::DATA_TS)) {
+            write_bufs_.emplace_back(f.data(), f.size());
+            continue;
+        }
+        // the frame is shared, so its egress stamp goes out from egress_stamps_
+        // (reserved for every remaining frame, the buffers stay put)
+        if (egress == 0) {
+            egress = trace_clock_ns();
+            egress_stamps_.reserve(in_flight_.size() - i);
+        }
+        egress_stamps_.emplace_back();
+        serializer::write_uint64_be(egress_stamps_.back().data(), egress);
+        write_bufs_.emplace_back(f.data(), TRACE_EGRESS_OFFSET);
+        write_bufs_.emplace_back(egress_stamps_.back().data(), 8);
+        write_bufs_.emplace_back(f.data() + TRACE_EGRESS_OFFSET + 8, f.size() - TRACE_EGRESS_OFFSET - 8);
+    }
+
+    size_t frames = in_flight_.size() - first;
+    Metrics::Timer write(Metrics::Stage::WRITE);
+    auto self = shared_from_this();
+    boost::asio::async_write(socket_, BufferRange(write_bufs_), bind_memory(write_memory_,
+        [this, self, frames, write](boost::system::error_code ec, std::size_t len) mutable {
+            in_flight_.clear();
             if (ec) {
+                Logger::error("Subscriber deliver error: " + ec.message());
+                {
+                    std::lock_guard<std::mutex> lock(write_mtx_);
+                    writing_ = false;
+                    write_queue_.clear();
+                    write_head_ = 0;
+                    queued_bytes_ = 0;
+                }
                 handle_error_and_close();
                 return;
             }
-            std::lock_guard<std::mutex> lock2(write_mtx_);
-            write_queue_.pop_front();
-            if (!write_queue_.empty()) {
-                do_write();
-            }
-        });
-}
\ No newline at end of file
+            write.stop();
+            Metrics::written(frames, len);
+            do_write();
+        }));
+}
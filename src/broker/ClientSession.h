@@ -1,45 +1,157 @@
 #pragma once
 #include <boost/asio.hpp>
-#include <deque>
+#include <array>
+#include <atomic>
+#include <chrono>
 #include <memory>
 #include <vector>
 #include <mutex>
-#include <array> 
+#include <string>
+#include <unordered_map>
 #include "../common/message.h"
 #include "../common/serializer.h"
+#include "../common/recv_buffer.h"
+#include "Frame.h"
+#include "HandlerMemory.h"
+#include "ShmLink.h"
+#include "Journal.h"
 
 class SubscriptionManager;
+class Shard;
+class Federation;
 
 class ClientSession : public std::enable_shared_from_this<ClientSession> {
 public:
 
     static constexpr size_t PAYLOAD_SIZE = sizeof(TradeMessage);
+    static constexpr size_t RECV_BUFFER_SIZE = 64 * 1024;
+    // journal records handed to one async_write during a replay
+    static constexpr size_t REPLAY_CHUNK_RECORDS = 512;
 
-    ClientSession(boost::asio::ip::tcp::socket socket, SubscriptionManager& mgr);
+    ClientSession(boost::asio::ip::tcp::socket socket, Shard& shard);
     ~ClientSession();
 
+    // the session and its control block in one block recycled across connections
+    static std::shared_ptr<ClientSession> create(boost::asio::ip::tcp::socket socket, Shard& shard);
+
     void start();
-    bool closed_ = false;
-    void deliver_raw(const std::vector<uint8_t>& data);
+    // dialing side of a link to a peer broker: sends PEER_HELLO, then start()
+    void start_link(uint32_t broker_id);
+    // closes the socket; the pending read then tears the session down
+    void disconnect();
+    std::atomic<bool> closed_{false};
+    void deliver_raw(const FramePtr& frame);
+    // Sharded mode, on the session's shard thread: a last-value snapshot of
+    // the topic at cache version `version` was queued. Frames routed over
+    // from other shards at or below it are older, and behind_snapshot() says
+    // to skip them; the first newer one lifts the fence.
+    void fence_snapshot(int topic_id, uint64_t version);
+    bool behind_snapshot(int topic_id, uint64_t version);
+    bool receives_multicast() const { return multicast_.load(std::memory_order_relaxed); }
+    // a link to a peer broker rather than a client (see Federation)
+    bool is_link() const { return link_.load(std::memory_order_relaxed); }
+    bool dialed_link() const { return dialed_; }
+
+    // for the admin report
+    struct QueueDepth {
+        size_t frames = 0;
+        size_t bytes = 0;
+        size_t peak_frames = 0; // most frames ever waiting at once
+    };
+    QueueDepth queue_depth();
+    uint64_t id() const { return id_; }
+    const std::string& peer() const { return peer_; }
     
     // Metoda za automatsko odjavljivanje pozvana iz asinkronog callbacka
     void handle_error_and_close(); 
 
 private:
-    void do_read_header();
-    void do_read_subscribe();
-    void do_read_data();
+    void do_read();
+    bool process_frames();
+    void on_subscribe(const uint8_t* body);
+    void on_subscribe_pattern(MsgType type, const uint8_t* body);
+    void on_unsubscribe(const uint8_t* sub);
+    bool on_subscribe_filter(const uint8_t* body);
+    bool on_subscribe_bars(const uint8_t* body);
+    bool on_peer_hello(const uint8_t* body);
+    Federation* interest();
+    bool on_shm_attach(const uint8_t* body);
+    void on_mcast_join();
+    void on_retransmit_request(const uint8_t* body);
+    void on_subscribe_replay(const uint8_t* body);
+    void wait_for_journal();
+    void stream_replay();
+    void finish_replay();
+    void start_shm();
+    void watch_socket();
+    ShmLink::PollResult poll_shm();
+    bool flush_shm();
+    bool shm_write(const Frame& frame);
+    template <typename Fn> void run_on_shard(Fn&& fn);
+    void on_data(const uint8_t* wire, size_t len);
+    void on_batch(const uint8_t* wire);
     void do_write();
+    bool admit(const FramePtr& frame);
+    void start_grace_timer(std::chrono::milliseconds grace);
+    size_t queued_frames() const { return write_queue_.size() - write_head_; }
 
     boost::asio::ip::tcp::socket socket_;
+    Shard& shard_;
+    uint64_t id_;
+    std::string peer_;
     SubscriptionManager& manager_;
 
-    // write queue (thread-safe queue)
-    std::deque<std::vector<uint8_t>> write_queue_;
+    // write queue: frames wait in write_queue_ while a flush of in_flight_ runs;
+    // entries before write_head_ were dropped by the slow-consumer policy
+    std::vector<FramePtr> write_queue_;
+    size_t write_head_ = 0;
+    size_t queued_bytes_ = 0;
+    size_t queued_peak_ = 0;
+    std::vector<FramePtr> in_flight_;
+    std::vector<boost::asio::const_buffer> write_bufs_;
+    // egress stamps of the DATA_TS frames in write_bufs_
+    std::vector<std::array<uint8_t, 8>> egress_stamps_;
+    bool writing_ = false;
     std::mutex write_mtx_;
 
-    // read buffers
-    uint8_t msg_type_; 
-    // Fiksni bafer za čitanje cijelog payload-a (28 bajtova)
-    std::array<uint8_t, PAYLOAD_SIZE> payload_buf_; 
+    // operation state of the read and the write in flight (reads and writes
+    // are each one at a time), so neither allocates per frame
+    HandlerMemory read_memory_;
+    HandlerMemory write_memory_;
+
+    // armed while over budget under the "disconnect" policy
+    boost::asio::steady_timer grace_timer_;
+    bool grace_armed_ = false;
+
+    // inbound bytes, parsed a whole read at a time
+    RecvBuffer rx_;
+    bool first_frame_ = true;
+    // sent MCAST_JOIN: multicast topics are not delivered on this session
+    std::atomic<bool> multicast_{false};
+    // PEER_HELLO exchanged or sent; dialed_ when this broker opened the link
+    std::atomic<bool> link_{false};
+    bool dialed_ = false;
+    // topic -> cache version of the snapshot still fencing older frames
+    std::unordered_map<int, uint64_t> snapshot_fences_;
+
+    // Set when the client switched to shared memory (SHM_ATTACH). From then on
+    // frames come and go through the link's rings, rx_ belongs to the shard's
+    // poller thread, write_queue_ only holds what did not fit into the outbound
+    // ring and the socket is watched for the client going away.
+    std::unique_ptr<ShmLink> shm_;
+    ShmPoller* shm_poller_ = nullptr;
+    // the link's reservation on shm_poller_ was handed to it, or given back
+    std::atomic<bool> shm_served_{false};
+    uint8_t socket_probe_ = 0;
+
+    // SUBSCRIBE_REPLAY in progress: live frames collect in write_queue_ while
+    // the journal up to replay_end_ is written straight from the mapping, then
+    // the held frames that the replay already covered are dropped
+    bool replay_hold_ = false; // write_mtx_
+    int replay_topic_ = 0;
+    Journal::ReplayFrom replay_mode_ = Journal::ReplayFrom::SEQ;
+    uint64_t replay_from_ = 0;
+    uint64_t replay_end_ = 0;
+    Journal::Cursor replay_cursor_;
+    boost::asio::steady_timer replay_timer_;
 };
\ No newline at end of file
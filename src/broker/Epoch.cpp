@@ -0,0 +1,98 @@
+#include "Epoch.h"
+#include <array>
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+#include <vector>
+
+namespace {
+
+constexpr size_t MAX_THREADS = 256;
+
+// 0 means "not inside a guard"; otherwise the global epoch seen on entry
+struct alignas(64) Slot {
+    std::atomic<uint64_t> epoch{0};
+    std::atomic<bool> in_use{false};
+};
+
+struct Retired {
+    void* ptr;
+    void (*deleter)(void*);
+    uint64_t epoch;
+};
+
+std::array<Slot, MAX_THREADS> slots;
+std::atomic<uint64_t> global_epoch{1};
+
+std::mutex retire_mtx;
+std::vector<Retired> retired;
+
+struct ThreadState {
+    Slot* slot = nullptr;
+    uint32_t depth = 0;
+
+    ~ThreadState() {
+        if (slot) {
+            slot->epoch.store(0, std::memory_order_release);
+            slot->in_use.store(false, std::memory_order_release);
+        }
+    }
+};
+
+thread_local ThreadState local;
+
+Slot* acquire_slot() {
+    for (auto& s : slots) {
+        bool expected = false;
+        if (!s.in_use.load(std::memory_order_relaxed) &&
+            s.in_use.compare_exchange_strong(expected, true)) {
+            return &s;
+        }
+    }
+    throw std::runtime_error("Epoch: too many reader threads");
+}
+
+void reclaim_locked() {
+    uint64_t min_active = UINT64_MAX;
+    for (auto& s : slots) {
+        uint64_t e = s.epoch.load(std::memory_order_seq_cst);
+        if (e != 0 && e < min_active) min_active = e;
+    }
+
+    size_t kept = 0;
+    for (auto& r : retired) {
+        // a reader that entered at epoch <= r.epoch may still hold r.ptr
+        if (r.epoch < min_active) {
+            r.deleter(r.ptr);
+        } else {
+            retired[kept++] = r;
+        }
+    }
+    retired.resize(kept);
+}
+
+}
+
+Epoch::Guard::Guard() {
+    if (local.depth++ > 0) return;
+    if (!local.slot) local.slot = acquire_slot();
+    // seq_cst so the announcement is visible before the protected pointer is loaded
+    local.slot->epoch.store(global_epoch.load(std::memory_order_relaxed), std::memory_order_seq_cst);
+}
+
+Epoch::Guard::~Guard() {
+    if (--local.depth > 0) return;
+    local.slot->epoch.store(0, std::memory_order_release);
+}
+
+void Epoch::retire(void* p, void (*deleter)(void*)) {
+    std::lock_guard<std::mutex> lock(retire_mtx);
+    retired.push_back({p, deleter, global_epoch.load(std::memory_order_seq_cst)});
+    global_epoch.fetch_add(1, std::memory_order_seq_cst);
+    reclaim_locked();
+}
+
+void Epoch::reclaim() {
+    std::lock_guard<std::mutex> lock(retire_mtx);
+    reclaim_locked();
+}
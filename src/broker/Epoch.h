@@ -0,0 +1,28 @@
+#pragma once
+#include <cstdint>
+
+// Epoch-based reclamation for the broker's read-mostly tables.
+//
+// Readers wrap their access in an Epoch::Guard; that costs one store to a
+// per-thread slot and never blocks. Writers swap in a new version of a
+// structure and hand the old one to retire(), which frees it only once every
+// reader that could still be looking at it has left its guard.
+class Epoch {
+public:
+    class Guard {
+    public:
+        Guard();
+        ~Guard();
+        Guard(const Guard&) = delete;
+        Guard& operator=(const Guard&) = delete;
+    };
+
+    template <typename T>
+    static void retire(const T* p) {
+        if (p) retire(const_cast<T*>(p), [](void* q) { delete static_cast<T*>(q); });
+    }
+    static void retire(void* p, void (*deleter)(void*));
+
+    // frees whatever retired memory no active reader can reach any more
+    static void reclaim();
+};
@@ -0,0 +1,306 @@
+#include "Federation.h"
+#include "ClientSession.h"
+#include "Shard.h"
+#include <algorithm>
+#include <cstring>
+#include "../common/message.h"
+#include "../common/serializer.h"
+#include "../common/logger.h"
+
+using boost::asio::ip::tcp;
+
+namespace {
+
+FramePtr control_frame(const std::vector<uint8_t>& bytes) {
+    auto frame = Frame::allocate(bytes.size());
+    std::memcpy(frame->data(), bytes.data(), bytes.size());
+    return frame;
+}
+
+// SUBSCRIBE for the topic, or UNSUBSCRIBE of it when `cancel`
+FramePtr interest_frame(bool cancel, int topic_id) {
+    std::vector<uint8_t> out;
+    if (cancel) out.push_back(static_cast<uint8_t>(MsgType::UNSUBSCRIBE));
+    out.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE));
+    serializer::write_int32_be(out, topic_id);
+    return control_frame(out);
+}
+
+FramePtr interest_frame(bool cancel, const TopicPattern& pattern) {
+    std::vector<uint8_t> out;
+    if (cancel) out.push_back(static_cast<uint8_t>(MsgType::UNSUBSCRIBE));
+    switch (pattern.kind) {
+        case TopicPattern::Kind::RANGE:
+            out.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE_RANGE));
+            serializer::write_int32_be(out, pattern.lo);
+            serializer::write_int32_be(out, pattern.hi);
+            break;
+        case TopicPattern::Kind::MASK:
+            out.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE_MASK));
+            serializer::write_int32_be(out, static_cast<int32_t>(pattern.value));
+            serializer::write_int32_be(out, static_cast<int32_t>(pattern.mask));
+            break;
+        case TopicPattern::Kind::ALL:
+            out.push_back(static_cast<uint8_t>(MsgType::SUBSCRIBE_ALL));
+            break;
+    }
+    return control_frame(out);
+}
+
+}
+
+Federation::Federation(boost::asio::io_context& io, const BrokerConfig& config,
+                       const std::vector<std::unique_ptr<Shard>>& shards)
+    : io_(io), shards_(shards), id_(config.broker_id), redial_timer_(io) {
+    for (const auto& peer : config.peers) {
+        auto colon = peer.rfind(':');
+        Dial d;
+        d.host = peer.substr(0, colon);
+        d.port = peer.substr(colon + 1);
+        dials_.push_back(std::move(d));
+    }
+}
+
+void Federation::start() {
+    if (dials_.empty()) return;
+    boost::asio::post(io_, [this] { redial(); });
+}
+
+// Runs on io_ every REDIAL_INTERVAL. An address is dialed while it has no
+// connection, unless the broker behind it is already linked the other way.
+void Federation::redial() {
+    std::vector<size_t> due;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (size_t i = 0; i < dials_.size(); ++i) {
+            Dial& d = dials_[i];
+            if (d.self || d.connecting) continue;
+            auto session = d.session.lock();
+            if (session && !session->closed_) continue;
+            if (d.peer_id != 0 && linked_locked(d.peer_id)) continue;
+            d.connecting = true;
+            due.push_back(i);
+        }
+    }
+    for (size_t i : due) dial(i);
+
+    redial_timer_.expires_after(REDIAL_INTERVAL);
+    redial_timer_.async_wait([this](boost::system::error_code ec) {
+        if (!ec) redial();
+    });
+}
+
+void Federation::dial(size_t index) {
+    Shard& target = *shards_[next_shard_];
+    next_shard_ = (next_shard_ + 1) % shards_.size();
+
+    // dials_ only grows in the constructor, so the strings stay put
+    const Dial& d = dials_[index];
+    auto resolver = std::make_shared<tcp::resolver>(io_);
+    auto socket = std::make_shared<tcp::socket>(target.io_context());
+    auto failed = [this, index](const char* what, const boost::system::error_code& ec) {
+        std::lock_guard<std::mutex> lock(mtx_);
+        Dial& d = dials_[index];
+        d.connecting = false;
+        LOG_WARN("Peer {}:{} {} failed: {}", d.host, d.port, what, ec.message());
+    };
+    resolver->async_resolve(d.host, d.port,
+        [this, index, resolver, socket, failed, &target](boost::system::error_code ec, tcp::resolver::results_type results) {
+            if (ec) {
+                failed("resolve", ec);
+                return;
+            }
+            boost::asio::async_connect(*socket, results,
+                [this, index, socket, failed, &target](boost::system::error_code ec, const tcp::endpoint&) {
+                    if (ec) {
+                        failed("connect", ec);
+                        return;
+                    }
+                    auto session = ClientSession::create(std::move(*socket), target);
+                    {
+                        std::lock_guard<std::mutex> lock(mtx_);
+                        dials_[index].session = session;
+                        dials_[index].connecting = false;
+                    }
+                    session->start_link(id_);
+                });
+        });
+}
+
+bool Federation::Held::holds(int topic_id) const {
+    return topics.count(topic_id) != 0 ||
+           std::any_of(filtered.begin(), filtered.end(), [&](const auto& f) { return f.first == topic_id; }) ||
+           std::any_of(bars.begin(), bars.end(), [&](const auto& b) { return b.first == topic_id; });
+}
+
+// a session's plain, filtered and bar subscriptions of one topic are one interest
+void Federation::add_interest(const ClientSession* session, int topic_id) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Held& held = held_[session];
+    bool had = held.holds(topic_id);
+    if (held.topics.insert(topic_id).second && !had) add_topic_locked(topic_id);
+}
+
+void Federation::remove_interest(const ClientSession* session, int topic_id) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = held_.find(session);
+    if (it == held_.end() || it->second.topics.erase(topic_id) == 0) return;
+    if (!it->second.holds(topic_id)) remove_topic_locked(topic_id);
+    if (it->second.empty()) held_.erase(it);
+}
+
+void Federation::add_interest(const ClientSession* session, int topic_id, const TradeFilter& filter) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Held& held = held_[session];
+    std::pair<int, TradeFilter> sub{topic_id, filter};
+    if (std::find(held.filtered.begin(), held.filtered.end(), sub) != held.filtered.end()) return;
+    bool had = held.holds(topic_id);
+    held.filtered.push_back(sub);
+    if (!had) add_topic_locked(topic_id);
+}
+
+void Federation::remove_interest(const ClientSession* session, int topic_id, const TradeFilter& filter) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = held_.find(session);
+    if (it == held_.end()) return;
+    auto& filtered = it->second.filtered;
+    auto f = std::find(filtered.begin(), filtered.end(), std::pair<int, TradeFilter>{topic_id, filter});
+    if (f == filtered.end()) return;
+    filtered.erase(f);
+    if (!it->second.holds(topic_id)) remove_topic_locked(topic_id);
+    if (it->second.empty()) held_.erase(it);
+}
+
+void Federation::add_interest(const ClientSession* session, int topic_id, uint32_t bar_interval_ms) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    Held& held = held_[session];
+    std::pair<int, uint32_t> sub{topic_id, bar_interval_ms};
+    if (std::find(held.bars.begin(), held.bars.end(), sub) != held.bars.end()) return;
+    bool had = held.holds(topic_id);
+    held.bars.push_back(sub);
+    if (!had) add_topic_locked(topic_id);
+}
+
+void Federation::remove_interest(const ClientSession* session, int topic_id, uint32_t bar_interval_ms) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = held_.find(session);
+    if (it == held_.end()) return;
+    auto& bars = it->second.bars;
+    auto b = std::find(bars.begin(), bars.end(), std::pair<int, uint32_t>{topic_id, bar_interval_ms});
+    if (b == bars.end()) return;
+    bars.erase(b);
+    if (!it->second.holds(topic_id)) remove_topic_locked(topic_id);
+    if (it->second.empty()) held_.erase(it);
+}
+
+void Federation::add_interest(const ClientSession* session, const TopicPattern& pattern) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto& patterns = held_[session].patterns;
+    if (std::find(patterns.begin(), patterns.end(), pattern) != patterns.end()) return;
+    patterns.push_back(pattern);
+    add_pattern_locked(pattern);
+}
+
+void Federation::remove_interest(const ClientSession* session, const TopicPattern& pattern) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = held_.find(session);
+    if (it == held_.end()) return;
+    auto& patterns = it->second.patterns;
+    auto p = std::find(patterns.begin(), patterns.end(), pattern);
+    if (p == patterns.end()) return;
+    patterns.erase(p);
+    remove_pattern_locked(pattern);
+    if (it->second.empty()) held_.erase(it);
+}
+
+void Federation::drop_interest(const ClientSession* session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = held_.find(session);
+    if (it == held_.end()) return;
+    Held held = std::move(it->second);
+    held_.erase(it);
+    for (auto& [topic_id, filter] : held.filtered) held.topics.insert(topic_id);
+    for (auto& [topic_id, interval_ms] : held.bars) held.topics.insert(topic_id);
+    for (int topic_id : held.topics) remove_topic_locked(topic_id);
+    for (const auto& pattern : held.patterns) remove_pattern_locked(pattern);
+}
+
+bool Federation::link_up(const std::shared_ptr<ClientSession>& link, uint32_t peer_id) {
+    std::shared_ptr<ClientSession> replaced;
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        for (auto& d : dials_) {
+            if (d.session.lock() != link) continue;
+            d.peer_id = peer_id;
+            d.self = peer_id == id_;
+        }
+        if (peer_id == id_) {
+            LOG_WARN("Peer {} is this broker, closing the link", link->peer());
+            return false;
+        }
+
+        // both ends agree on which of two links between them survives
+        auto dialer = [&](const ClientSession& s) { return s.dialed_link() ? id_ : peer_id; };
+        auto it = std::find_if(links_.begin(), links_.end(), [&](const Link& l) { return l.peer_id == peer_id; });
+        if (it != links_.end()) {
+            if (dialer(*link) >= dialer(*it->session)) {
+                LOG_INFO("Already linked to broker {}, closing the second link via {}", peer_id, link->peer());
+                return false;
+            }
+            replaced = std::move(it->session);
+            links_.erase(it);
+        }
+        links_.push_back({peer_id, link});
+
+        for (const auto& [topic_id, count] : topics_) link->deliver_raw(interest_frame(false, topic_id));
+        for (const auto& [pattern, count] : patterns_) link->deliver_raw(interest_frame(false, pattern));
+        LOG_INFO("Linked to broker {} via {}, interest in {} topics and {} patterns", peer_id, link->peer(),
+                 topics_.size(), patterns_.size());
+    }
+    if (replaced) replaced->disconnect();
+    return true;
+}
+
+void Federation::link_down(const ClientSession* link) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    auto it = std::find_if(links_.begin(), links_.end(), [&](const Link& l) { return l.session.get() == link; });
+    if (it == links_.end()) return;
+    LOG_WARN("Link to broker {} closed", it->peer_id);
+    links_.erase(it);
+}
+
+void Federation::send_locked(const FramePtr& frame) {
+    for (auto& l : links_) l.session->deliver_raw(frame);
+}
+
+void Federation::add_topic_locked(int topic_id) {
+    if (topics_[topic_id]++ == 0) send_locked(interest_frame(false, topic_id));
+}
+
+void Federation::remove_topic_locked(int topic_id) {
+    auto it = topics_.find(topic_id);
+    if (it == topics_.end() || --it->second > 0) return;
+    topics_.erase(it);
+    send_locked(interest_frame(true, topic_id));
+}
+
+void Federation::add_pattern_locked(const TopicPattern& pattern) {
+    auto it = std::find_if(patterns_.begin(), patterns_.end(), [&](const auto& p) { return p.first == pattern; });
+    if (it != patterns_.end()) {
+        ++it->second;
+        return;
+    }
+    patterns_.emplace_back(pattern, 1);
+    send_locked(interest_frame(false, pattern));
+}
+
+void Federation::remove_pattern_locked(const TopicPattern& pattern) {
+    auto it = std::find_if(patterns_.begin(), patterns_.end(), [&](const auto& p) { return p.first == pattern; });
+    if (it == patterns_.end() || --it->second > 0) return;
+    patterns_.erase(it);
+    send_locked(interest_frame(true, pattern));
+}
+
+bool Federation::linked_locked(uint32_t peer_id) const {
+    return std::any_of(links_.begin(), links_.end(), [&](const Link& l) { return l.peer_id == peer_id; });
+}
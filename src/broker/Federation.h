@@ -0,0 +1,116 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <chrono>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+#include <utility>
+#include <vector>
+#include "BrokerConfig.h"
+#include "Frame.h"
+#include "../common/topic_pattern.h"
+#include "../common/trade_filter.h"
+
+class ClientSession;
+class Shard;
+
+// Links to peer brokers (--peer HOST:PORT).
+//
+// A link is one TCP connection between two brokers carrying traffic both
+// ways, handled on each side by an ordinary ClientSession. The dialing side
+// sends PEER_HELLO with its broker id and the other answers with its own.
+// From then on each broker sends the other its local interest as plain
+// SUBSCRIBE*/UNSUBSCRIBE frames, one per topic or pattern going from no
+// local subscriber to some and back. The receiving broker registers the link
+// in its SubscriptionManager like any subscriber, so a frame crosses a link
+// only when the peer has subscribers for it, and many frames queued for the
+// link leave in one gathered write.
+//
+// Loops are prevented by split horizon: frames that arrived over a link are
+// never routed to another link, and a peer's subscriptions are not passed on
+// as interest. Brokers that should exchange data therefore need a direct
+// link (a full mesh), every frame takes at most one hop. When two brokers
+// dial each other, both keep the connection dialed by the lower broker id.
+class Federation {
+public:
+    static constexpr std::chrono::seconds REDIAL_INTERVAL{1};
+
+    // dialing runs on `io`; links are spread over the shards like accepted sessions
+    Federation(boost::asio::io_context& io, const BrokerConfig& config,
+               const std::vector<std::unique_ptr<Shard>>& shards);
+
+    uint32_t id() const { return id_; }
+    // starts dialing every configured peer, and again whenever a link is lost
+    void start();
+
+    // Interest of local subscribers (sessions that are not links). Any thread;
+    // repeats of the same subscription by one session count once. Peers are
+    // asked for the whole topic of a filtered or bar subscription; filters
+    // and bars run here.
+    void add_interest(const ClientSession* session, int topic_id);
+    void remove_interest(const ClientSession* session, int topic_id);
+    void add_interest(const ClientSession* session, const TopicPattern& pattern);
+    void remove_interest(const ClientSession* session, const TopicPattern& pattern);
+    void add_interest(const ClientSession* session, int topic_id, const TradeFilter& filter);
+    void remove_interest(const ClientSession* session, int topic_id, const TradeFilter& filter);
+    void add_interest(const ClientSession* session, int topic_id, uint32_t bar_interval_ms);
+    void remove_interest(const ClientSession* session, int topic_id, uint32_t bar_interval_ms);
+    // the session closed: everything it held
+    void drop_interest(const ClientSession* session);
+
+    // PEER_HELLO received on a link. Queues the local interest to it; false
+    // when the link must be closed (a link to ourselves, or the losing one of
+    // two links to the same peer).
+    bool link_up(const std::shared_ptr<ClientSession>& link, uint32_t peer_id);
+    void link_down(const ClientSession* link);
+
+private:
+    struct Held {
+        std::unordered_set<int> topics;
+        std::vector<TopicPattern> patterns;
+        std::vector<std::pair<int, TradeFilter>> filtered;
+        std::vector<std::pair<int, uint32_t>> bars; // topic, interval
+
+        bool holds(int topic_id) const;
+        bool empty() const { return topics.empty() && patterns.empty() && filtered.empty() && bars.empty(); }
+    };
+    struct Link {
+        uint32_t peer_id = 0;
+        std::shared_ptr<ClientSession> session;
+    };
+    struct Dial {
+        std::string host;
+        std::string port;
+        uint32_t peer_id = 0; // learned from the first PEER_HELLO, 0 until then
+        bool self = false;    // the address is this broker
+        std::weak_ptr<ClientSession> session;
+        bool connecting = false;
+    };
+
+    void redial();
+    void dial(size_t index);
+    // mtx_ held
+    void send_locked(const FramePtr& frame);
+    void add_topic_locked(int topic_id);
+    void remove_topic_locked(int topic_id);
+    void add_pattern_locked(const TopicPattern& pattern);
+    void remove_pattern_locked(const TopicPattern& pattern);
+    bool linked_locked(uint32_t peer_id) const;
+
+    boost::asio::io_context& io_;
+    const std::vector<std::unique_ptr<Shard>>& shards_;
+    uint32_t id_;
+    boost::asio::steady_timer redial_timer_;
+    size_t next_shard_ = 0;
+
+    std::mutex mtx_;
+    // local subscribers per topic and per distinct pattern
+    std::unordered_map<int, size_t> topics_;
+    std::vector<std::pair<TopicPattern, size_t>> patterns_;
+    std::unordered_map<const ClientSession*, Held> held_;
+    std::vector<Link> links_;
+    std::vector<Dial> dials_;
+};
@@ -0,0 +1,120 @@
+#include "FilterTable.h"
+#include <cstring>
+#include <utility>
+#include "../common/message.h"
+#if defined(__AVX__)
+#include <immintrin.h>
+#define FILTER_AVX 1
+#elif defined(__SSE2__) || defined(_M_X64)
+#include <emmintrin.h>
+#define FILTER_SSE2 1
+#endif
+
+namespace {
+
+constexpr size_t TRADE_SIZE = codec::wire_size<TradeMessage>;
+
+thread_local std::vector<uint8_t> scratch;
+
+// LANES filters starting at e against one trade; bit l set when filter e + l passes
+unsigned test_lanes(const double* price_lo, const double* price_hi, const double* qty_lo, const double* qty_hi,
+                    double price, double qty) {
+#if defined(FILTER_AVX)
+    __m256d p = _mm256_set1_pd(price);
+    __m256d q = _mm256_set1_pd(qty);
+    __m256d in = _mm256_and_pd(
+        _mm256_and_pd(_mm256_cmp_pd(p, _mm256_loadu_pd(price_lo), _CMP_GE_OQ),
+                      _mm256_cmp_pd(p, _mm256_loadu_pd(price_hi), _CMP_LE_OQ)),
+        _mm256_and_pd(_mm256_cmp_pd(q, _mm256_loadu_pd(qty_lo), _CMP_GE_OQ),
+                      _mm256_cmp_pd(q, _mm256_loadu_pd(qty_hi), _CMP_LE_OQ)));
+    return static_cast<unsigned>(_mm256_movemask_pd(in));
+#elif defined(FILTER_SSE2)
+    __m128d p = _mm_set1_pd(price);
+    __m128d q = _mm_set1_pd(qty);
+    unsigned bits = 0;
+    for (size_t half = 0; half < FilterTable::LANES; half += 2) {
+        __m128d in = _mm_and_pd(
+            _mm_and_pd(_mm_cmpge_pd(p, _mm_loadu_pd(price_lo + half)), _mm_cmple_pd(p, _mm_loadu_pd(price_hi + half))),
+            _mm_and_pd(_mm_cmpge_pd(q, _mm_loadu_pd(qty_lo + half)), _mm_cmple_pd(q, _mm_loadu_pd(qty_hi + half))));
+        bits |= static_cast<unsigned>(_mm_movemask_pd(in)) << half;
+    }
+    return bits;
+#else
+    unsigned bits = 0;
+    for (size_t l = 0; l < FilterTable::LANES; ++l) {
+        bool in = price >= price_lo[l] && price <= price_hi[l] && qty >= qty_lo[l] && qty <= qty_hi[l];
+        bits |= static_cast<unsigned>(in) << l;
+    }
+    return bits;
+#endif
+}
+
+}
+
+FilterTable::FilterTable(std::vector<Entry> entries)
+    : entries_(std::move(entries)), width_((entries_.size() + LANES - 1) / LANES * LANES) {
+    // padding lanes have empty bands
+    price_lo_.assign(width_, TradeFilter::OPEN);
+    price_hi_.assign(width_, -TradeFilter::OPEN);
+    qty_lo_.assign(width_, TradeFilter::OPEN);
+    qty_hi_.assign(width_, -TradeFilter::OPEN);
+    for (size_t e = 0; e < entries_.size(); ++e) {
+        const TradeFilter& f = entries_[e].filter;
+        price_lo_[e] = f.price_lo;
+        price_hi_[e] = f.price_hi;
+        qty_lo_[e] = f.qty_lo;
+        qty_hi_[e] = f.qty_hi;
+    }
+}
+
+// Each trade is decoded once and tested against all entries, LANES at a time.
+const uint8_t* FilterTable::evaluate(const Frame& frame, size_t& n) const {
+    const uint8_t* p = frame.data();
+    const uint8_t* trades = p + frame.size() - TRADE_SIZE;
+    n = 1;
+    if (p[0] == static_cast<uint8_t>(MsgType::BATCH)) {
+        n = batch_count(p);
+        trades = p + BATCH_HEADER_SIZE;
+    }
+
+    scratch.resize(n * width_);
+    uint8_t* pass = scratch.data();
+    for (size_t t = 0; t < n; ++t, trades += TRADE_SIZE, pass += width_) {
+        double price = codec::load_be<double>(trades + TradeFilter::PRICE_OFFSET);
+        double qty = codec::load_be<double>(trades + TradeFilter::QTY_OFFSET);
+        for (size_t e = 0; e < width_; e += LANES) {
+            unsigned bits = test_lanes(&price_lo_[e], &price_hi_[e], &qty_lo_[e], &qty_hi_[e], price, qty);
+            for (size_t l = 0; l < LANES; ++l) pass[e + l] = static_cast<uint8_t>((bits >> l) & 1);
+        }
+    }
+    return scratch.data();
+}
+
+// Only a BATCH can pass in part; its passing trades keep their order.
+FramePtr FilterTable::subset(const Frame& frame, const uint8_t* pass, size_t passed) const {
+    const uint8_t* trades = frame.data() + BATCH_HEADER_SIZE;
+    size_t n = batch_count(frame.data());
+
+    MutableFramePtr out;
+    uint8_t* dst = nullptr;
+    if (passed == 1) {
+        out = Frame::allocate(1 + TRADE_SIZE);
+        out->data()[0] = static_cast<uint8_t>(MsgType::DATA);
+        dst = out->data() + 1;
+    } else {
+        out = Frame::allocate(BATCH_HEADER_SIZE + passed * TRADE_SIZE);
+        uint8_t* p = out->data();
+        p[0] = static_cast<uint8_t>(MsgType::BATCH);
+        p[1] = static_cast<uint8_t>(passed >> 8);
+        p[2] = static_cast<uint8_t>(passed & 0xFF);
+        dst = p + BATCH_HEADER_SIZE;
+    }
+    for (size_t t = 0; t < n; ++t) {
+        if (!pass[t * width_]) continue;
+        std::memcpy(dst, trades + t * TRADE_SIZE, TRADE_SIZE);
+        dst += TRADE_SIZE;
+    }
+    out->set_topic(frame.topic());
+    out->set_seq(frame.seq());
+    return out;
+}
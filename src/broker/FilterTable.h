@@ -0,0 +1,57 @@
+#pragma once
+#include <cstddef>
+#include <memory>
+#include <vector>
+#include "Frame.h"
+#include "../common/trade_filter.h"
+
+class ClientSession;
+
+// The filtered subscribers of one topic in evaluation form. Subscribers with
+// the same filter share an entry. The bounds of all entries are stored column
+// by column and padded to a multiple of LANES with filters nothing passes,
+// so each trade is tested against LANES filters per vector compare and a
+// frame costs one pass over its trades however many subscribers filter it.
+// Immutable once built; SubscriptionManager publishes a new table whenever
+// the topic's filtered subscriptions change.
+class FilterTable {
+public:
+    static constexpr size_t LANES = 4;
+
+    struct Entry {
+        TradeFilter filter;
+        std::vector<std::shared_ptr<ClientSession>> sessions;
+    };
+
+    explicit FilterTable(std::vector<Entry> entries);
+
+    const std::vector<Entry>& entries() const { return entries_; }
+
+    // Tests every trade of a DATA, DATA_TS or BATCH frame against every entry
+    // and calls fn(entry, frame) for each entry that passed at least one
+    // trade: with the frame itself when all of them passed, otherwise with a
+    // new frame of just the passing trades (a DATA frame for a single one).
+    // The pass results live in thread-local scratch, so fn must not route
+    // another frame itself.
+    template <typename Fn>
+    void route(const FramePtr& frame, Fn&& fn) const {
+        size_t n = 0;
+        const uint8_t* pass = evaluate(*frame, n);
+        for (size_t e = 0; e < entries_.size(); ++e) {
+            size_t passed = 0;
+            for (size_t t = 0; t < n; ++t) passed += pass[t * width_ + e];
+            if (passed == 0) continue;
+            fn(entries_[e], passed == n ? frame : subset(*frame, pass + e, passed));
+        }
+    }
+
+private:
+    // pass[trade * width_ + entry] is 1 when the trade passes the entry
+    const uint8_t* evaluate(const Frame& frame, size_t& n) const;
+    // `pass` is the entry's column of evaluate()'s result
+    FramePtr subset(const Frame& frame, const uint8_t* pass, size_t passed) const;
+
+    std::vector<Entry> entries_;
+    size_t width_; // entries rounded up to LANES
+    std::vector<double> price_lo_, price_hi_, qty_lo_, qty_hi_;
+};
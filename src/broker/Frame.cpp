@@ -0,0 +1,147 @@
+#include "Frame.h"
+#include <algorithm>
+#include <array>
+#include <mutex>
+#include <new>
+#include <vector>
+
+namespace {
+
+// the largest class fits a full BATCH (MAX_BATCH_RECORDS trades)
+constexpr std::array<uint32_t, 4> CLASS_CAPACITY = {64, 512, 4096, 32 * 1024};
+constexpr uint8_t UNPOOLED = 0xFF;
+// a pool keeps at most this many free blocks, and this many bytes, per size
+// class before falling back to the heap
+constexpr size_t CACHE_LIMIT = 4096;
+constexpr size_t CACHE_BYTES = 4 * 1024 * 1024;
+
+constexpr size_t cache_limit(uint8_t cls) {
+    return std::min(CACHE_LIMIT, CACHE_BYTES / (sizeof(Frame) + CLASS_CAPACITY[cls]));
+}
+
+}
+
+// Free blocks of one thread. Frames are usually allocated on the publisher's
+// thread and released on whichever thread completed the last write, so a
+// block released elsewhere is pushed onto its owner's return stack (lock-free,
+// many producers) and the owner takes the whole stack over in one exchange
+// once a free list runs dry. The owner's free lists need no synchronisation.
+//
+// Pools are never freed: when its thread exits a pool waits, with whatever
+// blocks are still out, for the next thread to adopt it.
+struct FramePool {
+    struct Returned {
+        Returned* next;
+    };
+
+    std::array<std::vector<void*>, CLASS_CAPACITY.size()> free;
+    std::array<std::atomic<Returned*>, CLASS_CAPACITY.size()> returned{};
+
+    // owning thread
+    void* take(uint8_t cls) {
+        auto& list = free[cls];
+        if (list.empty()) reclaim(cls);
+        if (list.empty()) return nullptr;
+        void* mem = list.back();
+        list.pop_back();
+        return mem;
+    }
+
+    // owning thread
+    void put(uint8_t cls, void* mem) {
+        if (free[cls].size() < cache_limit(cls)) {
+            free[cls].push_back(mem);
+        } else {
+            ::operator delete(mem);
+        }
+    }
+
+    // any other thread
+    void give_back(uint8_t cls, void* mem) {
+        auto* r = static_cast<Returned*>(mem);
+        Returned* head = returned[cls].load(std::memory_order_relaxed);
+        do {
+            r->next = head;
+        } while (!returned[cls].compare_exchange_weak(head, r, std::memory_order_release,
+                                                      std::memory_order_relaxed));
+    }
+
+    // owning thread: moves the blocks other threads returned to the free list
+    void reclaim(uint8_t cls) {
+        Returned* r = returned[cls].exchange(nullptr, std::memory_order_acquire);
+        while (r) {
+            Returned* next = r->next;
+            put(cls, r);
+            r = next;
+        }
+    }
+
+    static FramePool* adopt() {
+        std::lock_guard<std::mutex> lock(idle_mtx());
+        auto& idle = idle_pools();
+        if (idle.empty()) return new FramePool();
+        FramePool* pool = idle.back();
+        idle.pop_back();
+        return pool;
+    }
+
+    static void retire(FramePool* pool) {
+        std::lock_guard<std::mutex> lock(idle_mtx());
+        idle_pools().push_back(pool);
+    }
+
+private:
+    static std::mutex& idle_mtx() {
+        static std::mutex m;
+        return m;
+    }
+    static std::vector<FramePool*>& idle_pools() {
+        static std::vector<FramePool*> pools;
+        return pools;
+    }
+};
+
+namespace {
+
+// the calling thread's pool, handed on to a later thread when this one exits
+struct ThreadPool {
+    FramePool* pool = FramePool::adopt();
+    ~ThreadPool() { FramePool::retire(pool); }
+};
+
+thread_local ThreadPool local;
+
+}
+
+MutableFramePtr Frame::allocate(size_t size) {
+    uint8_t cls = UNPOOLED;
+    uint32_t capacity = static_cast<uint32_t>(size);
+    for (uint8_t i = 0; i < CLASS_CAPACITY.size(); ++i) {
+        if (size <= CLASS_CAPACITY[i]) {
+            cls = i;
+            capacity = CLASS_CAPACITY[i];
+            break;
+        }
+    }
+
+    FramePool* pool = cls != UNPOOLED ? local.pool : nullptr;
+    void* mem = pool ? pool->take(cls) : nullptr;
+    if (!mem) mem = ::operator new(sizeof(Frame) + capacity);
+
+    MutableFramePtr frame(new (mem) Frame(capacity, cls, pool));
+    frame->size_ = static_cast<uint32_t>(size);
+    return frame;
+}
+
+void Frame::release(Frame* f) {
+    uint8_t cls = f->size_class_;
+    FramePool* pool = f->pool_;
+    f->~Frame();
+    if (!pool) {
+        ::operator delete(f);
+    } else if (pool == local.pool) {
+        pool->put(cls, f);
+    } else {
+        pool->give_back(cls, f);
+    }
+}
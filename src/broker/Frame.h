@@ -0,0 +1,65 @@
+#pragma once
+#include <boost/intrusive_ptr.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+class Frame;
+struct FramePool;
+using FramePtr = boost::intrusive_ptr<const Frame>;
+using MutableFramePtr = boost::intrusive_ptr<Frame>;
+
+// Encoded wire frame shared by reference between the publishing session and
+// every subscriber write queue. It is filled once right after allocate() and
+// treated as immutable from the moment it is handed out as a FramePtr.
+// Storage comes from the allocating thread's pool of fixed size classes and
+// goes back to that pool when the last reference is dropped, on whichever
+// thread that happens.
+class alignas(16) Frame {
+public:
+    static MutableFramePtr allocate(size_t size);
+    void set_size(size_t size) { size_ = static_cast<uint32_t>(size); }
+
+    const uint8_t* data() const { return reinterpret_cast<const uint8_t*>(this + 1); }
+    uint8_t* data() { return reinterpret_cast<uint8_t*>(this + 1); }
+    size_t size() const { return size_; }
+    size_t capacity() const { return capacity_; }
+
+    // routing metadata, not part of the wire bytes
+    int topic() const { return topic_id_; }
+    void set_topic(int topic_id) { topic_id_ = topic_id; }
+    // journal sequence number, 0 when the frame is not journalled
+    uint64_t seq() const { return seq_; }
+    void set_seq(uint64_t seq) { seq_ = seq; }
+    // arrived over a link from a peer broker, so it is not forwarded to peers
+    bool from_link() const { return from_link_; }
+    void set_from_link() { from_link_ = true; }
+
+    Frame(const Frame&) = delete;
+    Frame& operator=(const Frame&) = delete;
+
+private:
+    Frame(uint32_t capacity, uint8_t size_class, FramePool* pool)
+        : capacity_(capacity), size_class_(size_class), pool_(pool) {}
+    ~Frame() = default;
+
+    friend void intrusive_ptr_add_ref(const Frame* f) {
+        f->refs_.fetch_add(1, std::memory_order_relaxed);
+    }
+    friend void intrusive_ptr_release(const Frame* f) {
+        if (f->refs_.fetch_sub(1, std::memory_order_acq_rel) == 1) {
+            release(const_cast<Frame*>(f));
+        }
+    }
+    static void release(Frame* f);
+
+    mutable std::atomic<uint32_t> refs_{0};
+    uint32_t size_ = 0;
+    uint32_t capacity_;
+    int32_t topic_id_ = 0;
+    uint64_t seq_ = 0;
+    uint8_t size_class_;
+    bool from_link_ = false;
+    FramePool* pool_;   // nullptr when not pooled
+    // payload bytes follow the header in the same block
+};
@@ -0,0 +1,90 @@
+#pragma once
+#include <boost/asio/associated_allocator.hpp>
+#include <atomic>
+#include <cstddef>
+#include <new>
+#include <type_traits>
+#include <utility>
+
+// Memory for one outstanding asynchronous operation at a time. Asio allocates
+// an operation's state (the handler and everything it captured) through the
+// handler's associated allocator; binding a handler to a HandlerMemory makes
+// that allocation reuse this block instead of going to the heap. An owner
+// keeps one per chain of operations that are never outstanding together
+// (a session's reads, its writes). A request that does not fit, or arrives
+// while the block is taken, falls back to operator new.
+class HandlerMemory {
+public:
+    static constexpr size_t SIZE = 512;
+
+    HandlerMemory() = default;
+    HandlerMemory(const HandlerMemory&) = delete;
+    HandlerMemory& operator=(const HandlerMemory&) = delete;
+
+    void* allocate(size_t size) {
+        // freed on whichever thread completes the operation
+        if (size <= SIZE && !in_use_.exchange(true, std::memory_order_acquire)) return &storage_;
+        return ::operator new(size);
+    }
+
+    void deallocate(void* p) {
+        if (p == &storage_) {
+            in_use_.store(false, std::memory_order_release);
+            return;
+        }
+        ::operator delete(p);
+    }
+
+private:
+    std::aligned_storage_t<SIZE, alignof(std::max_align_t)> storage_;
+    std::atomic<bool> in_use_{false};
+};
+
+template <typename T>
+class HandlerAllocator {
+public:
+    using value_type = T;
+
+    explicit HandlerAllocator(HandlerMemory& memory) : memory_(&memory) {}
+    template <typename U>
+    HandlerAllocator(const HandlerAllocator<U>& other) noexcept : memory_(other.memory_) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(memory_->allocate(sizeof(T) * n)); }
+    void deallocate(T* p, size_t /*n*/) { memory_->deallocate(p); }
+
+    template <typename U>
+    bool operator==(const HandlerAllocator<U>& other) const noexcept { return memory_ == other.memory_; }
+    template <typename U>
+    bool operator!=(const HandlerAllocator<U>& other) const noexcept { return memory_ != other.memory_; }
+
+private:
+    template <typename> friend class HandlerAllocator;
+    HandlerMemory* memory_;
+};
+
+// A completion handler allocating from a HandlerMemory; see bind_memory().
+// It has no associated executor of its own, so it runs on the I/O object's.
+template <typename Handler>
+class MemoryBoundHandler {
+public:
+    using allocator_type = HandlerAllocator<void>;
+
+    MemoryBoundHandler(HandlerMemory& memory, Handler handler)
+        : memory_(&memory), handler_(std::move(handler)) {}
+
+    allocator_type get_allocator() const noexcept { return allocator_type(*memory_); }
+
+    template <typename... Args>
+    void operator()(Args&&... args) {
+        handler_(std::forward<Args>(args)...);
+    }
+
+private:
+    HandlerMemory* memory_;
+    Handler handler_;
+};
+
+template <typename Handler>
+MemoryBoundHandler<std::decay_t<Handler>> bind_memory(HandlerMemory& memory, Handler&& handler) {
+    return MemoryBoundHandler<std::decay_t<Handler>>(memory, std::forward<Handler>(handler));
+}
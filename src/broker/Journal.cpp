@@ -0,0 +1,380 @@
+#include "Journal.h"
+#include <algorithm>
+#include <cerrno>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <stdexcept>
+#include <unordered_map>
+#include "../common/serializer.h"
+#include "../common/logger.h"
+
+#if defined(__unix__)
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// record layout: type, uint64 seq, DATA frame (type, topic, timestamp_ms, ...)
+constexpr size_t SEQ_OFFSET = 1;
+constexpr size_t TOPIC_OFFSET = 1 + 8 + 1;
+constexpr size_t TS_OFFSET = TOPIC_OFFSET + 4;
+// records taken from one ring before the batch is committed
+constexpr size_t DRAIN_BUDGET = 4096;
+
+// trades in a DATA or BATCH frame
+size_t record_count(const Frame& frame) {
+    if (frame.data()[0] == static_cast<uint8_t>(MsgType::BATCH)) return batch_count(frame.data());
+    return 1;
+}
+
+std::string segment_name(uint64_t index) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "journal-%010llu.log", static_cast<unsigned long long>(index));
+    return name;
+}
+
+bool parse_segment_name(const std::string& name, uint64_t& index) {
+    unsigned long long v = 0;
+    char tail[8] = {};
+    if (std::sscanf(name.c_str(), "journal-%llu.%7s", &v, tail) != 2 || std::strcmp(tail, "log") != 0) return false;
+    index = v;
+    return true;
+}
+
+}
+
+struct Journal::Segment {
+    uint64_t index = 0;
+    std::string path;
+    uint8_t* base = nullptr;
+    size_t capacity = 0;
+    // readable bytes; grows once per group commit
+    std::atomic<size_t> committed{0};
+    // lets a replay skip whole segments
+    std::atomic<uint64_t> max_seq{0};
+    std::atomic<uint64_t> max_ts{0};
+    // record slots (offset / RECORD_SIZE) of each topic, in sequence order;
+    // only committed records are listed
+    std::mutex index_mtx;
+    std::unordered_map<int32_t, std::vector<uint32_t>> topics;
+
+    ~Segment() {
+#if defined(__unix__)
+        if (base) ::munmap(base, capacity);
+#endif
+    }
+};
+
+Journal::Journal(const BrokerConfig& config)
+    : dir_(config.journal_dir),
+      segment_bytes_(std::max(config.journal_segment_bytes, RECORD_SIZE * 1024)),
+      max_segments_(config.journal_max_segments),
+      sync_(config.journal_sync) {
+#if !defined(__unix__)
+    throw std::runtime_error("the journal needs POSIX mmap");
+#endif
+    // whole records only, so a record never straddles two segments
+    segment_bytes_ -= segment_bytes_ % RECORD_SIZE;
+    fs::create_directories(dir_);
+    recover();
+    thread_ = std::thread([this] { run(); });
+}
+
+Journal::~Journal() {
+    stop_.store(true, std::memory_order_release);
+    if (thread_.joinable()) thread_.join();
+}
+
+void Journal::append(const FramePtr& frame) {
+    FramePtr copy = frame;
+    if (local_ring().queue.try_push(std::move(copy))) return;
+    // never wait for the journal thread on the routing path
+    std::lock_guard<std::mutex> lock(overflow_mtx_);
+    overflow_.push_back(frame);
+}
+
+// Threads come and go (a shared-memory poller starts with its first link),
+// so a ring is marked orphaned when its thread exits and the journal thread
+// drops it once drained, like the logger's rings.
+Journal::ThreadRing& Journal::local_ring() {
+    struct Local {
+        Journal* owner = nullptr;
+        std::shared_ptr<ThreadRing> ring;
+        ~Local() {
+            if (ring) ring->orphaned.store(true, std::memory_order_release);
+        }
+    };
+    thread_local Local local;
+    if (local.owner != this) {
+        if (local.ring) local.ring->orphaned.store(true, std::memory_order_release);
+        local.ring = std::make_shared<ThreadRing>();
+        local.owner = this;
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        rings_.push_back(local.ring);
+        rings_version_.fetch_add(1, std::memory_order_release);
+    }
+    return *local.ring;
+}
+
+// Maps the segments left by a previous run and continues after the last
+// record found in them.
+void Journal::recover() {
+    std::vector<uint64_t> indexes;
+    for (auto& entry : fs::directory_iterator(dir_)) {
+        uint64_t index = 0;
+        if (entry.is_regular_file() && parse_segment_name(entry.path().filename().string(), index)) {
+            indexes.push_back(index);
+        }
+    }
+    std::sort(indexes.begin(), indexes.end());
+
+    uint64_t max_seq = 0;
+    for (uint64_t index : indexes) {
+        auto seg = open_segment(index, false);
+        size_t off = 0;
+        uint64_t seg_max_seq = 0, seg_max_ts = 0;
+        while (off + RECORD_SIZE <= seg->capacity && seg->base[off] == static_cast<uint8_t>(MsgType::JOURNAL_DATA)) {
+            seg_max_seq = std::max(seg_max_seq, serializer::read_uint64_be(seg->base + off + SEQ_OFFSET));
+            seg_max_ts = std::max(seg_max_ts, serializer::read_uint64_be(seg->base + off + TS_OFFSET));
+            seg->topics[serializer::read_int32_be(seg->base + off + TOPIC_OFFSET)].push_back(
+                static_cast<uint32_t>(off / RECORD_SIZE));
+            off += RECORD_SIZE;
+        }
+        seg->committed.store(off, std::memory_order_relaxed);
+        seg->max_seq.store(seg_max_seq, std::memory_order_relaxed);
+        seg->max_ts.store(seg_max_ts, std::memory_order_relaxed);
+        max_seq = std::max(max_seq, seg_max_seq);
+        segments_.push_back(std::move(seg));
+        next_index_ = index + 1;
+    }
+
+    next_seq_.store(max_seq + 1, std::memory_order_relaxed);
+    written_below_.store(max_seq + 1, std::memory_order_relaxed);
+    written_local_ = max_seq + 1;
+
+    if (segments_.empty() || segments_.back()->capacity != segment_bytes_) {
+        roll();
+    } else {
+        write_offset_ = segments_.back()->committed.load(std::memory_order_relaxed);
+    }
+    if (!indexes.empty()) {
+        LOG_INFO("Journal: recovered {} segments, next sequence number {}", indexes.size(), max_seq + 1);
+    }
+}
+
+std::shared_ptr<Journal::Segment> Journal::open_segment(uint64_t index, bool create) {
+    auto seg = std::make_shared<Segment>();
+    seg->index = index;
+    seg->path = (fs::path(dir_) / segment_name(index)).string();
+#if defined(__unix__)
+    int fd = ::open(seg->path.c_str(), create ? (O_RDWR | O_CREAT | O_EXCL) : O_RDWR, 0644);
+    if (fd < 0) throw std::runtime_error("journal: cannot open " + seg->path + ": " + std::strerror(errno));
+    struct stat st {};
+    if (create ? ::ftruncate(fd, static_cast<off_t>(segment_bytes_)) != 0 : ::fstat(fd, &st) != 0) {
+        ::close(fd);
+        throw std::runtime_error("journal: cannot size " + seg->path + ": " + std::strerror(errno));
+    }
+    seg->capacity = create ? segment_bytes_ : static_cast<size_t>(st.st_size);
+    void* p = ::mmap(nullptr, seg->capacity, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ::close(fd);
+    if (p == MAP_FAILED) throw std::runtime_error("journal: cannot map " + seg->path + ": " + std::strerror(errno));
+    seg->base = static_cast<uint8_t*>(p);
+#endif
+    return seg;
+}
+
+// journal thread (or the constructor): seals the active segment and starts the next
+void Journal::roll() {
+    if (!segments_.empty()) commit();
+    auto seg = open_segment(next_index_++, true);
+
+    std::lock_guard<std::mutex> lock(segments_mtx_);
+    segments_.push_back(std::move(seg));
+    write_offset_ = 0;
+    // readers holding a cursor keep their mapping; the file goes now
+    while (max_segments_ > 0 && segments_.size() > max_segments_) {
+        fs::remove(segments_.front()->path);
+        segments_.erase(segments_.begin());
+    }
+}
+
+void Journal::run() {
+    while (!stop_.load(std::memory_order_acquire)) {
+        if (drain() == 0) std::this_thread::sleep_for(std::chrono::microseconds(100));
+    }
+    while (drain() > 0) {
+    }
+}
+
+size_t Journal::drain() {
+    if (snapshot_version_ != rings_version_.load(std::memory_order_acquire)) {
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        rings_snapshot_ = rings_;
+        snapshot_version_ = rings_version_.load(std::memory_order_relaxed);
+    }
+
+    size_t n = 0;
+    FramePtr frame;
+    bool dead = false;
+    for (auto& ring : rings_snapshot_) {
+        // orphaned first: once set, nothing more is pushed
+        bool orphaned = ring->orphaned.load(std::memory_order_acquire);
+        for (size_t i = 0; i < DRAIN_BUDGET && ring->queue.try_pop(frame); ++i, ++n) {
+            sequence(std::move(frame));
+        }
+        if (orphaned && ring->queue.empty()) dead = true;
+    }
+    if (dead) {
+        std::lock_guard<std::mutex> lock(rings_mtx_);
+        std::erase_if(rings_, [](const std::shared_ptr<ThreadRing>& r) {
+            return r->orphaned.load(std::memory_order_acquire) && r->queue.empty();
+        });
+        rings_version_.fetch_add(1, std::memory_order_release);
+    }
+
+    std::vector<FramePtr> overflow;
+    {
+        std::lock_guard<std::mutex> lock(overflow_mtx_);
+        overflow.swap(overflow_);
+    }
+    for (auto& f : overflow) sequence(std::move(f));
+    n += overflow.size();
+
+    if (n > 0) commit();
+    return n;
+}
+
+// journal thread: frames of different threads arrive out of order; the
+// segments hold them in sequence order
+void Journal::sequence(FramePtr frame) {
+    if (frame->seq() != written_local_) {
+        if (frame->seq() > written_local_) early_.push(std::move(frame));
+        return;
+    }
+    write_records(*frame);
+    written_local_ += record_count(*frame);
+    while (!early_.empty() && early_.top()->seq() == written_local_) {
+        write_records(*early_.top());
+        written_local_ += record_count(*early_.top());
+        early_.pop();
+    }
+}
+
+// journal thread
+void Journal::write_records(const Frame& frame) {
+    size_t count = record_count(frame);
+    // the trades are the last count * sizeof(TradeMessage) bytes of either frame type
+    const uint8_t* payload = frame.data() + frame.size() - count * sizeof(TradeMessage);
+    for (size_t i = 0; i < count; ++i, payload += sizeof(TradeMessage)) {
+        if (write_offset_ + RECORD_SIZE > segments_.back()->capacity) roll();
+
+        Segment& seg = *segments_.back();
+        uint64_t seq = frame.seq() + i;
+        uint8_t* rec = seg.base + write_offset_;
+        rec[0] = static_cast<uint8_t>(MsgType::JOURNAL_DATA);
+        serializer::write_uint64_be(rec + SEQ_OFFSET, seq);
+        rec[1 + 8] = static_cast<uint8_t>(MsgType::DATA);
+        std::memcpy(rec + TOPIC_OFFSET, payload, sizeof(TradeMessage));
+        pending_index_.emplace_back(serializer::read_int32_be(rec + TOPIC_OFFSET),
+                                    static_cast<uint32_t>(write_offset_ / RECORD_SIZE));
+        write_offset_ += RECORD_SIZE;
+
+        if (seq > seg.max_seq.load(std::memory_order_relaxed)) seg.max_seq.store(seq, std::memory_order_relaxed);
+        uint64_t ts = serializer::read_uint64_be(rec + TS_OFFSET);
+        if (ts > seg.max_ts.load(std::memory_order_relaxed)) seg.max_ts.store(ts, std::memory_order_relaxed);
+    }
+}
+
+// journal thread: makes everything written so far visible to replays
+void Journal::commit() {
+    Segment& seg = *segments_.back();
+    size_t committed = seg.committed.load(std::memory_order_relaxed);
+#if defined(__unix__)
+    if (sync_ && write_offset_ > committed) {
+        static const size_t page = static_cast<size_t>(::sysconf(_SC_PAGESIZE));
+        size_t from = committed & ~(page - 1);
+        ::msync(seg.base + from, write_offset_ - from, MS_SYNC);
+    }
+#endif
+    if (!pending_index_.empty()) {
+        std::lock_guard<std::mutex> lock(seg.index_mtx);
+        for (auto& [topic, slot] : pending_index_) seg.topics[topic].push_back(slot);
+        pending_index_.clear();
+    }
+    seg.committed.store(write_offset_, std::memory_order_release);
+    written_below_.store(written_local_, std::memory_order_release);
+}
+
+Journal::Cursor Journal::open_cursor(int topic_id, ReplayFrom mode, uint64_t from, uint64_t end_seq) const {
+    Cursor c;
+    c.topic_id = topic_id;
+    c.mode = mode;
+    c.from = from;
+    c.end_seq = end_seq;
+    {
+        std::lock_guard<std::mutex> lock(segments_mtx_);
+        c.segments = segments_;
+    }
+    // segments that end before the starting point hold nothing to replay
+    auto before_start = [&](const std::shared_ptr<Segment>& s) {
+        uint64_t max = mode == ReplayFrom::SEQ ? s->max_seq.load(std::memory_order_acquire)
+                                               : s->max_ts.load(std::memory_order_acquire);
+        return max < from;
+    };
+    while (c.segment < c.segments.size() && before_start(c.segments[c.segment])) ++c.segment;
+    return c;
+}
+
+// Every record below end_seq was committed before the cursor was opened, so
+// a segment is done once its index of the topic is.
+bool Journal::read(Cursor& c, std::vector<boost::asio::const_buffer>& out, size_t max) const {
+    size_t n = 0;
+    size_t scanned = 0;
+    while (n < max && scanned < READ_SCAN_BUDGET) {
+        if (c.segment >= c.segments.size()) return false;
+        Segment& seg = *c.segments[c.segment];
+        std::lock_guard<std::mutex> lock(seg.index_mtx);
+        auto it = seg.topics.find(c.topic_id);
+        if (it != seg.topics.end()) {
+            const std::vector<uint32_t>& slots = it->second;
+            auto record = [&](size_t i) { return seg.base + static_cast<size_t>(slots[i]) * RECORD_SIZE; };
+            if (!c.positioned && c.mode == ReplayFrom::SEQ) {
+                size_t lo = 0, hi = slots.size();
+                while (lo < hi) {
+                    size_t mid = lo + (hi - lo) / 2;
+                    if (serializer::read_uint64_be(record(mid) + SEQ_OFFSET) < c.from) lo = mid + 1;
+                    else hi = mid;
+                }
+                c.position = lo;
+            }
+            c.positioned = true;
+
+            for (; c.position < slots.size() && n < max && scanned < READ_SCAN_BUDGET; ++c.position, ++scanned) {
+                const uint8_t* rec = record(c.position);
+                // sequence numbers only grow along the log
+                if (serializer::read_uint64_be(rec + SEQ_OFFSET) >= c.end_seq) return false;
+                if (c.mode == ReplayFrom::TIMESTAMP && serializer::read_uint64_be(rec + TS_OFFSET) < c.from) continue;
+
+                // neighbouring records go out as one buffer
+                if (!out.empty() && static_cast<const uint8_t*>(out.back().data()) + out.back().size() == rec) {
+                    out.back() = boost::asio::const_buffer(out.back().data(), out.back().size() + RECORD_SIZE);
+                } else {
+                    out.emplace_back(rec, RECORD_SIZE);
+                }
+                ++n;
+            }
+            if (c.position < slots.size()) break;
+        }
+        ++c.segment;
+        c.position = 0;
+        c.positioned = false;
+    }
+    return true;
+}
@@ -0,0 +1,133 @@
+#pragma once
+#include <boost/asio/buffer.hpp>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <mutex>
+#include <queue>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#include "BrokerConfig.h"
+#include "Frame.h"
+#include "../common/message.h"
+#include "../common/spsc_queue.h"
+
+// Append-only log of every published DATA frame, kept in fixed-size segment
+// files under --journal-dir that are mapped into memory.
+//
+// Sequence numbers are handed out at ingress (next_seq) and stamped on the
+// frame before it is routed. Publishing threads only push the frame onto a
+// ring of their own; one journal thread drains all rings, puts the frames
+// back into sequence order, copies the records into the mapped segment and
+// publishes the new end once per batch (group commit, with an optional
+// msync), so routing never waits for the disk.
+//
+// A record has exactly the wire layout of a JOURNAL_DATA frame, so replay
+// hands the mapped bytes to the socket as they are. Sequence numbers are
+// broker-wide and a topic may be published from any shard, so there is one
+// log; each segment indexes its records by topic, and a replay walks only
+// the records of its own topic.
+class Journal {
+public:
+    static constexpr size_t RECORD_SIZE = 1 + 8 + 1 + sizeof(TradeMessage);
+    static constexpr size_t READ_SCAN_BUDGET = 4096;
+
+    enum class ReplayFrom : uint8_t { SEQ = 0, TIMESTAMP = 1 };
+
+    // throws std::runtime_error if the directory or a segment cannot be used
+    explicit Journal(const BrokerConfig& config);
+    ~Journal();
+    Journal(const Journal&) = delete;
+    Journal& operator=(const Journal&) = delete;
+
+    // reserves n consecutive sequence numbers (one per record of a BATCH frame)
+    uint64_t next_seq(uint64_t n = 1) { return next_seq_.fetch_add(n); }
+    // the sequence number the next frame will get
+    uint64_t peek_next_seq() const { return next_seq_.load(); }
+    // every sequence number below this one is in the journal
+    uint64_t written_below() const { return written_below_.load(std::memory_order_acquire); }
+
+    // any thread; the frame must carry a sequence number from next_seq(). A
+    // BATCH frame is journalled as one record per trade.
+    void append(const FramePtr& frame);
+
+    struct Segment;
+
+    // Replay position over a snapshot of the segments. Records of one topic
+    // with sequence numbers below end_seq are returned, starting at `from`.
+    struct Cursor {
+        int topic_id = 0;
+        ReplayFrom mode = ReplayFrom::SEQ;
+        uint64_t from = 0;
+        uint64_t end_seq = 0;
+        std::vector<std::shared_ptr<Segment>> segments;
+        size_t segment = 0;
+        size_t position = 0; // into the current segment's index of the topic
+        bool positioned = false;
+    };
+
+    // call once written_below() >= end_seq
+    Cursor open_cursor(int topic_id, ReplayFrom mode, uint64_t from, uint64_t end_seq) const;
+
+    // Appends buffers over up to max matching records to out (they point into
+    // the mapping and stay valid while the cursor lives). Looks at no more
+    // than READ_SCAN_BUDGET records of the topic per call, so out may stay
+    // empty while more is to come. Returns false once the cursor is exhausted.
+    bool read(Cursor& cursor, std::vector<boost::asio::const_buffer>& out, size_t max) const;
+
+private:
+    struct ThreadRing {
+        SpscQueue<FramePtr> queue{64 * 1024};
+        std::atomic<bool> orphaned{false}; // owning thread has exited
+    };
+
+    void recover();
+    std::shared_ptr<Segment> open_segment(uint64_t index, bool create);
+    void roll();
+    void run();
+    size_t drain();
+    void sequence(FramePtr frame);
+    void write_records(const Frame& frame);
+    void commit();
+    ThreadRing& local_ring();
+
+    std::string dir_;
+    size_t segment_bytes_;
+    size_t max_segments_;
+    bool sync_;
+
+    std::atomic<uint64_t> next_seq_{1};
+    std::atomic<uint64_t> written_below_{1};
+    // frames that arrived ahead of a gap (journal thread only)
+    struct LaterSeq {
+        bool operator()(const FramePtr& a, const FramePtr& b) const { return a->seq() > b->seq(); }
+    };
+    std::priority_queue<FramePtr, std::vector<FramePtr>, LaterSeq> early_;
+
+    // segments_ changes only on the journal thread, under segments_mtx_
+    mutable std::mutex segments_mtx_;
+    std::vector<std::shared_ptr<Segment>> segments_;
+    uint64_t next_index_ = 0;
+    // journal thread: end of the records written into segments_.back(), and
+    // the next sequence number to write
+    size_t write_offset_ = 0;
+    uint64_t written_local_ = 1;
+    // (topic, record slot) written since the last commit (journal thread)
+    std::vector<std::pair<int32_t, uint32_t>> pending_index_;
+
+    std::mutex rings_mtx_;
+    std::vector<std::shared_ptr<ThreadRing>> rings_;
+    // bumped whenever rings_ changes
+    std::atomic<uint64_t> rings_version_{0};
+    std::vector<std::shared_ptr<ThreadRing>> rings_snapshot_; // journal thread
+    uint64_t snapshot_version_ = 0;                            // journal thread
+    // frames that found their thread's ring full
+    std::mutex overflow_mtx_;
+    std::vector<FramePtr> overflow_;
+
+    std::atomic<bool> stop_{false};
+    std::thread thread_;
+};
@@ -0,0 +1,91 @@
+#include "LastValueCache.h"
+#include <cstring>
+#include <thread>
+
+LastValueCache::LastValueCache(size_t dense_topics)
+    : dense_(dense_topics) {
+}
+
+uint64_t LastValueCache::store(int topic_id, const uint8_t* record) {
+    if (dense(topic_id)) {
+        std::array<uint64_t, WORDS> words{};
+        auto* bytes = reinterpret_cast<uint8_t*>(words.data());
+        bytes[0] = static_cast<uint8_t>(MsgType::DATA);
+        std::memcpy(bytes + 1, record, sizeof(TradeMessage));
+
+        DenseEntry& e = dense_[static_cast<size_t>(topic_id)];
+        // another shard may be storing the same topic; take the entry by
+        // making its version odd
+        uint64_t v = e.version.load(std::memory_order_relaxed);
+        for (;;) {
+            if (v & 1) {
+                std::this_thread::yield();
+                v = e.version.load(std::memory_order_relaxed);
+                continue;
+            }
+            if (e.version.compare_exchange_weak(v, v + 1, std::memory_order_acquire, std::memory_order_relaxed)) break;
+        }
+        for (size_t i = 0; i < WORDS; ++i) e.words[i].store(words[i], std::memory_order_relaxed);
+        e.version.store(v + 2, std::memory_order_release);
+        return v + 2;
+    }
+    std::lock_guard<std::mutex> lock(sparse_mtx_);
+    Entry& e = sparse_[topic_id];
+    e.wire[0] = static_cast<uint8_t>(MsgType::DATA);
+    std::memcpy(e.wire.data() + 1, record, sizeof(TradeMessage));
+    e.version += 2;
+    return e.version;
+}
+
+bool LastValueCache::read_dense(size_t index, Entry& out) const {
+    const DenseEntry& e = dense_[index];
+    std::array<uint64_t, WORDS> words;
+    uint64_t before;
+    for (;;) {
+        before = e.version.load(std::memory_order_acquire);
+        if (before == 0) return false;
+        if (before & 1) {
+            std::this_thread::yield();
+            continue;
+        }
+        for (size_t i = 0; i < WORDS; ++i) words[i] = e.words[i].load(std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_acquire);
+        if (e.version.load(std::memory_order_relaxed) == before) break;
+    }
+    std::memcpy(out.wire.data(), words.data(), FRAME_SIZE);
+    out.version = before;
+    return true;
+}
+
+LastValueCache::Snapshot LastValueCache::snapshot(int topic_id) const {
+    if (dense(topic_id)) {
+        Entry e;
+        if (!read_dense(static_cast<size_t>(topic_id), e)) return {};
+        return make_snapshot(topic_id, e);
+    }
+    std::lock_guard<std::mutex> lock(sparse_mtx_);
+    auto it = sparse_.find(topic_id);
+    if (it == sparse_.end() || it->second.version == 0) return {};
+    return make_snapshot(topic_id, it->second);
+}
+
+std::vector<LastValueCache::Snapshot> LastValueCache::snapshot_matching(const TopicPattern& pattern) const {
+    std::vector<Snapshot> out;
+    Entry e;
+    for (size_t i = 0; i < dense_.size(); ++i) {
+        int topic_id = static_cast<int>(i);
+        if (pattern.matches(topic_id) && read_dense(i, e)) out.push_back(make_snapshot(topic_id, e));
+    }
+    std::lock_guard<std::mutex> lock(sparse_mtx_);
+    for (auto& [topic_id, entry] : sparse_) {
+        if (entry.version != 0 && pattern.matches(topic_id)) out.push_back(make_snapshot(topic_id, entry));
+    }
+    return out;
+}
+
+LastValueCache::Snapshot LastValueCache::make_snapshot(int topic_id, const Entry& e) {
+    auto frame = Frame::allocate(FRAME_SIZE);
+    std::memcpy(frame->data(), e.wire.data(), FRAME_SIZE);
+    frame->set_topic(topic_id);
+    return {std::move(frame), e.version};
+}
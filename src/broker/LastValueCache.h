@@ -0,0 +1,76 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "Frame.h"
+#include "../common/topic_pattern.h"
+#include "../common/message.h"
+
+// Latest DATA frame of every topic, kept as raw wire bytes so an update is a
+// 29-byte copy and the whole dense range stays compact in memory. Topic ids
+// in [0, dense_topics) index a flat array; anything outside that range falls
+// back to a hash map.
+//
+// One cache serves all shards and is written by the shard a frame entered
+// on. Dense entries are seqlocks, so stores from several shards and snapshots
+// taken anywhere never see a torn value; the sparse map takes a mutex.
+// Every store raises the topic's version, which the caller can carry along
+// with the frame to tell it apart from older and newer snapshots (see
+// Shard::subscribe); ordering within one shard is up to the caller (see
+// Shard::topic_lock).
+class LastValueCache {
+public:
+    static constexpr size_t FRAME_SIZE = 1 + sizeof(TradeMessage);
+
+    // a fresh DATA frame holding a cached value, and the version it had
+    struct Snapshot {
+        FramePtr frame;
+        uint64_t version = 0;
+
+        explicit operator bool() const { return frame != nullptr; }
+    };
+
+    explicit LastValueCache(size_t dense_topics);
+
+    // record: one packed TradeMessage (the payload of a DATA frame, or the last
+    // record of a BATCH); returns the topic's new version, never 0
+    uint64_t store(int topic_id, const uint8_t* record);
+
+    // empty if the topic has no value yet
+    Snapshot snapshot(int topic_id) const;
+
+    // snapshots of every cached topic the pattern matches, in topic order for
+    // the dense range; walks the whole cache, so meant for subscribe time only
+    std::vector<Snapshot> snapshot_matching(const TopicPattern& pattern) const;
+
+private:
+    struct Entry {
+        std::array<uint8_t, FRAME_SIZE> wire;
+        uint64_t version = 0;   // 0 until the first store
+    };
+
+    // the DATA frame bytes in whole words, so a seqlock reader never races
+    // with the writer on plain memory
+    static constexpr size_t WORDS = (FRAME_SIZE + 7) / 8;
+    struct DenseEntry {
+        // odd while a store is in progress, 0 until the first one
+        std::atomic<uint64_t> version{0};
+        std::array<std::atomic<uint64_t>, WORDS> words{};
+    };
+
+    static Snapshot make_snapshot(int topic_id, const Entry& e);
+    // false when the topic has no value yet
+    bool read_dense(size_t index, Entry& out) const;
+
+    bool dense(int topic_id) const {
+        return topic_id >= 0 && static_cast<size_t>(topic_id) < dense_.size();
+    }
+
+    std::vector<DenseEntry> dense_;
+    std::unordered_map<int, Entry> sparse_;
+    mutable std::mutex sparse_mtx_;
+};
@@ -0,0 +1,279 @@
+#include "Metrics.h"
+#include <algorithm>
+#include <cstdio>
+#include <mutex>
+#include <utility>
+#include <vector>
+#include "ClientSession.h"
+#include "SlowConsumer.h"
+#include "../common/histogram.h"
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+// 1.6 % resolution is plenty for a scrape and keeps a block small
+using StageHistogram = BasicHistogram<7>;
+
+constexpr size_t STAGES = static_cast<size_t>(Metrics::Stage::COUNT);
+constexpr const char* STAGE_NAMES[STAGES] = {"decode", "route", "write"};
+
+const Clock::time_point started = Clock::now();
+
+int64_t now_ns() {
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(Clock::now().time_since_epoch()).count();
+}
+
+// every counter has exactly one writer, the thread owning the block
+inline void bump(std::atomic<uint64_t>& c, uint64_t n = 1) {
+    c.store(c.load(std::memory_order_relaxed) + n, std::memory_order_relaxed);
+}
+
+size_t topic_slot(int topic_id) {
+    auto t = static_cast<size_t>(static_cast<uint32_t>(topic_id));
+    return t < Metrics::TOPIC_SLOTS ? t : Metrics::TOPIC_SLOTS;
+}
+
+struct alignas(64) ThreadBlock {
+    std::atomic<bool> in_use{false};
+    std::atomic<uint64_t> frames_in{0}, bytes_in{0}, trades_in{0};
+    std::atomic<uint64_t> routed{0}, deliveries{0};
+    std::atomic<uint64_t> frames_out{0}, bytes_out{0};
+    // slot TOPIC_SLOTS collects every topic outside the counted range
+    std::array<std::atomic<uint64_t>, Metrics::TOPIC_SLOTS + 1> published{};
+    std::array<std::atomic<uint64_t>, Metrics::TOPIC_SLOTS + 1> delivered{};
+    // the owner takes the lock only for a sampled record, a scrape to read
+    std::mutex hist_mtx;
+    std::array<StageHistogram, STAGES> stages;
+    // per stage, so stages that always alternate are all sampled
+    std::array<unsigned, STAGES> countdown{};
+};
+
+struct Registry {
+    std::mutex mtx;
+    // blocks are never freed; a block whose thread exited is taken over by
+    // the next new thread, its counts keep adding to the totals
+    std::vector<std::unique_ptr<ThreadBlock>> blocks;
+    std::vector<std::weak_ptr<ClientSession>> sessions;
+};
+
+Registry& registry() {
+    static Registry r;
+    return r;
+}
+
+struct LocalBlock {
+    ThreadBlock* block = nullptr;
+
+    LocalBlock() {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        for (auto& b : r.blocks) {
+            bool expected = false;
+            if (b->in_use.compare_exchange_strong(expected, true)) {
+                block = b.get();
+                return;
+            }
+        }
+        r.blocks.push_back(std::make_unique<ThreadBlock>());
+        block = r.blocks.back().get();
+        block->in_use.store(true);
+    }
+    ~LocalBlock() { block->in_use.store(false); }
+};
+
+ThreadBlock& local() {
+    thread_local LocalBlock l;
+    return *l.block;
+}
+
+struct Snapshot {
+    double uptime_s = 0;
+    std::vector<std::pair<const char*, uint64_t>> counters;
+    std::array<StageHistogram, STAGES> stages;
+    struct Topic {
+        int topic_id; // -1: all topics outside the counted range
+        uint64_t published;
+        uint64_t delivered;
+    };
+    std::vector<Topic> topics;
+    struct Session {
+        uint64_t id;
+        std::string peer;
+        ClientSession::QueueDepth depth;
+    };
+    std::vector<Session> sessions;
+};
+
+Snapshot take_snapshot() {
+    Snapshot snap;
+    snap.uptime_s = std::chrono::duration<double>(Clock::now() - started).count();
+
+    uint64_t frames_in = 0, bytes_in = 0, trades_in = 0, routed = 0, deliveries = 0, frames_out = 0, bytes_out = 0;
+    std::vector<uint64_t> published(Metrics::TOPIC_SLOTS + 1), delivered(Metrics::TOPIC_SLOTS + 1);
+    std::vector<std::shared_ptr<ClientSession>> sessions;
+    {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lock(r.mtx);
+        for (auto& b : r.blocks) {
+            auto get = [](const std::atomic<uint64_t>& c) { return c.load(std::memory_order_relaxed); };
+            frames_in += get(b->frames_in);
+            bytes_in += get(b->bytes_in);
+            trades_in += get(b->trades_in);
+            routed += get(b->routed);
+            deliveries += get(b->deliveries);
+            frames_out += get(b->frames_out);
+            bytes_out += get(b->bytes_out);
+            for (size_t i = 0; i <= Metrics::TOPIC_SLOTS; ++i) {
+                published[i] += get(b->published[i]);
+                delivered[i] += get(b->delivered[i]);
+            }
+            std::lock_guard<std::mutex> hist_lock(b->hist_mtx);
+            for (size_t s = 0; s < STAGES; ++s) snap.stages[s].merge(b->stages[s]);
+        }
+        for (auto& w : r.sessions) {
+            if (auto s = w.lock(); s && !s->closed_) sessions.push_back(std::move(s));
+        }
+    }
+
+    auto& slow = SlowConsumerStats::instance();
+    snap.counters = {
+        {"frames_in", frames_in},
+        {"bytes_in", bytes_in},
+        {"trades_in", trades_in},
+        {"frames_routed", routed},
+        {"deliveries", deliveries},
+        {"frames_out", frames_out},
+        {"bytes_out", bytes_out},
+        {"sessions", sessions.size()},
+        {"slow_dropped_oldest", slow.dropped_oldest.load(std::memory_order_relaxed)},
+        {"slow_conflated", slow.conflated.load(std::memory_order_relaxed)},
+        {"slow_dropped_in_grace", slow.dropped_in_grace.load(std::memory_order_relaxed)},
+        {"slow_disconnects", slow.disconnects.load(std::memory_order_relaxed)},
+    };
+    for (size_t i = 0; i <= Metrics::TOPIC_SLOTS; ++i) {
+        if (published[i] == 0 && delivered[i] == 0) continue;
+        int topic_id = i == Metrics::TOPIC_SLOTS ? -1 : static_cast<int>(i);
+        snap.topics.push_back({topic_id, published[i], delivered[i]});
+    }
+    for (auto& s : sessions) snap.sessions.push_back({s->id(), s->peer(), s->queue_depth()});
+    return snap;
+}
+
+template <typename... Args>
+void append(std::string& out, const char* fmt, Args... args) {
+    char buf[256];
+    int n = std::snprintf(buf, sizeof(buf), fmt, args...);
+    if (n > 0) out.append(buf, std::min<size_t>(static_cast<size_t>(n), sizeof(buf) - 1));
+}
+
+unsigned long long ull(uint64_t v) { return static_cast<unsigned long long>(v); }
+
+}
+
+Metrics::Timer::Timer(Stage stage) : stage_(stage) {
+    unsigned& countdown = local().countdown[static_cast<size_t>(stage)];
+    if (countdown-- == 0) {
+        countdown = SAMPLE_EVERY - 1;
+        start_ns_ = now_ns();
+    }
+}
+
+void Metrics::Timer::stop() {
+    if (start_ns_ == 0) return;
+    int64_t elapsed = now_ns() - start_ns_;
+    start_ns_ = 0;
+    ThreadBlock& b = local();
+    std::lock_guard<std::mutex> lock(b.hist_mtx);
+    b.stages[static_cast<size_t>(stage_)].record(elapsed > 0 ? static_cast<uint64_t>(elapsed) : 0);
+}
+
+void Metrics::received(size_t bytes) {
+    ThreadBlock& b = local();
+    bump(b.frames_in);
+    bump(b.bytes_in, bytes);
+}
+
+void Metrics::published(int topic_id, size_t trades) {
+    ThreadBlock& b = local();
+    bump(b.trades_in, trades);
+    bump(b.published[topic_slot(topic_id)], trades);
+}
+
+void Metrics::routed(int topic_id, size_t subscribers) {
+    ThreadBlock& b = local();
+    bump(b.routed);
+    bump(b.deliveries, subscribers);
+    bump(b.delivered[topic_slot(topic_id)], subscribers);
+}
+
+void Metrics::written(size_t frames, size_t bytes) {
+    ThreadBlock& b = local();
+    bump(b.frames_out, frames);
+    bump(b.bytes_out, bytes);
+}
+
+void Metrics::add_session(const std::shared_ptr<ClientSession>& session) {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lock(r.mtx);
+    std::erase_if(r.sessions, [](const std::weak_ptr<ClientSession>& w) { return w.expired(); });
+    r.sessions.push_back(session);
+}
+
+std::string Metrics::report_text() {
+    Snapshot snap = take_snapshot();
+    std::string out;
+    append(out, "uptime_s %.3f\n", snap.uptime_s);
+    for (auto& [name, value] : snap.counters) append(out, "%s %llu\n", name, ull(value));
+    for (size_t s = 0; s < STAGES; ++s) {
+        const StageHistogram& h = snap.stages[s];
+        append(out, "stage %s samples=%llu p50_ns=%llu p99_ns=%llu p999_ns=%llu max_ns=%llu\n", STAGE_NAMES[s],
+               ull(h.count()), ull(h.percentile(50)), ull(h.percentile(99)), ull(h.percentile(99.9)), ull(h.max()));
+    }
+    for (auto& t : snap.topics) {
+        if (t.topic_id < 0) {
+            append(out, "topic other published=%llu delivered=%llu\n", ull(t.published), ull(t.delivered));
+        } else {
+            append(out, "topic %d published=%llu delivered=%llu\n", t.topic_id, ull(t.published), ull(t.delivered));
+        }
+    }
+    for (auto& s : snap.sessions) {
+        append(out, "session %llu peer=%s queued_frames=%llu queued_bytes=%llu peak_frames=%llu\n", ull(s.id),
+               s.peer.c_str(), ull(s.depth.frames), ull(s.depth.bytes), ull(s.depth.peak_frames));
+    }
+    return out;
+}
+
+std::string Metrics::report_json() {
+    Snapshot snap = take_snapshot();
+    std::string out = "{";
+    append(out, "\"uptime_s\":%.3f,\"counters\":{", snap.uptime_s);
+    for (size_t i = 0; i < snap.counters.size(); ++i) {
+        append(out, "%s\"%s\":%llu", i ? "," : "", snap.counters[i].first, ull(snap.counters[i].second));
+    }
+    out += "},\"stages\":{";
+    for (size_t s = 0; s < STAGES; ++s) {
+        const StageHistogram& h = snap.stages[s];
+        append(out, "%s\"%s\":{\"samples\":%llu,\"p50_ns\":%llu,\"p99_ns\":%llu,\"p999_ns\":%llu,\"max_ns\":%llu}",
+               s ? "," : "", STAGE_NAMES[s], ull(h.count()), ull(h.percentile(50)), ull(h.percentile(99)),
+               ull(h.percentile(99.9)), ull(h.max()));
+    }
+    out += "},\"topics\":[";
+    for (size_t i = 0; i < snap.topics.size(); ++i) {
+        const auto& t = snap.topics[i];
+        if (t.topic_id < 0) {
+            append(out, "%s{\"topic\":\"other\"", i ? "," : "");
+        } else {
+            append(out, "%s{\"topic\":%d", i ? "," : "", t.topic_id);
+        }
+        append(out, ",\"published\":%llu,\"delivered\":%llu}", ull(t.published), ull(t.delivered));
+    }
+    out += "],\"sessions\":[";
+    for (size_t i = 0; i < snap.sessions.size(); ++i) {
+        const auto& s = snap.sessions[i];
+        append(out, "%s{\"id\":%llu,\"peer\":\"%s\",\"queued_frames\":%llu,\"queued_bytes\":%llu,\"peak_frames\":%llu}",
+               i ? "," : "", ull(s.id), s.peer.c_str(), ull(s.depth.frames), ull(s.depth.bytes),
+               ull(s.depth.peak_frames));
+    }
+    out += "]}\n";
+    return out;
+}
@@ -0,0 +1,57 @@
+#pragma once
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <memory>
+#include <string>
+
+class ClientSession;
+
+// Broker instrumentation, read through the admin endpoint (AdminServer).
+//
+// Every thread that records gets its own block of counters and stage
+// histograms, registered on first use; a scrape adds the blocks up. Counters
+// have a single writer, so bumping one is a relaxed load and store without a
+// lock prefix. Stage latencies are sampled: one Timer in SAMPLE_EVERY reads
+// the clock, the others cost a decrement of a thread-local countdown.
+class Metrics {
+public:
+    enum class Stage : uint8_t {
+        DECODE,   // inbound DATA/BATCH frame copied into a routable Frame
+        ROUTE,    // get_subscribers plus queueing the frame to each subscriber
+        WRITE,    // async_write of a session's queue until its completion
+        COUNT
+    };
+    static constexpr unsigned SAMPLE_EVERY = 64;
+    // topic ids below this are counted one by one, the rest in one bucket
+    static constexpr size_t TOPIC_SLOTS = 4096;
+
+    // Times one stage on a sampled subset of calls. Copyable, so a start in
+    // one handler can be finished in a later one (on any thread).
+    class Timer {
+    public:
+        explicit Timer(Stage stage);
+        void stop();
+
+    private:
+        Stage stage_;
+        int64_t start_ns_ = 0; // 0: not sampled
+    };
+
+    // DATA or BATCH frame of `bytes` read from a publisher
+    static void received(size_t bytes);
+    // trades of one topic accepted for routing
+    static void published(int topic_id, size_t trades);
+    // a frame of the topic handed to `subscribers` sessions on this shard
+    static void routed(int topic_id, size_t subscribers);
+    // frames and bytes that left through a socket write or a shared-memory ring
+    static void written(size_t frames, size_t bytes);
+
+    // sessions whose outbound queues show up in the report
+    static void add_session(const std::shared_ptr<ClientSession>& session);
+
+    static std::string report_text();
+    static std::string report_json();
+};
@@ -0,0 +1,154 @@
+#include "MulticastPublisher.h"
+#include "ClientSession.h"
+#include "Shard.h"
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include "../common/serializer.h"
+#include "../common/logger.h"
+
+using boost::asio::ip::udp;
+
+MulticastPublisher::MulticastPublisher(const BrokerConfig& config, const std::vector<std::unique_ptr<Shard>>& shards)
+    : linger_(config.mcast_linger_us),
+      ring_size_(std::max<size_t>(1, config.mcast_retransmit_frames)),
+      topics_(config.mcast_topics.begin(), config.mcast_topics.end()) {
+    auto addr = boost::asio::ip::make_address(config.mcast_group);
+    if (!addr.is_multicast()) throw std::invalid_argument(config.mcast_group + " is not a multicast address");
+    group_ = udp::endpoint(addr, config.mcast_port);
+
+    size_t lanes = config.sharded() ? shards.size() : std::max(1u, config.threads);
+    for (size_t i = 0; i < lanes; ++i) {
+        auto lane = std::make_unique<Lane>(shards[i % shards.size()]->io_context());
+        lane->socket.open(group_.protocol());
+        if (!config.mcast_interface.empty()) {
+            lane->socket.set_option(boost::asio::ip::multicast::outbound_interface(
+                boost::asio::ip::make_address_v4(config.mcast_interface)));
+        }
+        // subscribers on the broker's own host receive the group too
+        lane->socket.set_option(boost::asio::ip::multicast::enable_loopback(true));
+
+        lane->batch.reserve(MCAST_MAX_DATAGRAM);
+        lane->batch.assign(2, 0);
+        lanes_.push_back(std::move(lane));
+    }
+}
+
+void MulticastPublisher::publish(int topic_id, const FramePtr& frame) {
+    Lane& lane = lane_of(topic_id);
+    std::unique_lock<std::mutex> lock(lane.mtx);
+    TopicState& st = lane.state[topic_id];
+    if (st.ring.empty()) st.ring.resize(ring_size_);
+
+    if (frame->data()[0] == static_cast<uint8_t>(MsgType::BATCH)) {
+        size_t count = batch_count(frame->data());
+        for (size_t i = 0; i < count; ++i) {
+            add_locked(lane, st, frame->data() + BATCH_HEADER_SIZE + i * sizeof(TradeMessage));
+        }
+    } else {
+        // DATA or DATA_TS; the group gets the trade without the trace stamps
+        add_locked(lane, st, frame->data() + frame->size() - sizeof(TradeMessage));
+    }
+
+    if (linger_.count() == 0 || lane.batch.size() + MCAST_RECORD_SIZE > MCAST_MAX_DATAGRAM) {
+        seal_locked(lane);
+    } else {
+        arm_linger_locked(lane);
+    }
+    send(lane, lock);
+}
+
+// lane.mtx held
+void MulticastPublisher::add_locked(Lane& lane, TopicState& st, const uint8_t* trade) {
+    uint64_t seq = st.next_seq++;
+    Sent& sent = st.ring[seq % ring_size_];
+    sent.seq = seq;
+    std::memcpy(sent.trade.data(), trade, sizeof(TradeMessage));
+
+    if (lane.batch.size() + MCAST_RECORD_SIZE > MCAST_MAX_DATAGRAM) seal_locked(lane);
+    serializer::write_uint64_be(lane.batch, seq);
+    lane.batch.push_back(static_cast<uint8_t>(MsgType::DATA));
+    lane.batch.insert(lane.batch.end(), trade, trade + sizeof(TradeMessage));
+    ++lane.batch_count;
+}
+
+void MulticastPublisher::retransmit(int topic_id, uint64_t first, uint32_t count,
+                                    const std::shared_ptr<ClientSession>& session) {
+    std::vector<Sent> found;
+    {
+        Lane& lane = lane_of(topic_id);
+        std::lock_guard<std::mutex> lock(lane.mtx);
+        auto it = lane.state.find(topic_id);
+        if (it == lane.state.end()) return;
+        uint64_t n = std::min<uint64_t>(count, ring_size_);
+        for (uint64_t seq = first; seq < first + n; ++seq) {
+            const Sent& e = it->second.ring[seq % ring_size_];
+            if (e.seq == seq) found.push_back(e);
+        }
+    }
+    LOG_DEBUG("Retransmitting {} of {} frames of topic {}", found.size(), count, topic_id);
+
+    for (auto& e : found) {
+        auto frame = Frame::allocate(1 + MCAST_RECORD_SIZE);
+        uint8_t* p = frame->data();
+        p[0] = static_cast<uint8_t>(MsgType::RETRANSMIT);
+        serializer::write_uint64_be(p + 1, e.seq);
+        p[9] = static_cast<uint8_t>(MsgType::DATA);
+        std::memcpy(p + 10, e.trade.data(), sizeof(TradeMessage));
+        frame->set_topic(topic_id);
+        session->deliver_raw(FramePtr(std::move(frame)));
+    }
+}
+
+// lane.mtx held: queues the datagram for send() and starts the next one
+void MulticastPublisher::seal_locked(Lane& lane) {
+    if (lane.batch_count == 0) return;
+    lane.batch[0] = static_cast<uint8_t>(lane.batch_count >> 8);
+    lane.batch[1] = static_cast<uint8_t>(lane.batch_count & 0xFF);
+    lane.outgoing.push_back(std::move(lane.batch));
+
+    if (lane.spare.empty()) {
+        lane.batch = std::vector<uint8_t>();
+        lane.batch.reserve(MCAST_MAX_DATAGRAM);
+    } else {
+        lane.batch = std::move(lane.spare.back());
+        lane.spare.pop_back();
+    }
+    lane.batch.assign(2, 0);
+    lane.batch_count = 0;
+}
+
+// Called and returns with the lane lock held. Whoever finds no send under way
+// sends every queued datagram, releasing the lock around each one; the others
+// go back to routing.
+void MulticastPublisher::send(Lane& lane, std::unique_lock<std::mutex>& lock) {
+    if (lane.sending) return;
+    lane.sending = true;
+    while (!lane.outgoing.empty()) {
+        std::vector<uint8_t> datagram = std::move(lane.outgoing.front());
+        lane.outgoing.pop_front();
+        lock.unlock();
+
+        boost::system::error_code ec;
+        lane.socket.send_to(boost::asio::buffer(datagram), group_, 0, ec);
+        if (ec) LOG_WARN("Multicast send failed: {}", ec.message());
+
+        lock.lock();
+        lane.spare.push_back(std::move(datagram));
+    }
+    lane.sending = false;
+}
+
+// lane.mtx held
+void MulticastPublisher::arm_linger_locked(Lane& lane) {
+    if (lane.linger_armed) return;
+    lane.linger_armed = true;
+    lane.linger_timer.expires_after(linger_);
+    lane.linger_timer.async_wait([this, &lane](boost::system::error_code ec) {
+        if (ec) return;
+        std::unique_lock<std::mutex> lock(lane.mtx);
+        lane.linger_armed = false;
+        seal_locked(lane);
+        send(lane, lock);
+    });
+}
@@ -0,0 +1,86 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <array>
+#include <cstdint>
+#include <deque>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+#include "BrokerConfig.h"
+#include "Frame.h"
+#include "../common/message.h"
+
+class ClientSession;
+class Shard;
+
+// UDP fan-out for the topics listed in --mcast-topics. Each trade of those
+// topics (a DATA frame or one record of a BATCH) is sent once to the multicast group, tagged with a per-topic
+// sequence number and packed with its neighbours into datagrams of up to
+// MCAST_MAX_DATAGRAM bytes; a partly filled datagram leaves after
+// --mcast-linger-us. The last frames of every topic stay in a retransmit ring
+// so subscribers can fetch the sequence numbers they missed over TCP.
+//
+// The topics are split over lanes, one per shard (one per io thread in the
+// default mode), each with its own lock, socket, datagram and linger timer.
+// A topic always goes through the same lane, so its sequence numbers leave in
+// order. A full datagram is swapped out under the lane lock and sent after
+// it is released, by one thread at a time per lane, so publishers never wait
+// for a send to fill the next datagram.
+//
+// Sessions that sent MCAST_JOIN get these topics only from the group, so
+// broker egress for a multicast topic does not grow with its subscribers.
+class MulticastPublisher {
+public:
+    // throws std::invalid_argument / boost::system::system_error on bad settings
+    MulticastPublisher(const BrokerConfig& config, const std::vector<std::unique_ptr<Shard>>& shards);
+
+    bool covers(int topic_id) const { return topics_.count(topic_id) != 0; }
+
+    // any thread
+    void publish(int topic_id, const FramePtr& frame);
+
+    // queues RETRANSMIT frames for [first, first + count) to the session;
+    // sequence numbers that already left the ring are skipped
+    void retransmit(int topic_id, uint64_t first, uint32_t count, const std::shared_ptr<ClientSession>& session);
+
+private:
+    // one trade as it went out, without the frame it came in
+    struct Sent {
+        uint64_t seq = 0;
+        std::array<uint8_t, sizeof(TradeMessage)> trade{};
+    };
+    struct TopicState {
+        uint64_t next_seq = 1;
+        std::vector<Sent> ring;
+    };
+    struct Lane {
+        explicit Lane(boost::asio::io_context& io) : socket(io), linger_timer(io) {}
+
+        boost::asio::ip::udp::socket socket;
+        boost::asio::steady_timer linger_timer;
+
+        std::mutex mtx;
+        std::unordered_map<int, TopicState> state;
+        std::vector<uint8_t> batch;
+        uint16_t batch_count = 0;
+        bool linger_armed = false;
+        // full datagrams waiting for the sender, and emptied ones for reuse
+        std::deque<std::vector<uint8_t>> outgoing;
+        std::vector<std::vector<uint8_t>> spare;
+        bool sending = false;
+    };
+
+    Lane& lane_of(int topic_id) { return *lanes_[static_cast<uint32_t>(topic_id) % lanes_.size()]; }
+    void add_locked(Lane& lane, TopicState& st, const uint8_t* trade);
+    void seal_locked(Lane& lane);
+    void arm_linger_locked(Lane& lane);
+    void send(Lane& lane, std::unique_lock<std::mutex>& lock);
+
+    boost::asio::ip::udp::endpoint group_;
+    std::chrono::microseconds linger_;
+    size_t ring_size_;
+    std::unordered_set<int> topics_;
+    std::vector<std::unique_ptr<Lane>> lanes_;
+};
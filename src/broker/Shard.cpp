@@ -0,0 +1,254 @@
+#include "Shard.h"
+#include "ClientSession.h"
+#include "Metrics.h"
+#include "../common/logger.h"
+#include <algorithm>
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+Shard::Shard(size_t index, const BrokerConfig& config)
+    : index_(index), config_(config), work_(boost::asio::make_work_guard(io_context_)), bar_timer_(io_context_) {
+    if (config.lvc) {
+        lvc_ = std::make_shared<LastValueCache>(config.lvc_dense_topics);
+        // a pinned shard thread routes alone; the cache it shares with the
+        // other shards orders itself (see LastValueCache)
+        if (!config.sharded()) topic_locks_ = std::make_unique<std::array<TopicLock, TOPIC_LOCK_STRIPES>>();
+    }
+    size_t pollers = config.sharded() ? 1 : std::max(1u, config.threads);
+    for (size_t i = 0; i < pollers; ++i) shm_pollers_.push_back(std::make_unique<ShmPoller>(config.shm_busy_poll));
+}
+
+void Shard::connect(const std::vector<std::unique_ptr<Shard>>& shards) {
+    for (auto& dst : shards) {
+        dst->lvc_ = shards.front()->lvc_;
+        dst->inboxes_.resize(shards.size());
+        for (auto& src : shards) {
+            if (src == dst) continue;
+            dst->inboxes_[src->index_] = std::make_unique<SpscQueue<CrossShardFrame>>(CROSS_SHARD_QUEUE_SIZE);
+        }
+    }
+    for (auto& src : shards) {
+        for (auto& dst : shards) {
+            if (src == dst) continue;
+            Outbox out;
+            out.peer = dst.get();
+            out.queue = dst->inboxes_[src->index_].get();
+            src->outboxes_.push_back(std::move(out));
+        }
+    }
+}
+
+void Shard::run() {
+    low_latency::run(io_context_, config_.busy_poll);
+}
+
+void Shard::stop() {
+    work_.reset();
+    io_context_.stop();
+}
+
+bool Shard::pin_current_thread(int cpu) {
+#if defined(__linux__)
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(pthread_self(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    return SetThreadAffinityMask(GetCurrentThread(), DWORD_PTR(1) << cpu) != 0;
+#else
+    (void)cpu;
+    return false;
+#endif
+}
+
+ShmPoller* Shard::reserve_shm_poller() {
+    // pollers start their thread with their first link, so links spread out
+    // over idle pollers before any poller serves two
+    std::vector<std::pair<size_t, ShmPoller*>> load;
+    for (auto& p : shm_pollers_) load.emplace_back(p->reserved(), p.get());
+    std::sort(load.begin(), load.end(), [](const auto& a, const auto& b) { return a.first < b.first; });
+    for (auto& [links, poller] : load) {
+        if (poller->reserve()) return poller;
+    }
+    return nullptr;
+}
+
+void Shard::publish(int topic_id, const FramePtr& frame) {
+    if (journal_) journal_->append(frame);
+    // the ingress shard is the only one that sends a frame to the group
+    if (mcast_ && mcast_->covers(topic_id)) mcast_->publish(topic_id, frame);
+    uint64_t version = route_local(topic_id, frame, true);
+
+    for (auto& out : outboxes_) {
+        // the peer's table is safe to read from here; skip shards nobody there wants
+        if (out.peer->manager_.get_subscribers(topic_id).empty()) continue;
+        send_to(out, topic_id, frame, version);
+    }
+}
+
+void Shard::subscribe(int topic_id, const std::shared_ptr<ClientSession>& session) {
+    auto lock = topic_lock(topic_id);
+    // the group already brings this topic to a session that joined it
+    bool via_group = mcast_ && mcast_->covers(topic_id) && session->receives_multicast();
+    if (!via_group) manager_.subscribe(topic_id, session);
+    if (!lvc_ || session->is_link()) return;
+    if (auto snapshot = lvc_->snapshot(topic_id)) deliver_snapshot(*session, snapshot);
+}
+
+void Shard::subscribe_pattern(const TopicPattern& pattern, const std::shared_ptr<ClientSession>& session) {
+    std::vector<std::unique_lock<std::mutex>> locks;
+    if (topic_locks_) {
+        locks.reserve(TOPIC_LOCK_STRIPES);
+        for (auto& stripe : *topic_locks_) locks.emplace_back(stripe.mtx);
+    }
+    manager_.subscribe_pattern(pattern, session);
+    if (!lvc_ || session->is_link()) return;
+    for (auto& snapshot : lvc_->snapshot_matching(pattern)) deliver_snapshot(*session, snapshot);
+}
+
+void Shard::subscribe_filtered(int topic_id, const TradeFilter& filter, const std::shared_ptr<ClientSession>& session) {
+    auto lock = topic_lock(topic_id);
+    manager_.subscribe_filtered(topic_id, filter, session);
+    if (!lvc_) return;
+    auto snapshot = lvc_->snapshot(topic_id);
+    if (snapshot && filter.matches(snapshot.frame->data() + snapshot.frame->size() - sizeof(TradeMessage))) {
+        deliver_snapshot(*session, snapshot);
+    }
+}
+
+void Shard::deliver_snapshot(ClientSession& session, const LastValueCache::Snapshot& snapshot) {
+    session.deliver_raw(snapshot.frame);
+    if (config_.sharded()) session.fence_snapshot(snapshot.frame->topic(), snapshot.version);
+}
+
+void Shard::subscribe_bars(int topic_id, uint32_t interval_ms, const std::shared_ptr<ClientSession>& session) {
+    manager_.subscribe_bars(topic_id, interval_ms, session);
+    if (!bar_tick_started_.exchange(true, std::memory_order_acq_rel)) schedule_bar_tick();
+}
+
+// Runs every BAR_TICK from the first bar subscription on; closes the bars of
+// topics that had no trade since their interval ended.
+void Shard::schedule_bar_tick() {
+    bar_timer_.expires_after(BAR_TICK);
+    bar_timer_.async_wait([this](boost::system::error_code ec) {
+        if (ec) return;
+        manager_.bar_series(bar_scratch_);
+        uint64_t now = BarSeries::now_ms();
+        for (BarSeries* series : bar_scratch_) series->flush(now);
+        schedule_bar_tick();
+    });
+}
+
+std::unique_lock<std::mutex> Shard::topic_lock(int topic_id) {
+    if (!topic_locks_) return {};
+    auto stripe = static_cast<uint32_t>(topic_id) % TOPIC_LOCK_STRIPES;
+    return std::unique_lock<std::mutex>((*topic_locks_)[stripe].mtx);
+}
+
+uint64_t Shard::route_local(int topic_id, const FramePtr& frame, bool ingress, uint64_t version) {
+    auto lock = topic_lock(topic_id);
+    // a DATA frame or a BATCH of this topic; either way its last trade is last
+    if (lvc_ && ingress) version = lvc_->store(topic_id, frame->data() + frame->size() - sizeof(TradeMessage));
+    // only a frame from another shard can be older than a snapshot queued here
+    bool fenced = !ingress && version != 0;
+
+    Metrics::Timer route(Metrics::Stage::ROUTE);
+    auto subscribers = manager_.get_subscribers(topic_id);
+
+    if (const FilterTable* filters = subscribers.filters()) {
+        LOG_INFO("Broker: Received DATA for Topic {}, routing to {} subscribers and {} filters.", topic_id,
+                 subscribers.size(), filters->entries().size());
+    } else if (!subscribers.empty()) {
+        LOG_INFO("Broker: Received DATA for Topic {}, routing to {} subscribers.", topic_id, subscribers.size());
+    } else {
+        LOG_INFO("Broker: Received DATA for Topic {}, but found 0 subscribers.", topic_id);
+    }
+
+    // pattern subscribers that joined the group get this topic from there;
+    // a frame from a peer broker never goes out over another link
+    bool via_group = mcast_ && mcast_->covers(topic_id);
+    bool from_link = frame->from_link();
+    for (auto &sub : subscribers) {
+        if (!sub || (via_group && sub->receives_multicast()) || (from_link && sub->is_link())) continue;
+        if (fenced && sub->behind_snapshot(topic_id, version)) continue;
+        sub->deliver_raw(frame);
+    }
+    // filtered subscribers get the trades that pass, each distinct filter's
+    // share of the frame built once
+    size_t delivered = subscribers.size();
+    if (const FilterTable* filters = subscribers.filters()) {
+        filters->route(frame, [&](const FilterTable::Entry& entry, const FramePtr& passed) {
+            for (auto& sub : entry.sessions) {
+                if ((via_group && sub->receives_multicast()) || (fenced && sub->behind_snapshot(topic_id, version))) {
+                    continue;
+                }
+                sub->deliver_raw(passed);
+            }
+            delivered += entry.sessions.size();
+        });
+    }
+    if (BarSeries* bars = subscribers.bars()) bars->add(*frame, BarSeries::now_ms());
+    route.stop();
+    Metrics::routed(topic_id, delivered);
+    return version;
+}
+
+void Shard::send_to(Outbox& out, int topic_id, const FramePtr& frame, uint64_t version) {
+    if (!flush_backlog(out) || !out.queue->try_push(CrossShardFrame{topic_id, frame, version})) {
+        // the peer is behind; keep order by parking the frame until its queue drains
+        out.backlog.push_back(CrossShardFrame{topic_id, frame, version});
+        schedule_backlog_retry();
+    }
+    out.peer->notify();
+}
+
+bool Shard::flush_backlog(Outbox& out) {
+    while (!out.backlog.empty()) {
+        if (!out.queue->try_push(std::move(out.backlog.front()))) return false;
+        out.backlog.pop_front();
+    }
+    return true;
+}
+
+void Shard::schedule_backlog_retry() {
+    if (backlog_retry_scheduled_) return;
+    backlog_retry_scheduled_ = true;
+    boost::asio::post(io_context_, [this]() {
+        backlog_retry_scheduled_ = false;
+        for (auto& out : outboxes_) {
+            if (out.backlog.empty()) continue;
+            if (!flush_backlog(out)) schedule_backlog_retry();
+            out.peer->notify();
+        }
+    });
+}
+
+// Called by producer shards after queueing. At most one drain is pending at a
+// time; the flag is cleared before draining so a frame pushed mid-drain
+// always triggers another pass.
+void Shard::notify() {
+    if (drain_scheduled_.exchange(true, std::memory_order_acq_rel)) return;
+    boost::asio::post(io_context_, bind_memory(drain_memory_, [this]() {
+        drain_scheduled_.store(false, std::memory_order_release);
+        drain_inboxes();
+    }));
+}
+
+void Shard::drain_inboxes() {
+    CrossShardFrame item;
+    bool more = false;
+    for (auto& inbox : inboxes_) {
+        if (!inbox) continue;
+        // bounded per pass so a busy producer cannot starve this shard's sockets
+        size_t budget = inbox->capacity();
+        while (budget-- > 0 && inbox->try_pop(item)) {
+            route_local(item.topic_id, item.frame, false, item.version);
+            item.frame.reset();
+        }
+        if (!inbox->empty()) more = true;
+    }
+    if (more) notify();
+}
@@ -0,0 +1,158 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <memory>
+#include <vector>
+#include "BrokerConfig.h"
+#include "SubscriptionManager.h"
+#include "LastValueCache.h"
+#include "MulticastPublisher.h"
+#include "Journal.h"
+#include "Federation.h"
+#include "Frame.h"
+#include "HandlerMemory.h"
+#include "ShmLink.h"
+#include "../common/spsc_queue.h"
+
+// One io_context together with the subscription table of the sessions that
+// live on it. The default broker runs a single shard on a pool of threads;
+// in sharded mode every shard is driven by exactly one pinned thread, and a
+// frame published on one shard reaches the others through bounded SPSC
+// queues, one per (source, destination) pair.
+class Shard {
+public:
+    static constexpr size_t CROSS_SHARD_QUEUE_SIZE = 16 * 1024;
+    // how often finished bars of quiet topics are sent; at most this late
+    static constexpr std::chrono::milliseconds BAR_TICK{10};
+
+    Shard(size_t index, const BrokerConfig& config);
+    Shard(const Shard&) = delete;
+    Shard& operator=(const Shard&) = delete;
+
+    // wires up the cross-shard queues and has every shard use the first
+    // one's last-value cache; call once on every shard before run()
+    static void connect(const std::vector<std::unique_ptr<Shard>>& shards);
+
+    size_t index() const { return index_; }
+    const BrokerConfig& config() const { return config_; }
+    boost::asio::io_context& io_context() { return io_context_; }
+    SubscriptionManager& subscriptions() { return manager_; }
+    MulticastPublisher* multicast() { return mcast_; }
+    // shared by all shards; set before run()
+    void set_multicast(MulticastPublisher* mcast) { mcast_ = mcast; }
+    Journal* journal() { return journal_; }
+    // shared by all shards; set before run()
+    void set_journal(Journal* journal) { journal_ = journal; }
+    Federation* federation() { return federation_; }
+    // shared by all shards; set before run()
+    void set_federation(Federation* federation) { federation_ = federation; }
+
+    // runs the io_context on the calling thread until stop(), spinning
+    // instead of sleeping under --busy-poll
+    void run();
+    void stop();
+
+    // binds the calling thread to one CPU; returns false where unsupported
+    static bool pin_current_thread(int cpu);
+
+    // The least busy shared-memory poller of this shard with one link
+    // reserved on it, or nullptr when all of them are full. A sharded shard
+    // has one poller, the default shard one per io thread.
+    ShmPoller* reserve_shm_poller();
+
+    // Stores the frame's trade in the last-value cache, routes it to
+    // subscribers on this shard and hands it to every other shard that has
+    // subscribers for the topic. Must be called from a thread running this
+    // shard. With a journal, the frame (stamped with its sequence number at
+    // ingress) is appended first.
+    void publish(int topic_id, const FramePtr& frame);
+
+    // Registers a subscriber and queues the topic's cached last value to it.
+    // The snapshot is ordered before any live frame routed afterwards. In
+    // sharded mode the cache is written at ingress, so a frame still on its
+    // way from another shard may be older than the snapshot; every frame
+    // carries the cache version its ingress shard stored, and the session
+    // skips those at or below its snapshot's version.
+    // Links to peer brokers get no snapshots, they could echo the peer's own
+    // frames.
+    void subscribe(int topic_id, const std::shared_ptr<ClientSession>& session);
+
+    // Same for a range/mask/all pattern: snapshots of every cached topic it
+    // matches. Holds every topic stripe while it runs, so it is a rare-path call.
+    void subscribe_pattern(const TopicPattern& pattern, const std::shared_ptr<ClientSession>& session);
+
+    // Same for a filtered subscription: the snapshot only if it passes.
+    void subscribe_filtered(int topic_id, const TradeFilter& filter, const std::shared_ptr<ClientSession>& session);
+
+    // Registers a bar subscription (interval already validated) and starts
+    // the bar tick on its first use. No snapshot: the first bar follows when
+    // the current interval ends.
+    void subscribe_bars(int topic_id, uint32_t interval_ms, const std::shared_ptr<ClientSession>& session);
+
+private:
+    struct CrossShardFrame {
+        int topic_id = 0;
+        FramePtr frame;
+        uint64_t version = 0;   // cache version stored at ingress, 0 without a cache
+    };
+
+    // producer side of the queue from this shard to one peer
+    struct Outbox {
+        Shard* peer = nullptr;
+        SpscQueue<CrossShardFrame>* queue = nullptr;
+        // frames that did not fit; flushed in order before anything new is queued
+        std::deque<CrossShardFrame> backlog;
+    };
+
+    // `ingress`: the frame entered on this shard, which alone updates the
+    // cache; returns the version stored. Otherwise `version` is the one its
+    // ingress shard stored.
+    uint64_t route_local(int topic_id, const FramePtr& frame, bool ingress, uint64_t version = 0);
+    // queues a snapshot and, in sharded mode, fences older frames of its topic
+    void deliver_snapshot(ClientSession& session, const LastValueCache::Snapshot& snapshot);
+    // serialises cache updates, routing and snapshots of one topic; a no-op
+    // lock when nothing needs ordering (cache off, or one thread per shard)
+    std::unique_lock<std::mutex> topic_lock(int topic_id);
+    void send_to(Outbox& out, int topic_id, const FramePtr& frame, uint64_t version);
+    bool flush_backlog(Outbox& out);
+    void schedule_backlog_retry();
+    void notify();
+    void drain_inboxes();
+    void schedule_bar_tick();
+
+    size_t index_;
+    const BrokerConfig& config_;
+    boost::asio::io_context io_context_;
+    boost::asio::executor_work_guard<boost::asio::io_context::executor_type> work_;
+    SubscriptionManager manager_;
+
+    static constexpr size_t TOPIC_LOCK_STRIPES = 256;
+    struct alignas(64) TopicLock {
+        std::mutex mtx;
+    };
+    // shared by all shards once connect() has run
+    std::shared_ptr<LastValueCache> lvc_;
+    MulticastPublisher* mcast_ = nullptr;
+    Journal* journal_ = nullptr;
+    Federation* federation_ = nullptr;
+    std::unique_ptr<std::array<TopicLock, TOPIC_LOCK_STRIPES>> topic_locks_;
+
+    std::vector<std::unique_ptr<SpscQueue<CrossShardFrame>>> inboxes_;
+    std::vector<Outbox> outboxes_;
+    std::atomic<bool> drain_scheduled_{false};
+    // the single pending drain, posted by producer shards
+    HandlerMemory drain_memory_;
+    bool backlog_retry_scheduled_ = false;
+
+    boost::asio::steady_timer bar_timer_;
+    std::atomic<bool> bar_tick_started_{false};
+    // the tick's copy of the active series; one tick handler runs at a time
+    std::vector<BarSeries*> bar_scratch_;
+
+    // last, so their threads drop the sessions they hold while the rest of
+    // the shard is still there
+    std::vector<std::unique_ptr<ShmPoller>> shm_pollers_;
+};
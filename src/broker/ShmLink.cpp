@@ -0,0 +1,123 @@
+#include "ShmLink.h"
+
+namespace {
+// a sleeping poller still wakes this often
+constexpr std::chrono::microseconds IDLE_WAIT{100000};
+}
+
+ShmLink::ShmLink(const std::string& name)
+    : segment_(shm::Segment::open(name)),
+      rx_(segment_.to_broker()),
+      tx_(segment_.to_client()) {
+}
+
+ShmLink::~ShmLink() {
+    stop();
+}
+
+void ShmLink::stop() {
+    if (stop_.exchange(true)) return;
+    bell().interrupt();
+}
+
+void ShmLink::wake() {
+    bell().interrupt();
+}
+
+ShmPoller::ShmPoller(bool busy_poll) : busy_poll_(busy_poll) {
+}
+
+ShmPoller::~ShmPoller() {
+    stop_.store(true, std::memory_order_release);
+    bell_.interrupt();
+    if (thread_.joinable()) thread_.join();
+}
+
+bool ShmPoller::reserve() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    if (reserved_ >= MAX_LINKS) return false;
+    ++reserved_;
+    return true;
+}
+
+void ShmPoller::release() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    --reserved_;
+}
+
+size_t ShmPoller::reserved() {
+    std::lock_guard<std::mutex> lock(mtx_);
+    return reserved_;
+}
+
+void ShmPoller::add(ShmLink& link, std::function<ShmLink::PollResult()> poll, std::shared_ptr<void> keepalive) {
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        added_.push_back({&link, std::move(poll), std::move(keepalive)});
+        if (!thread_.joinable()) thread_ = std::thread([this] { run(); });
+    }
+    bell_.interrupt();
+    link.acknowledge();
+}
+
+void ShmPoller::run() {
+    std::vector<Entry> links;
+    while (!stop_.load(std::memory_order_acquire)) {
+        size_t dropped = 0;
+        {
+            std::lock_guard<std::mutex> lock(mtx_);
+            for (auto& e : added_) links.push_back(std::move(e));
+            added_.clear();
+        }
+
+        bool progress = false;
+        for (size_t i = 0; i < links.size();) {
+            Entry& e = links[i];
+            if (e.link->stopped()) {
+                // the last reference to the session (and so to the link) may go here
+                links[i] = std::move(links.back());
+                links.pop_back();
+                ++dropped;
+                continue;
+            }
+            ShmLink::PollResult r = e.poll();
+            progress |= r.progress;
+            e.backlog = r.backlog;
+            ++i;
+        }
+        if (dropped > 0) {
+            std::lock_guard<std::mutex> lock(mtx_);
+            reserved_ -= dropped;
+        }
+
+        if (progress) continue;
+        if (busy_poll_) {
+            shm::cpu_relax();
+            continue;
+        }
+        sleep(links);
+    }
+}
+
+void ShmPoller::sleep(std::vector<Entry>& links) {
+    std::atomic<uint32_t>* words[shm::MAX_WAIT_WORDS];
+    uint32_t seen[shm::MAX_WAIT_WORDS];
+    words[0] = &bell_.seq;
+    seen[0] = bell_.seq.load(std::memory_order_acquire);
+    size_t n = 1;
+    for (auto& e : links) {
+        shm::Doorbell& bell = e.link->bell();
+        words[n] = &bell.seq;
+        seen[n++] = bell.arm(shm::Doorbell::DATA | (e.backlog ? shm::Doorbell::SPACE : 0));
+    }
+
+    bool ready = stop_.load(std::memory_order_acquire);
+    {
+        std::lock_guard<std::mutex> lock(mtx_);
+        ready = ready || !added_.empty();
+    }
+    for (auto& e : links) ready = ready || e.link->ready(e.backlog);
+    if (!ready) shm::futex_wait_any(words, seen, n, IDLE_WAIT);
+
+    for (auto& e : links) e.link->bell().disarm();
+}
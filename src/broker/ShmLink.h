@@ -0,0 +1,95 @@
+#pragma once
+#include <atomic>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "../common/shm_ring.h"
+
+// Broker end of a client's shared-memory segment: its two rings and the
+// doorbell the client rings. An ShmPoller serves it.
+class ShmLink {
+public:
+    struct PollResult {
+        bool progress = false;
+        size_t backlog = 0; // size of the next outbound frame waiting for room
+    };
+
+    // throws std::runtime_error if the segment cannot be mapped
+    explicit ShmLink(const std::string& name);
+    ~ShmLink();
+    ShmLink(const ShmLink&) = delete;
+    ShmLink& operator=(const ShmLink&) = delete;
+
+    shm::Ring& inbound() { return rx_; }
+    shm::Ring& outbound() { return tx_; }
+
+    // tells the client it may switch to the rings
+    void acknowledge() { segment_.acknowledge(); }
+    // the poller drops the link on its next pass
+    void stop();
+    bool stopped() const { return stop_.load(std::memory_order_acquire); }
+    // makes the poller look at the link again (e.g. output got backed up)
+    void wake();
+
+    shm::Doorbell& bell() { return segment_.header()->broker_bell; }
+    // whether a sleeping poller would have work: input, a stop, or room for
+    // the backlog reported by the last poll
+    bool ready(size_t backlog) {
+        return stopped() || rx_.readable() || (backlog && tx_.has_space(backlog));
+    }
+
+private:
+    shm::Segment segment_;
+    shm::Ring rx_;
+    shm::Ring tx_;
+    std::atomic<bool> stop_{false};
+};
+
+// One thread serving up to MAX_LINKS links. It calls every link's poll()
+// until a whole pass makes no progress, then either spins (busy-poll) or
+// sleeps on all the links' doorbells at once until a client writes a frame,
+// frees room a backed-up link is waiting for, or a link is added or stopped.
+// The thread starts with the first link.
+class ShmPoller {
+public:
+    // one futex_wait_any word is the poller's own
+    static constexpr size_t MAX_LINKS = shm::MAX_WAIT_WORDS - 1;
+
+    explicit ShmPoller(bool busy_poll);
+    ~ShmPoller();
+    ShmPoller(const ShmPoller&) = delete;
+    ShmPoller& operator=(const ShmPoller&) = delete;
+
+    // Claims room for one more link; false once MAX_LINKS are claimed. A
+    // claim is given back by release() or when its link is dropped.
+    bool reserve();
+    void release();
+    size_t reserved();
+
+    // Serves a reserved link and acknowledges it to the client. keepalive is
+    // held until the poller drops the link after its stop(), which may be
+    // after the owner of the link has been released everywhere else.
+    void add(ShmLink& link, std::function<ShmLink::PollResult()> poll, std::shared_ptr<void> keepalive);
+
+private:
+    struct Entry {
+        ShmLink* link = nullptr;
+        std::function<ShmLink::PollResult()> poll;
+        std::shared_ptr<void> keepalive;
+        size_t backlog = 0;
+    };
+
+    void run();
+    void sleep(std::vector<Entry>& links);
+
+    bool busy_poll_;
+    std::mutex mtx_;
+    size_t reserved_ = 0;
+    std::vector<Entry> added_; // waiting for the poller thread
+    std::thread thread_;
+    std::atomic<bool> stop_{false};
+    shm::Doorbell bell_; // rung by add() and the destructor
+};
@@ -0,0 +1,28 @@
+#include "SlowConsumer.h"
+#include <stdexcept>
+#include "../common/logger.h"
+
+SlowConsumerPolicy SlowConsumerConfig::parse_policy(const std::string& name) {
+    if (name == "drop-oldest") return SlowConsumerPolicy::DROP_OLDEST;
+    if (name == "conflate") return SlowConsumerPolicy::CONFLATE;
+    if (name == "disconnect") return SlowConsumerPolicy::DISCONNECT;
+    throw std::invalid_argument("unknown slow consumer policy: " + name);
+}
+
+SlowConsumerStats& SlowConsumerStats::instance() {
+    static SlowConsumerStats stats;
+    return stats;
+}
+
+void SlowConsumerStats::report() {
+    uint64_t dropped = dropped_oldest.load(std::memory_order_relaxed);
+    uint64_t conf = conflated.load(std::memory_order_relaxed);
+    uint64_t grace = dropped_in_grace.load(std::memory_order_relaxed);
+    uint64_t disc = disconnects.load(std::memory_order_relaxed);
+
+    uint64_t total = dropped + conf + grace + disc;
+    if (last_total_.exchange(total, std::memory_order_relaxed) == total) return;
+
+    LOG_WARN("Slow consumers: dropped-oldest={} conflated={} dropped-in-grace={} disconnects={}",
+             dropped, conf, grace, disc);
+}
@@ -0,0 +1,48 @@
+#pragma once
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// What a session does with a new frame once its outbound queue is over budget.
+enum class SlowConsumerPolicy : uint8_t {
+    DROP_OLDEST,   // make room by discarding the oldest queued frames
+    CONFLATE,      // a DATA frame replaces the queued DATA frame of its topic
+    DISCONNECT     // drop new frames; close the session if still over budget after the grace period
+};
+
+// Outbound budget of a subscriber session. Only frames waiting behind the
+// write in flight count against it.
+struct SlowConsumerConfig {
+    size_t max_frames = 64 * 1024;
+    size_t max_bytes = 8 * 1024 * 1024;
+    SlowConsumerPolicy policy = SlowConsumerPolicy::DROP_OLDEST;
+    std::unordered_map<int, SlowConsumerPolicy> topic_policy;
+    std::chrono::milliseconds disconnect_grace{2000};
+
+    SlowConsumerPolicy policy_for(int topic_id) const {
+        auto it = topic_policy.find(topic_id);
+        return it == topic_policy.end() ? policy : it->second;
+    }
+
+    // "drop-oldest", "conflate" or "disconnect"; throws std::invalid_argument
+    static SlowConsumerPolicy parse_policy(const std::string& name);
+};
+
+// Process-wide counts of how often each policy fired.
+struct SlowConsumerStats {
+    std::atomic<uint64_t> dropped_oldest{0};
+    std::atomic<uint64_t> conflated{0};
+    std::atomic<uint64_t> dropped_in_grace{0};
+    std::atomic<uint64_t> disconnects{0};
+
+    static SlowConsumerStats& instance();
+
+    // logs the totals if anything changed since the previous call
+    void report();
+
+private:
+    std::atomic<uint64_t> last_total_{0};
+};
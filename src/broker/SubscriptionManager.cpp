@@ -3,77 +3,279 @@
 #include <algorithm>
 #include "../common/logger.h"
 
-void SubscriptionManager::subscribe(int topic_id, std::shared_ptr<ClientSession> session) {
-    std::lock_guard<std::mutex> lock(mtx_);
-    auto &vec = subs_[topic_id];
-    for (auto &w : vec) {
-        if (auto s = w.lock()) {
-            if (s == session) return;
+namespace {
+
+bool contains(const SubscriptionManager::SubscriberList& list, const std::shared_ptr<ClientSession>& s) {
+    return std::find(list.begin(), list.end(), s) != list.end();
+}
+
+}
+
+SubscriptionManager::SubscriberView::SubscriberView(SubscriptionManager& mgr, int topic_id) {
+    TopicSlot* slot = mgr.find(topic_id);
+    if (!slot) {
+        if (!mgr.match_patterns(topic_id, matches_)) return;
+        slot = mgr.try_materialize(topic_id);
+        if (!slot) {
+            list_ = &matches_;
+            return;
+        }
+    }
+    list_ = slot->list.load(std::memory_order_seq_cst);
+    filters_ = slot->filters.load(std::memory_order_seq_cst);
+    bars_ = slot->bars.load(std::memory_order_seq_cst);
+}
+
+SubscriptionManager::SubscriptionManager()
+    : directory_(new Directory()) {
+}
+
+SubscriptionManager::~SubscriptionManager() {
+    for (auto& slot : slots_) {
+        delete slot.list.load();
+        delete slot.filters.load();
+    }
+    delete directory_.load();
+    delete pattern_snapshot_.load();
+}
+
+SubscriptionManager::TopicSlot* SubscriptionManager::find(int topic_id) {
+    const Directory* dir = directory_.load(std::memory_order_seq_cst);
+    auto it = dir->find(topic_id);
+    return it != dir->end() ? it->second : nullptr;
+}
+
+// readers, under an epoch guard
+bool SubscriptionManager::match_patterns(int topic_id, SubscriberList& out) const {
+    const PatternList* patterns = pattern_snapshot_.load(std::memory_order_seq_cst);
+    if (!patterns) return false;
+    for (auto& p : *patterns) {
+        if (p.pattern.matches(topic_id) && !contains(out, p.session)) out.push_back(p.session);
+    }
+    return !out.empty();
+}
+
+// first lookup of a topic some pattern matches; nullptr instead of waiting
+// when a writer holds mtx_
+SubscriptionManager::TopicSlot* SubscriptionManager::try_materialize(int topic_id) {
+    std::unique_lock<std::mutex> lock(mtx_, std::try_to_lock);
+    if (!lock) return nullptr;
+    size_t before = slots_.size();
+    TopicSlot* slot = slot_for(topic_id);
+    if (slots_.size() != before) rebuild(slot);
+    return slot;
+}
+
+// writers only (mtx_ held)
+SubscriptionManager::TopicSlot* SubscriptionManager::slot_for(int topic_id) {
+    const Directory* dir = directory_.load(std::memory_order_relaxed);
+    auto it = dir->find(topic_id);
+    if (it != dir->end()) return it->second;
+
+    TopicSlot* slot = &slots_.emplace_back();
+    slot->topic_id = topic_id;
+    auto* next = new Directory(*dir);
+    next->emplace(topic_id, slot);
+    directory_.store(next, std::memory_order_seq_cst);
+    Epoch::retire(dir);
+    return slot;
+}
+
+// writers only (mtx_ held): swaps in a copy of patterns_ for readers
+void SubscriptionManager::publish_patterns() {
+    const PatternList* next = patterns_.empty() ? nullptr : new PatternList(patterns_);
+    Epoch::retire(pattern_snapshot_.exchange(next, std::memory_order_seq_cst));
+}
+
+// writers only (mtx_ held): republishes exact subscribers plus matching patterns
+void SubscriptionManager::rebuild(TopicSlot* slot) {
+    auto* next = new SubscriberList(slot->exact);
+    for (auto& p : patterns_) {
+        if (p.pattern.matches(slot->topic_id) && !contains(*next, p.session)) {
+            next->push_back(p.session);
+            holdings_[p.session.get()].slots.insert(slot);
         }
     }
-    vec.emplace_back(session);
+    publish(slot, next);
+}
+
+// writers only (mtx_ held); an empty list is published as nullptr
+void SubscriptionManager::publish(TopicSlot* slot, SubscriberList* next) {
+    if (next && next->empty()) {
+        delete next;
+        next = nullptr;
+    }
+    const SubscriberList* prev = slot->list.exchange(next, std::memory_order_seq_cst);
+    Epoch::retire(prev);
+}
+
+// writers only (mtx_ held): groups the slot's filtered subscriptions by
+// filter into a new FilterTable (none when there are no such subscriptions)
+void SubscriptionManager::rebuild_filters(TopicSlot* slot) {
+    std::vector<FilterTable::Entry> entries;
+    for (auto& [filter, session] : slot->filtered) {
+        auto it = std::find_if(entries.begin(), entries.end(), [&](const auto& e) { return e.filter == filter; });
+        if (it == entries.end()) it = entries.insert(entries.end(), FilterTable::Entry{filter, {}});
+        it->sessions.push_back(session);
+    }
+    const FilterTable* next = entries.empty() ? nullptr : new FilterTable(std::move(entries));
+    Epoch::retire(slot->filters.exchange(next, std::memory_order_seq_cst));
+}
+
+// writers only (mtx_ held): publishes the slot's BarSeries while it has
+// subscriptions, and keeps bar_series_ in step
+void SubscriptionManager::publish_bars(TopicSlot* slot) {
+    BarSeries* series = slot->bar_series.get();
+    bool active = series && !series->empty();
+    slot->bars.store(active ? series : nullptr, std::memory_order_seq_cst);
+    auto it = std::find(bar_series_.begin(), bar_series_.end(), series);
+    if (active && it == bar_series_.end()) bar_series_.push_back(series);
+    if (!active && it != bar_series_.end()) bar_series_.erase(it);
+}
+
+// writers only (mtx_ held): drops the slot from the session's holdings once
+// neither the slot's list nor its filtered or bar subscriptions have it
+void SubscriptionManager::release(TopicSlot* slot, const ClientSession* session) {
+    const SubscriberList* cur = slot->list.load(std::memory_order_relaxed);
+    if (cur && std::any_of(cur->begin(), cur->end(), [&](const auto& s) { return s.get() == session; })) return;
+    if (std::any_of(slot->filtered.begin(), slot->filtered.end(),
+                    [&](const auto& f) { return f.second.get() == session; })) return;
+    if (slot->bar_series && slot->bar_series->holds(session)) return;
+    auto it = holdings_.find(session);
+    if (it == holdings_.end()) return;
+    it->second.slots.erase(slot);
+    if (it->second.slots.empty() && it->second.patterns == 0) holdings_.erase(it);
+}
+
+void SubscriptionManager::subscribe(int topic_id, std::shared_ptr<ClientSession> session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    TopicSlot* slot = slot_for(topic_id);
+    if (contains(slot->exact, session)) return;
+    holdings_[session.get()].slots.insert(slot);
+    slot->exact.push_back(std::move(session));
+    rebuild(slot);
 }
 
 void SubscriptionManager::unsubscribe(int topic_id, std::shared_ptr<ClientSession> session) {
     std::lock_guard<std::mutex> lock(mtx_);
-    auto it = subs_.find(topic_id);
-    if (it == subs_.end()) return;
-    auto &vec = it->second;
-    vec.erase(std::remove_if(vec.begin(), vec.end(), [&](const std::weak_ptr<ClientSession>& w) {
-        auto s = w.lock();
-        return !s || s == session;
-    }), vec.end());
-    if (vec.empty()) subs_.erase(it);
+    const Directory* dir = directory_.load(std::memory_order_relaxed);
+    auto it = dir->find(topic_id);
+    if (it == dir->end()) return;
+    TopicSlot* slot = it->second;
+    auto pos = std::find(slot->exact.begin(), slot->exact.end(), session);
+    if (pos == slot->exact.end()) return;
+    slot->exact.erase(pos);
+    rebuild(slot);
+    release(slot, session.get());
 }
 
-void SubscriptionManager::unsubscribe_all(std::shared_ptr<ClientSession> session) {
+void SubscriptionManager::subscribe_filtered(int topic_id, const TradeFilter& filter,
+                                             std::shared_ptr<ClientSession> session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    TopicSlot* slot = slot_for(topic_id);
+    for (auto& f : slot->filtered) {
+        if (f.first == filter && f.second == session) return;
+    }
+    holdings_[session.get()].slots.insert(slot);
+    slot->filtered.emplace_back(filter, std::move(session));
+    rebuild_filters(slot);
+}
+
+void SubscriptionManager::unsubscribe_filtered(int topic_id, const TradeFilter& filter,
+                                               std::shared_ptr<ClientSession> session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const Directory* dir = directory_.load(std::memory_order_relaxed);
+    auto it = dir->find(topic_id);
+    if (it == dir->end()) return;
+    TopicSlot* slot = it->second;
+    auto pos = std::find_if(slot->filtered.begin(), slot->filtered.end(),
+                            [&](const auto& f) { return f.first == filter && f.second == session; });
+    if (pos == slot->filtered.end()) return;
+    slot->filtered.erase(pos);
+    rebuild_filters(slot);
+    release(slot, session.get());
+}
+
+void SubscriptionManager::subscribe_bars(int topic_id, uint32_t interval_ms, std::shared_ptr<ClientSession> session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    TopicSlot* slot = slot_for(topic_id);
+    if (!slot->bar_series) slot->bar_series = std::make_unique<BarSeries>(topic_id);
+    holdings_[session.get()].slots.insert(slot);
+    if (slot->bar_series->subscribe(interval_ms, std::move(session))) publish_bars(slot);
+}
+
+void SubscriptionManager::unsubscribe_bars(int topic_id, uint32_t interval_ms,
+                                           std::shared_ptr<ClientSession> session) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    const Directory* dir = directory_.load(std::memory_order_relaxed);
+    auto it = dir->find(topic_id);
+    if (it == dir->end()) return;
+    TopicSlot* slot = it->second;
+    if (!slot->bar_series || !slot->bar_series->unsubscribe(interval_ms, session.get())) return;
+    publish_bars(slot);
+    release(slot, session.get());
+}
+
+void SubscriptionManager::subscribe_pattern(const TopicPattern& pattern, std::shared_ptr<ClientSession> session) {
     std::lock_guard<std::mutex> lock(mtx_);
-    for (auto& [topic, subs] : subs_) {
-        subs.erase(std::remove_if(subs.begin(), subs.end(),
-            [&](const std::weak_ptr<ClientSession>& wp) {
-                return wp.expired() || wp.lock() == session;
-            }),
-            subs.end());
+    for (auto& p : patterns_) {
+        if (p.pattern == pattern && p.session == session) return;
+    }
+    ++holdings_[session.get()].patterns;
+    patterns_.push_back({pattern, std::move(session)});
+    publish_patterns();
+
+    for (auto& slot : slots_) {
+        if (pattern.matches(slot.topic_id)) rebuild(&slot);
     }
-    Logger::info("Client auto-unsubscribed from all topics.");
 }
 
-std::vector<std::shared_ptr<ClientSession>> SubscriptionManager::get_subscribers(int topic_id) {
-    std::vector<std::shared_ptr<ClientSession>> out;
+void SubscriptionManager::unsubscribe_pattern(const TopicPattern& pattern, std::shared_ptr<ClientSession> session) {
     std::lock_guard<std::mutex> lock(mtx_);
-    auto it = subs_.find(topic_id);
-    if (it == subs_.end()) return out;
-    auto &vec = it->second;
+    auto it = std::find_if(patterns_.begin(), patterns_.end(), [&](const PatternSubscription& p) {
+        return p.pattern == pattern && p.session == session;
+    });
+    if (it == patterns_.end()) return;
+    patterns_.erase(it);
+    publish_patterns();
 
-    for (auto &w : vec) {
-        if (auto s = w.lock()) out.push_back(s);
+    auto held = holdings_.find(session.get());
+    if (held != holdings_.end() && --held->second.patterns == 0 && held->second.slots.empty()) holdings_.erase(held);
+    for (auto& slot : slots_) {
+        if (!pattern.matches(slot.topic_id)) continue;
+        rebuild(&slot);
+        release(&slot, session.get());
     }
-    return out;
 }
 
-// Metoda za periodično čišćenje (poziva se iz timera)
-void SubscriptionManager::cleanup_dead_sessions() {
+// O(topics the session holds): its holdings name every slot to rebuild
+void SubscriptionManager::unsubscribe_all(std::shared_ptr<ClientSession> session) {
     std::lock_guard<std::mutex> lock(mtx_);
-    size_t cleaned_count = 0;
-    
-    for (auto it = subs_.begin(); it != subs_.end(); ) {
-        auto& vec = it->second;
-        
-        size_t old_size = vec.size();
-        vec.erase(std::remove_if(vec.begin(), vec.end(), 
-            [&](const std::weak_ptr<ClientSession>& w) {
-                return w.expired();
-            }), vec.end());
-        
-        cleaned_count += (old_size - vec.size());
-
-        if (vec.empty()) {
-            it = subs_.erase(it);
-        } else {
-            ++it;
-        }
+    auto it = holdings_.find(session.get());
+    if (it == holdings_.end()) return;
+    Holdings held = std::move(it->second);
+    holdings_.erase(it);
+
+    if (held.patterns > 0) {
+        std::erase_if(patterns_, [&](const PatternSubscription& p) { return p.session == session; });
+        publish_patterns();
     }
-    if (cleaned_count > 0) {
-        Logger::info("Cleanup complete. Removed " + std::to_string(cleaned_count) + " dead sessions.");
+    for (TopicSlot* slot : held.slots) {
+        std::erase(slot->exact, session);
+        rebuild(slot);
+        if (std::erase_if(slot->filtered, [&](const auto& f) { return f.second == session; }) > 0) {
+            rebuild_filters(slot);
+        }
+        if (slot->bar_series && slot->bar_series->unsubscribe_all(session.get())) publish_bars(slot);
     }
-}
\ No newline at end of file
+    LOG_INFO("Client auto-unsubscribed from {} topics and {} patterns", held.slots.size(), held.patterns);
+}
+
+SubscriptionManager::SubscriberView SubscriptionManager::get_subscribers(int topic_id) {
+    return SubscriberView(*this, topic_id);
+}
+
+void SubscriptionManager::bar_series(std::vector<BarSeries*>& out) {
+    std::lock_guard<std::mutex> lock(mtx_);
+    out = bar_series_;
+}
@@ -1,21 +1,140 @@
 #pragma once
+#include <atomic>
+#include <deque>
 #include <unordered_map>
+#include <unordered_set>
+#include <utility>
 #include <vector>
 #include <memory>
 #include <mutex>
+#include "BarSeries.h"
+#include "Epoch.h"
+#include "FilterTable.h"
+#include "../common/topic_pattern.h"
+#include "../common/trade_filter.h"
 
 // forward
 class ClientSession;
 
+// Routing table. Each topic's subscribers are published as an immutable list
+// that readers walk without locking; subscribe/unsubscribe/cleanup build a new
+// list under mtx_, swap it in and retire the old one through Epoch.
+//
+// Pattern subscriptions (ranges, bitmasks, all topics) are resolved by the
+// writers: every topic's published list already contains the matching pattern
+// subscribers, so routing a message costs one lookup however many patterns
+// exist. A topic without a slot is checked against an immutable snapshot of
+// the patterns instead, without locking; only a topic some pattern matches
+// gets a slot, built when mtx_ is free and routed straight from the matches
+// until then.
+//
+// Subscriptions with a content filter are kept apart from the plain list:
+// each topic publishes a FilterTable of them next to it, which the router
+// runs over every frame of the topic. Bar subscriptions (SUBSCRIBE_BARS)
+// likewise publish the topic's BarSeries, which the router feeds every trade.
+//
+// Every session's holdings (the topics whose lists contain it, its pattern
+// count) are indexed too, so unsubscribe_all() touches only that session's
+// topics instead of the whole table. Sessions call it as soon as they close;
+// nothing sweeps the table for dead entries.
 class SubscriptionManager {
 public:
+    using SubscriberList = std::vector<std::shared_ptr<ClientSession>>;
+
+    // Snapshot of one topic's subscribers. Holds an epoch guard, so it must be
+    // used and destroyed on the thread that obtained it.
+    class SubscriberView {
+    public:
+        SubscriberView(SubscriptionManager& mgr, int topic_id);
+
+        const std::shared_ptr<ClientSession>* begin() const { return list_ ? list_->data() : nullptr; }
+        const std::shared_ptr<ClientSession>* end() const { return list_ ? list_->data() + list_->size() : nullptr; }
+        // unfiltered subscribers
+        size_t size() const { return list_ ? list_->size() : 0; }
+        // filtered subscribers, nullptr when there are none
+        const FilterTable* filters() const { return filters_; }
+        // bar subscriptions, nullptr when there are none
+        BarSeries* bars() const { return bars_; }
+        bool empty() const { return size() == 0 && !filters_ && !bars_; }
+
+    private:
+        Epoch::Guard guard_;
+        const SubscriberList* list_ = nullptr;
+        const FilterTable* filters_ = nullptr;
+        BarSeries* bars_ = nullptr;
+        // pattern subscribers of a topic that has no slot yet
+        SubscriberList matches_;
+    };
+
+    SubscriptionManager();
+    ~SubscriptionManager();
+    SubscriptionManager(const SubscriptionManager&) = delete;
+    SubscriptionManager& operator=(const SubscriptionManager&) = delete;
+
     void subscribe(int topic_id, std::shared_ptr<ClientSession> session);
     void unsubscribe(int topic_id, std::shared_ptr<ClientSession> session);
+    void subscribe_pattern(const TopicPattern& pattern, std::shared_ptr<ClientSession> session);
+    void unsubscribe_pattern(const TopicPattern& pattern, std::shared_ptr<ClientSession> session);
+    void subscribe_filtered(int topic_id, const TradeFilter& filter, std::shared_ptr<ClientSession> session);
+    void unsubscribe_filtered(int topic_id, const TradeFilter& filter, std::shared_ptr<ClientSession> session);
+    void subscribe_bars(int topic_id, uint32_t interval_ms, std::shared_ptr<ClientSession> session);
+    void unsubscribe_bars(int topic_id, uint32_t interval_ms, std::shared_ptr<ClientSession> session);
     void unsubscribe_all(std::shared_ptr<ClientSession> session);
-    std::vector<std::shared_ptr<ClientSession>> get_subscribers(int topic_id); 
-    void cleanup_dead_sessions();
+    SubscriberView get_subscribers(int topic_id);
+    // replaces `out` with every BarSeries that has subscribers
+    void bar_series(std::vector<BarSeries*>& out);
 
 private:
-    std::unordered_map<int, std::vector<std::weak_ptr<ClientSession>>> subs_;
+    struct TopicSlot {
+        std::atomic<const SubscriberList*> list{nullptr};
+        int topic_id = 0;
+        // writer-side: exact subscribers only, list is exact + matching patterns
+        SubscriberList exact;
+        std::atomic<const FilterTable*> filters{nullptr};
+        // writer-side source of filters
+        std::vector<std::pair<TradeFilter, std::shared_ptr<ClientSession>>> filtered;
+        // published while bar_series has subscriptions
+        std::atomic<BarSeries*> bars{nullptr};
+        // created on the first bar subscription, kept while the slot lives so
+        // a router that loaded `bars` just before it was cleared is still safe
+        std::unique_ptr<BarSeries> bar_series;
+    };
+    using Directory = std::unordered_map<int, TopicSlot*>;
+
+    struct PatternSubscription {
+        TopicPattern pattern;
+        std::shared_ptr<ClientSession> session;
+    };
+    using PatternList = std::vector<PatternSubscription>;
+
+    // what one session holds
+    struct Holdings {
+        std::unordered_set<TopicSlot*> slots; // slots whose list contains the session
+        size_t patterns = 0;                  // its entries in patterns_
+    };
+
+    TopicSlot* find(int topic_id);
+    // appends the snapshot's pattern subscribers of the topic; false when none match
+    bool match_patterns(int topic_id, SubscriberList& out) const;
+    TopicSlot* try_materialize(int topic_id);
+    TopicSlot* slot_for(int topic_id);
+    void publish_patterns();
+    void rebuild(TopicSlot* slot);
+    void rebuild_filters(TopicSlot* slot);
+    void publish_bars(TopicSlot* slot);
+    void publish(TopicSlot* slot, SubscriberList* next);
+    void release(TopicSlot* slot, const ClientSession* session);
+
+    // topic -> slot map, replaced only when a topic is seen for the first time
+    std::atomic<const Directory*> directory_;
+    // slots are never freed while the manager lives, so directory entries stay valid
+    std::deque<TopicSlot> slots_;
+    PatternList patterns_;
+    // immutable copy of patterns_ for readers, nullptr while there are none
+    std::atomic<const PatternList*> pattern_snapshot_{nullptr};
+    // the BarSeries currently published
+    std::vector<BarSeries*> bar_series_;
+    // keyed by the session; an entry exists while the session holds anything
+    std::unordered_map<const ClientSession*, Holdings> holdings_;
     std::mutex mtx_;
-};
\ No newline at end of file
+};
@@ -2,32 +2,78 @@
 #include <iostream>
 #include <thread>
 #include <vector>
-#include <chrono> 
+#include <chrono>
+#include "BrokerConfig.h"
+#include "Shard.h"
+#include "MulticastPublisher.h"
+#include "Journal.h"
 #include "SubscriptionManager.h"
 #include "ClientSession.h"
-#include "../common/logger.h" 
+#include "AdminServer.h"
+#include "Federation.h"
+#include "../common/logger.h"
 
 using boost::asio::ip::tcp;
 
-void start_cleanup_timer(boost::asio::io_context& io_context, SubscriptionManager& manager);
+void start_housekeeping_timer(boost::asio::io_context& io_context);
 
 int main(int argc, char* argv[]) {
     try {
-        boost::asio::io_context io_context;
+        BrokerConfig config = BrokerConfig::from_args(argc, argv);
+        Logger::set_overflow_policy(config.log_overflow);
 
-        SubscriptionManager manager;
+        // default mode: one shard shared by all io threads
+        size_t nshards = config.sharded() ? config.shards : 1;
+        std::vector<std::unique_ptr<Shard>> shards;
+        for (size_t i = 0; i < nshards; ++i) {
+            shards.push_back(std::make_unique<Shard>(i, config));
+        }
+        Shard::connect(shards);
+
+        std::unique_ptr<MulticastPublisher> mcast;
+        if (config.multicast()) {
+            mcast = std::make_unique<MulticastPublisher>(config, shards);
+            for (auto& shard : shards) shard->set_multicast(mcast.get());
+            Logger::info("Multicast fan-out of " + std::to_string(config.mcast_topics.size()) + " topics to " +
+                         config.mcast_group + ":" + std::to_string(config.mcast_port));
+        }
+
+        std::unique_ptr<Journal> journal;
+        if (config.journal()) {
+            journal = std::make_unique<Journal>(config);
+            for (auto& shard : shards) shard->set_journal(journal.get());
+            Logger::info("Journal in " + config.journal_dir);
+        }
+
+        // always present: a peer may link to this broker without it dialing anyone
+        auto federation = std::make_unique<Federation>(shards[0]->io_context(), config, shards);
+        for (auto& shard : shards) shard->set_federation(federation.get());
+        federation->start();
+        Logger::info("Broker id " + std::to_string(federation->id()) + ", linking to " +
+                     std::to_string(config.peers.size()) + " peers");
+
+        std::unique_ptr<AdminServer> admin;
+        if (config.admin_port != 0) {
+            admin = std::make_unique<AdminServer>(shards[0]->io_context(), config.admin_port);
+            Logger::info("Admin endpoint on 127.0.0.1:" + std::to_string(config.admin_port));
+        }
 
-        start_cleanup_timer(io_context, manager);
+        start_housekeeping_timer(shards[0]->io_context());
 
-        tcp::acceptor acceptor(io_context, tcp::endpoint(tcp::v4(), 8080));
-        Logger::info("Broker listening on 0.0.0.0:8080");
+        tcp::acceptor acceptor(shards[0]->io_context(), tcp::endpoint(tcp::v4(), config.port));
+        Logger::info("Broker listening on 0.0.0.0:" + std::to_string(config.port));
 
+        // connections are spread round-robin; a session stays on its shard for life
+        size_t next_shard = 0;
         std::function<void()> do_accept;
         do_accept = [&]() {
-            acceptor.async_accept([&](boost::system::error_code ec, tcp::socket socket) {
+            Shard& target = *shards[next_shard];
+            next_shard = (next_shard + 1) % shards.size();
+            acceptor.async_accept(target.io_context(), [&](boost::system::error_code ec, tcp::socket socket) {
                 if (!ec) {
-                    Logger::info("New connection from " + socket.remote_endpoint().address().to_string());
-                    auto session = std::make_shared<ClientSession>(std::move(socket), manager);
+                    Logger::info("New connection from " + socket.remote_endpoint().address().to_string() +
+                                 " on shard " + std::to_string(target.index()));
+                    auto session = ClientSession::create(std::move(socket), target);
                     session->start();
                 } else {
                     Logger::error("Accept error: " + ec.message());
@@ -38,18 +84,32 @@ int main(int argc, char* argv[]) {
 
         do_accept();
 
-        unsigned int nthreads = std::max(1u, std::thread::hardware_concurrency());
         std::vector<std::thread> threads;
-        for (unsigned int i = 0; i < nthreads - 1; ++i) { 
-            threads.emplace_back([&io_context]() {
-                io_context.run();
-            });
+        if (config.sharded()) {
+            for (size_t i = 0; i < shards.size(); ++i) {
+                int cpu = config.cpus.empty() ? static_cast<int>(i) : config.cpus[i];
+                threads.emplace_back([&shards, i, cpu]() {
+                    if (!Shard::pin_current_thread(cpu)) {
+                        Logger::warn("Could not pin shard " + std::to_string(i) + " to CPU " + std::to_string(cpu));
+                    }
+                    shards[i]->run();
+                });
+            }
+            Logger::info("Running " + std::to_string(shards.size()) + " pinned shards.");
+        } else {
+            unsigned int nthreads = config.threads;
+            for (unsigned int i = 0; i < nthreads; ++i) {
+                int cpu = config.cpus.empty() ? -1 : config.cpus[i % config.cpus.size()];
+                threads.emplace_back([&shards, i, cpu]() {
+                    if (cpu >= 0 && !Shard::pin_current_thread(cpu)) {
+                        Logger::warn("Could not pin io thread " + std::to_string(i) + " to CPU " + std::to_string(cpu));
+                    }
+                    shards[0]->run();
+                });
+            }
+            Logger::info("Running io_context on " + std::to_string(nthreads) + " threads.");
         }
-
-        Logger::info("Running io_context on " + std::to_string(nthreads) + " threads.");
-
-        // run u glavnoj niti
-        io_context.run();
+        if (config.busy_poll) Logger::info("io threads busy-poll instead of sleeping in the reactor");
 
         for (auto &t : threads) if (t.joinable()) t.join();
     } catch (std::exception& e) {
@@ -59,16 +119,19 @@ int main(int argc, char* argv[]) {
     return 0;
 }
 
-void start_cleanup_timer(boost::asio::io_context& io_context, SubscriptionManager& manager) {
-    auto timer = std::make_shared<boost::asio::steady_timer>(io_context, 
-        std::chrono::seconds(5)); 
-    
-    timer->async_wait([&io_context, &manager, timer](const boost::system::error_code& ec) {
+// Closed sessions leave the subscription tables on their own; this only frees
+// retired table versions no writer got to and reports slow-consumer activity.
+void start_housekeeping_timer(boost::asio::io_context& io_context) {
+    auto timer = std::make_shared<boost::asio::steady_timer>(io_context,
+        std::chrono::seconds(5));
+
+    timer->async_wait([&io_context, timer](const boost::system::error_code& ec) {
         if (!ec) {
-            manager.cleanup_dead_sessions(); 
+            Epoch::reclaim();
+            SlowConsumerStats::instance().report();
         } else {
-            Logger::error("Cleanup timer error: " + ec.message());
+            Logger::error("Housekeeping timer error: " + ec.message());
         }
-        start_cleanup_timer(io_context, manager); 
+        start_housekeeping_timer(io_context);
     });
-}
\ No newline at end of file
+}
@@ -0,0 +1,249 @@
+#pragma once
+#include <array>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <type_traits>
+#if defined(_MSC_VER)
+#include <stdlib.h>
+#endif
+#if defined(__SSSE3__) || defined(__AVX__)
+#include <immintrin.h>
+#define CODEC_SIMD 1
+#endif
+#include "message.h"
+
+// Big-endian wire codec. A message type is described once by its field list
+// (Schema<Msg> below); encode/decode for it are generated from that list and
+// work on caller-provided buffers, so nothing is allocated per message.
+// Everything except the bulk paths is constexpr.
+namespace codec {
+
+template <size_t N> struct uint_of_size;
+template <> struct uint_of_size<1> { using type = uint8_t; };
+template <> struct uint_of_size<2> { using type = uint16_t; };
+template <> struct uint_of_size<4> { using type = uint32_t; };
+template <> struct uint_of_size<8> { using type = uint64_t; };
+template <typename T> using uint_of = typename uint_of_size<sizeof(T)>::type;
+
+template <typename U>
+constexpr U byteswap(U v) noexcept {
+    static_assert(std::is_unsigned_v<U>);
+    if constexpr (sizeof(U) == 1) {
+        return v;
+    } else {
+#if defined(__GNUC__) || defined(__clang__)
+        if constexpr (sizeof(U) == 2) return __builtin_bswap16(v);
+        else if constexpr (sizeof(U) == 4) return __builtin_bswap32(v);
+        else return __builtin_bswap64(v);
+#else
+        if (!std::is_constant_evaluated()) {
+            if constexpr (sizeof(U) == 2) return _byteswap_ushort(v);
+            else if constexpr (sizeof(U) == 4) return _byteswap_ulong(v);
+            else return _byteswap_uint64(v);
+        }
+        U r = 0;
+        for (size_t i = 0; i < sizeof(U); ++i) r = static_cast<U>((r << 8) | ((v >> (8 * i)) & 0xFF));
+        return r;
+#endif
+    }
+}
+
+// one scalar field (integer or floating point) in network byte order
+template <typename T>
+constexpr void store_be(uint8_t* p, T v) noexcept {
+    auto u = std::bit_cast<uint_of<T>>(v);
+    if (std::is_constant_evaluated()) {
+        for (size_t i = 0; i < sizeof(u); ++i) p[i] = static_cast<uint8_t>(u >> (8 * (sizeof(u) - 1 - i)));
+        return;
+    }
+    if constexpr (std::endian::native == std::endian::little) u = byteswap(u);
+    std::memcpy(p, &u, sizeof(u));
+}
+
+template <typename T>
+constexpr T load_be(const uint8_t* p) noexcept {
+    uint_of<T> u = 0;
+    if (std::is_constant_evaluated()) {
+        for (size_t i = 0; i < sizeof(u); ++i) u = static_cast<uint_of<T>>((u << 8) | p[i]);
+        return std::bit_cast<T>(u);
+    }
+    std::memcpy(&u, p, sizeof(u));
+    if constexpr (std::endian::native == std::endian::little) u = byteswap(u);
+    return std::bit_cast<T>(u);
+}
+
+template <auto Member> struct member_traits;
+template <typename C, typename M, M C::*P>
+struct member_traits<P> {
+    using type = M;
+};
+
+// Wire layout: the listed members back to back, in order.
+template <auto... Members>
+struct Fields {
+    static constexpr std::array<size_t, sizeof...(Members)> sizes{sizeof(typename member_traits<Members>::type)...};
+    static constexpr size_t wire_size = (sizeof(typename member_traits<Members>::type) + ...);
+};
+
+// Specialised per message type:
+//   using fields = Fields<&Msg::a, &Msg::b, ...>;
+//   static constexpr bool same_layout;  // struct is packed in field order,
+//                                       // so bulk paths may shuffle bytes in place
+template <typename Msg> struct Schema;
+
+template <typename Msg>
+constexpr size_t wire_size = Schema<Msg>::fields::wire_size;
+
+namespace detail {
+
+template <typename Msg, auto... Members>
+constexpr void encode(const Msg& m, uint8_t* out, Fields<Members...>) noexcept {
+    size_t off = 0;
+    ((store_be(out + off, m.*Members), off += sizeof(typename member_traits<Members>::type)), ...);
+}
+
+template <typename Msg, auto... Members>
+constexpr void decode(const uint8_t* in, Msg& m, Fields<Members...>) noexcept {
+    size_t off = 0;
+    ((m.*Members = load_be<typename member_traits<Members>::type>(in + off),
+      off += sizeof(typename member_traits<Members>::type)), ...);
+}
+
+// Byte-swapping a message with the same layout is one fixed permutation of
+// its bytes, done with 16-byte shuffles. Each window starts at the first
+// field not handled yet and takes every field that fits whole; bytes of a
+// field cut off at the end are copied unchanged and fixed by the next window.
+template <size_t N>
+struct SwapPlan {
+    size_t count = 0;
+    std::array<size_t, N> start{};
+    std::array<std::array<uint8_t, 16>, N> mask{};
+};
+
+template <size_t N>
+constexpr SwapPlan<N> make_swap_plan(const std::array<size_t, N>& sizes) {
+    SwapPlan<N> plan;
+    size_t f = 0, off = 0;
+    while (f < N) {
+        size_t start = off;
+        auto& m = plan.mask[plan.count];
+        for (size_t i = 0; i < 16; ++i) m[i] = static_cast<uint8_t>(i);
+        while (f < N && off + sizes[f] <= start + 16) {
+            for (size_t i = 0; i < sizes[f]; ++i) m[off - start + i] = static_cast<uint8_t>(off - start + sizes[f] - 1 - i);
+            off += sizes[f];
+            ++f;
+        }
+        plan.start[plan.count++] = start;
+    }
+    return plan;
+}
+
+template <typename Msg>
+void swap_array(const uint8_t* in, size_t n, uint8_t* out) noexcept {
+    constexpr size_t size = wire_size<Msg>;
+    if constexpr (std::endian::native == std::endian::big) {
+        std::memmove(out, in, n * size);
+        return;
+    }
+#if defined(CODEC_SIMD)
+    constexpr auto plan = make_swap_plan(Schema<Msg>::fields::sizes);
+    // the last window of the last message may not read past the array
+    constexpr bool tail_fits = plan.start[plan.count - 1] + 16 <= size;
+    size_t simd_n = tail_fits || n == 0 ? n : n - 1;
+
+    __m128i masks[plan.count];
+    for (size_t w = 0; w < plan.count; ++w) {
+        masks[w] = _mm_loadu_si128(reinterpret_cast<const __m128i*>(plan.mask[w].data()));
+    }
+    for (size_t i = 0; i < simd_n; ++i, in += size, out += size) {
+        for (size_t w = 0; w < plan.count; ++w) {
+            __m128i v = _mm_loadu_si128(reinterpret_cast<const __m128i*>(in + plan.start[w]));
+            _mm_storeu_si128(reinterpret_cast<__m128i*>(out + plan.start[w]), _mm_shuffle_epi8(v, masks[w]));
+        }
+    }
+    n -= simd_n;
+#endif
+    for (size_t i = 0; i < n; ++i, in += size, out += size) {
+        Msg m;
+        std::memcpy(&m, in, size);
+        encode(m, out, typename Schema<Msg>::fields{});
+    }
+}
+
+}
+
+template <typename Msg>
+constexpr void encode(const Msg& m, uint8_t* out) noexcept {
+    detail::encode(m, out, typename Schema<Msg>::fields{});
+}
+
+template <typename Msg>
+constexpr Msg decode(const uint8_t* in) noexcept {
+    Msg m{};
+    detail::decode(in, m, typename Schema<Msg>::fields{});
+    return m;
+}
+
+// n messages back to back; SSSE3 shuffles where the build target has them
+template <typename Msg>
+void encode_array(const Msg* in, size_t n, uint8_t* out) noexcept {
+    if constexpr (Schema<Msg>::same_layout) {
+        detail::swap_array<Msg>(reinterpret_cast<const uint8_t*>(in), n, out);
+    } else {
+        for (size_t i = 0; i < n; ++i) encode(in[i], out + i * wire_size<Msg>);
+    }
+}
+
+template <typename Msg>
+void decode_array(const uint8_t* in, size_t n, Msg* out) noexcept {
+    if constexpr (Schema<Msg>::same_layout) {
+        detail::swap_array<Msg>(in, n, reinterpret_cast<uint8_t*>(out));
+    } else {
+        for (size_t i = 0; i < n; ++i) out[i] = decode<Msg>(in + i * wire_size<Msg>);
+    }
+}
+
+template <>
+struct Schema<TradeMessage> {
+    using fields = Fields<&TradeMessage::topic_id, &TradeMessage::timestamp_ms,
+                          &TradeMessage::price, &TradeMessage::quantity>;
+    static constexpr bool same_layout = true;
+};
+static_assert(wire_size<TradeMessage> == sizeof(TradeMessage), "TradeMessage must stay packed");
+
+// DATA frame: type byte + encoded TradeMessage
+constexpr size_t DATA_FRAME_SIZE = 1 + wire_size<TradeMessage>;
+
+constexpr void encode_data(const TradeMessage& m, uint8_t* out) noexcept {
+    out[0] = static_cast<uint8_t>(MsgType::DATA);
+    encode(m, out + 1);
+}
+
+template <>
+struct Schema<BarMessage> {
+    using fields = Fields<&BarMessage::topic_id, &BarMessage::interval_ms, &BarMessage::start_ms,
+                          &BarMessage::open, &BarMessage::high, &BarMessage::low, &BarMessage::close,
+                          &BarMessage::volume, &BarMessage::vwap, &BarMessage::trades>;
+    static constexpr bool same_layout = true;
+};
+static_assert(wire_size<BarMessage> == sizeof(BarMessage), "BarMessage must stay packed");
+
+// BAR frame: type byte + encoded BarMessage
+constexpr size_t BAR_FRAME_SIZE = 1 + wire_size<BarMessage>;
+
+constexpr void encode_bar(const BarMessage& m, uint8_t* out) noexcept {
+    out[0] = static_cast<uint8_t>(MsgType::BAR);
+    encode(m, out + 1);
+}
+
+static_assert([] {
+    std::array<uint8_t, DATA_FRAME_SIZE> buf{};
+    encode_data(TradeMessage{0x01020304, 5, 1.5, -2.0}, buf.data());
+    TradeMessage m = decode<TradeMessage>(buf.data() + 1);
+    return buf[1] == 0x01 && buf[4] == 0x04 && buf[12] == 5 && m.topic_id == 0x01020304 &&
+           m.timestamp_ms == 5 && m.price == 1.5 && m.quantity == -2.0;
+}(), "codec round trip");
+
+}
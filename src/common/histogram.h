@@ -0,0 +1,88 @@
+#pragma once
+#include <algorithm>
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <vector>
+
+// HDR-style latency histogram: values below 2^SUB_BITS are counted exactly,
+// above that every power-of-two range is split into 2^(SUB_BITS-1) equal
+// buckets, so the relative error stays below 2^-(SUB_BITS-1) (about 0.1 %
+// with 11 bits, 1.6 % with 7) up to 2^63. Recording is a shift and an
+// increment; the counts array is allocated once.
+template <unsigned SubBits>
+class BasicHistogram {
+public:
+    static constexpr unsigned SUB_BITS = SubBits;
+    static constexpr uint64_t SUB_COUNT = uint64_t{1} << SUB_BITS;
+    static constexpr uint64_t HALF_COUNT = SUB_COUNT / 2;
+    static constexpr size_t BUCKETS = SUB_COUNT + (64 - SUB_BITS) * HALF_COUNT;
+
+    BasicHistogram() : counts_(BUCKETS) {}
+
+    void record(uint64_t value) {
+        ++counts_[index(value)];
+        ++total_;
+        min_ = std::min(min_, value);
+        max_ = std::max(max_, value);
+        sum_ += value;
+    }
+
+    void merge(const BasicHistogram& other) {
+        for (size_t i = 0; i < BUCKETS; ++i) counts_[i] += other.counts_[i];
+        total_ += other.total_;
+        min_ = std::min(min_, other.min_);
+        max_ = std::max(max_, other.max_);
+        sum_ += other.sum_;
+    }
+
+    void reset() {
+        std::fill(counts_.begin(), counts_.end(), 0);
+        total_ = 0;
+        min_ = std::numeric_limits<uint64_t>::max();
+        max_ = 0;
+        sum_ = 0;
+    }
+
+    uint64_t count() const { return total_; }
+    uint64_t min() const { return total_ ? min_ : 0; }
+    uint64_t max() const { return max_; }
+    double mean() const { return total_ ? static_cast<double>(sum_) / static_cast<double>(total_) : 0.0; }
+
+    // highest value equivalent to the p-th percentile (p in [0, 100])
+    uint64_t percentile(double p) const {
+        if (total_ == 0) return 0;
+        auto rank = static_cast<uint64_t>(p / 100.0 * static_cast<double>(total_) + 0.5);
+        rank = std::clamp<uint64_t>(rank, 1, total_);
+        uint64_t seen = 0;
+        for (size_t i = 0; i < BUCKETS; ++i) {
+            seen += counts_[i];
+            if (seen >= rank) return std::min(highest_equivalent(i), max_);
+        }
+        return max_;
+    }
+
+private:
+    static size_t index(uint64_t v) {
+        if (v < SUB_COUNT) return static_cast<size_t>(v);
+        unsigned shift = static_cast<unsigned>(std::bit_width(v)) - SUB_BITS;
+        uint64_t sub = v >> shift; // in [HALF_COUNT, SUB_COUNT)
+        return static_cast<size_t>(SUB_COUNT + (shift - 1) * HALF_COUNT + (sub - HALF_COUNT));
+    }
+
+    static uint64_t highest_equivalent(size_t i) {
+        if (i < SUB_COUNT) return i;
+        uint64_t shift = (i - SUB_COUNT) / HALF_COUNT + 1;
+        uint64_t sub = (i - SUB_COUNT) % HALF_COUNT + HALF_COUNT;
+        return ((sub + 1) << shift) - 1;
+    }
+
+    std::vector<uint64_t> counts_;
+    uint64_t total_ = 0;
+    uint64_t min_ = std::numeric_limits<uint64_t>::max();
+    uint64_t max_ = 0;
+    uint64_t sum_ = 0;
+};
+
+using Histogram = BasicHistogram<11>;
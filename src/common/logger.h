@@ -3,37 +3,298 @@
 #endif
 
 #pragma once
-#include <iostream>
-#include <mutex>
+#include <atomic>
 #include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
 #include <ctime>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <string_view>
+#include <thread>
+#include <type_traits>
+#include <vector>
+#include "spsc_queue.h"
+
+enum class LogLevel : uint8_t { DEBUG, INFO, WARN, ERROR };
+
+// Calls below this level are removed at compile time when made through the
+// LOG_* macros (0 = DEBUG, 1 = INFO, 2 = WARN, 3 = ERROR).
+#ifndef LOG_COMPILE_LEVEL
+#define LOG_COMPILE_LEVEL 1
+#endif
+
+#define LOG_AT(lvl, fmt, ...)                                                     \
+    do {                                                                          \
+        if constexpr (static_cast<int>(lvl) >= LOG_COMPILE_LEVEL) {               \
+            Logger::write(lvl, fmt, ##__VA_ARGS__);                               \
+        }                                                                         \
+    } while (0)
 
-enum class LogLevel { INFO, WARN, ERROR, DEBUG };
+#define LOG_DEBUG(fmt, ...) LOG_AT(LogLevel::DEBUG, fmt, ##__VA_ARGS__)
+#define LOG_INFO(fmt, ...)  LOG_AT(LogLevel::INFO, fmt, ##__VA_ARGS__)
+#define LOG_WARN(fmt, ...)  LOG_AT(LogLevel::WARN, fmt, ##__VA_ARGS__)
+#define LOG_ERROR(fmt, ...) LOG_AT(LogLevel::ERROR, fmt, ##__VA_ARGS__)
 
+// What a producing thread does when its ring is full.
+enum class LogOverflow : uint8_t {
+    DROP,   // discard the record and count it; the drop total is reported later
+    BLOCK   // spin until the background thread makes room
+};
+
+// Asynchronous logger. A log call fills one fixed-size binary record (format
+// string pointer, raw argument values, copied string arguments) and pushes it
+// onto a ring owned by the calling thread; a background thread formats the
+// records and writes them to stdout. The calling thread never takes a lock,
+// allocates or makes a syscall once its ring exists.
+//
+// The format string must outlive the process (use string literals); each "{}"
+// is replaced by the next argument.
 class Logger {
+public:
+    static constexpr size_t MAX_ARGS = 6;
+    static constexpr size_t TEXT_SIZE = 176;
+    static constexpr size_t RING_SIZE = 4096;
+
+    struct Record {
+        enum class Kind : uint8_t { I64, U64, F64, STR };
+        union Arg {
+            int64_t i;
+            uint64_t u;
+            double d;
+            uint32_t str;   // offset into text, NUL terminated
+        };
+
+        int64_t timestamp_ns = 0;
+        const char* fmt = nullptr;
+        LogLevel level = LogLevel::INFO;
+        uint8_t nargs = 0;
+        uint8_t text_used = 0;
+        Kind kinds[MAX_ARGS] = {};
+        Arg args[MAX_ARGS] = {};
+        char text[TEXT_SIZE];
+    };
+
+    template <typename... Args>
+    static void write(LogLevel lvl, const char* fmt, const Args&... args) {
+        static_assert(sizeof...(Args) <= MAX_ARGS, "too many log arguments");
+        if (lvl < min_level_.load(std::memory_order_relaxed)) return;
+        Record rec;
+        rec.timestamp_ns = std::chrono::duration_cast<std::chrono::nanoseconds>(
+            std::chrono::system_clock::now().time_since_epoch()).count();
+        rec.fmt = fmt;
+        rec.level = lvl;
+        (add_arg(rec, args), ...);
+        submit(std::move(rec));
+    }
+
+    static void set_overflow_policy(LogOverflow policy) {
+        backend().overflow.store(policy, std::memory_order_relaxed);
+    }
+
+    // records below lvl are discarded at run time, on top of LOG_COMPILE_LEVEL
+    static void set_level(LogLevel lvl) { min_level_.store(lvl, std::memory_order_relaxed); }
+
+    // blocks until everything logged so far has been written
+    static void flush() { backend().flush(); }
+
+    // string-message forms for cold paths; prefer the LOG_* macros on hot ones
+    static void info(const std::string& msg) { LOG_INFO("{}", msg); }
+    static void warn(const std::string& msg) { LOG_WARN("{}", msg); }
+    static void error(const std::string& msg) { LOG_ERROR("{}", msg); }
+    static void debug(const std::string& msg) { LOG_DEBUG("{}", msg); }
+
 private:
-    static void log(LogLevel lvl, const std::string& msg) {
-        static std::mutex mtx;
-        std::lock_guard<std::mutex> lock(mtx);
+    struct Ring {
+        SpscQueue<Record> queue{RING_SIZE};
+        std::atomic<uint64_t> dropped{0};
+        // counters for flush(); each is written by one side only
+        std::atomic<uint64_t> submitted{0};
+        std::atomic<uint64_t> handled{0};
+        std::atomic<bool> orphaned{false};   // owning thread has exited
+    };
+
+    struct Backend {
+        std::mutex mtx;
+        std::condition_variable cv;
+        std::vector<std::shared_ptr<Ring>> rings;
+        std::atomic<LogOverflow> overflow{LogOverflow::DROP};
+        bool stopping = false;
+        std::thread worker;
+
+        Backend() : worker([this] { loop(); }) {}
+
+        ~Backend() {
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                stopping = true;
+            }
+            cv.notify_all();
+            worker.join();
+        }
+
+        std::shared_ptr<Ring> attach() {
+            auto ring = std::make_shared<Ring>();
+            std::lock_guard<std::mutex> lock(mtx);
+            rings.push_back(ring);
+            return ring;
+        }
+
+        void flush() {
+            std::vector<std::shared_ptr<Ring>> snapshot;
+            {
+                std::lock_guard<std::mutex> lock(mtx);
+                snapshot = rings;
+            }
+            for (auto& ring : snapshot) {
+                uint64_t target = ring->submitted.load(std::memory_order_acquire);
+                while (ring->handled.load(std::memory_order_acquire) < target) {
+                    std::this_thread::sleep_for(std::chrono::microseconds(100));
+                }
+            }
+        }
+
+        void loop() {
+            std::string out;
+            Record rec;
+            for (;;) {
+                std::vector<std::shared_ptr<Ring>> snapshot;
+                bool stop;
+                {
+                    std::unique_lock<std::mutex> lock(mtx);
+                    cv.wait_for(lock, std::chrono::milliseconds(1));
+                    stop = stopping;
+                    snapshot = rings;
+                }
+
+                std::vector<uint64_t> counts(snapshot.size(), 0);
+                for (size_t i = 0; i < snapshot.size(); ++i) {
+                    auto& ring = snapshot[i];
+                    while (ring->queue.try_pop(rec)) {
+                        format(rec, out);
+                        ++counts[i];
+                    }
+                    if (uint64_t d = ring->dropped.exchange(0, std::memory_order_relaxed)) {
+                        out += "[logger][WARN] ring overflow, dropped " + std::to_string(d) + " records\n";
+                        counts[i] += d;
+                    }
+                }
+                if (!out.empty()) {
+                    std::fwrite(out.data(), 1, out.size(), stdout);
+                    std::fflush(stdout);
+                    out.clear();
+                }
+                for (size_t i = 0; i < snapshot.size(); ++i) {
+                    snapshot[i]->handled.fetch_add(counts[i], std::memory_order_release);
+                }
+
+                {
+                    std::lock_guard<std::mutex> lock(mtx);
+                    std::erase_if(rings, [](const std::shared_ptr<Ring>& r) {
+                        return r->orphaned.load() && r->queue.empty();
+                    });
+                }
+                if (stop) return;
+            }
+        }
+    };
+
+    // per-thread handle; marks the ring orphaned so the backend drops it once drained
+    struct ThreadRing {
+        std::shared_ptr<Ring> ring = backend().attach();
+        ~ThreadRing() { ring->orphaned.store(true); }
+    };
+
+    inline static std::atomic<LogLevel> min_level_{LogLevel::DEBUG};
 
-        auto now = std::chrono::system_clock::now();
-        std::time_t t = std::chrono::system_clock::to_time_t(now);
+    static Backend& backend() {
+        static Backend instance;
+        return instance;
+    }
+
+    static void submit(Record&& rec) {
+        thread_local ThreadRing local;
+        Backend& be = backend();
+        local.ring->submitted.fetch_add(1, std::memory_order_relaxed);
+        while (!local.ring->queue.try_push(std::move(rec))) {
+            if (be.overflow.load(std::memory_order_relaxed) == LogOverflow::DROP) {
+                local.ring->dropped.fetch_add(1, std::memory_order_relaxed);
+                return;
+            }
+            std::this_thread::yield();
+        }
+    }
 
-        std::string lvl_str;
-        switch (lvl) {
+    template <typename T>
+    static void add_arg(Record& rec, const T& v) {
+        auto& slot = rec.args[rec.nargs];
+        auto& kind = rec.kinds[rec.nargs];
+        ++rec.nargs;
+        if constexpr (std::is_floating_point_v<T>) {
+            kind = Record::Kind::F64;
+            slot.d = static_cast<double>(v);
+        } else if constexpr (std::is_integral_v<T> && std::is_signed_v<T>) {
+            kind = Record::Kind::I64;
+            slot.i = static_cast<int64_t>(v);
+        } else if constexpr (std::is_integral_v<T> || std::is_enum_v<T>) {
+            kind = Record::Kind::U64;
+            slot.u = static_cast<uint64_t>(v);
+        } else {
+            // strings are copied (truncated if the record is full)
+            std::string_view sv(v);
+            kind = Record::Kind::STR;
+            if (rec.text_used >= TEXT_SIZE) {
+                // full: the last byte is the previous string's terminator
+                slot.str = TEXT_SIZE - 1;
+                return;
+            }
+            size_t room = TEXT_SIZE - rec.text_used - 1;
+            size_t len = sv.size() < room ? sv.size() : room;
+            slot.str = rec.text_used;
+            std::memcpy(rec.text + rec.text_used, sv.data(), len);
+            rec.text[rec.text_used + len] = '\0';
+            rec.text_used = static_cast<uint8_t>(rec.text_used + len + 1);
+        }
+    }
+
+    static void format(const Record& rec, std::string& out) {
+        std::time_t t = static_cast<std::time_t>(rec.timestamp_ns / 1000000000);
+        char ts[32];
+        std::strftime(ts, sizeof(ts), "%a %b %d %H:%M:%S", std::localtime(&t));
+
+        const char* lvl_str = "INFO";
+        switch (rec.level) {
             case LogLevel::INFO: lvl_str = "INFO"; break;
             case LogLevel::WARN: lvl_str = "WARN"; break;
             case LogLevel::ERROR: lvl_str = "ERROR"; break;
             case LogLevel::DEBUG: lvl_str = "DEBUG"; break;
         }
 
-        std::cout << "[" << std::string(std::ctime(&t)).substr(0, 19)
-                  << "][" << lvl_str << "] "
-                  << msg << std::endl;
+        out += '[';
+        out += ts;
+        out += "][";
+        out += lvl_str;
+        out += "] ";
+
+        size_t next = 0;
+        for (const char* p = rec.fmt; *p; ++p) {
+            if (p[0] == '{' && p[1] == '}' && next < rec.nargs) {
+                const auto& a = rec.args[next];
+                switch (rec.kinds[next]) {
+                    case Record::Kind::I64: out += std::to_string(a.i); break;
+                    case Record::Kind::U64: out += std::to_string(a.u); break;
+                    case Record::Kind::F64: out += std::to_string(a.d); break;
+                    case Record::Kind::STR: out += rec.text + a.str; break;
+                }
+                ++next;
+                ++p;
+            } else {
+                out += *p;
+            }
+        }
+        out += '\n';
     }
-public:
-    static void info(const std::string& msg) { log(LogLevel::INFO, msg); }
-    static void warn(const std::string& msg) { log(LogLevel::WARN, msg); }
-    static void error(const std::string& msg) { log(LogLevel::ERROR, msg); }
-    static void debug(const std::string& msg) { log(LogLevel::DEBUG, msg); }
 };
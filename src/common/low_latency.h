@@ -0,0 +1,88 @@
+#pragma once
+#include <boost/asio.hpp>
+#include <string>
+
+#if defined(__linux__)
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+#endif
+
+// Low-latency mode helpers: socket options and a spinning event loop.
+//
+// TCP_NODELAY is always set: every frame is written as soon as it exists and
+// batching, where wanted, is done above the socket. The rest is opt-in;
+// SO_BUSY_POLL and TCP_QUICKACK only exist on Linux and are skipped elsewhere.
+struct SocketTuning {
+    int busy_poll_us = 0;   // SO_BUSY_POLL: spin on the device queue this long in a blocking read/poll
+    int send_buffer = 0;    // SO_SNDBUF in bytes, 0 keeps the system default
+    int receive_buffer = 0; // SO_RCVBUF in bytes, 0 keeps the system default
+    bool quickack = false;  // acknowledge at once instead of delaying the ACK (re-armed per read)
+};
+
+namespace low_latency {
+
+#if defined(__linux__)
+using busy_poll = boost::asio::detail::socket_option::integer<SOL_SOCKET, SO_BUSY_POLL>;
+using quickack = boost::asio::detail::socket_option::boolean<IPPROTO_TCP, TCP_QUICKACK>;
+#endif
+
+// Applies `tuning` to a connected socket. Returns the options the OS refused
+// (raising SO_BUSY_POLL above net.core.busy_read needs CAP_NET_ADMIN), empty
+// when everything took.
+inline std::string apply(boost::asio::ip::tcp::socket& socket, const SocketTuning& tuning) {
+    std::string refused;
+    auto check = [&](const char* name, const boost::system::error_code& ec) {
+        if (!ec) return;
+        if (!refused.empty()) refused += ", ";
+        refused += std::string(name) + " (" + ec.message() + ")";
+    };
+    boost::system::error_code ec;
+    socket.set_option(boost::asio::ip::tcp::no_delay(true), ec);
+    check("TCP_NODELAY", ec);
+    if (tuning.send_buffer > 0) {
+        socket.set_option(boost::asio::socket_base::send_buffer_size(tuning.send_buffer), ec);
+        check("SO_SNDBUF", ec);
+    }
+    if (tuning.receive_buffer > 0) {
+        socket.set_option(boost::asio::socket_base::receive_buffer_size(tuning.receive_buffer), ec);
+        check("SO_RCVBUF", ec);
+    }
+#if defined(__linux__)
+    if (tuning.busy_poll_us > 0) {
+        socket.set_option(busy_poll(tuning.busy_poll_us), ec);
+        check("SO_BUSY_POLL", ec);
+    }
+    if (tuning.quickack) {
+        socket.set_option(quickack(true), ec);
+        check("TCP_QUICKACK", ec);
+    }
+#endif
+    return refused;
+}
+
+// TCP_QUICKACK is not sticky: the kernel may fall back to delayed ACKs, so
+// it is set again after every read
+inline void rearm_quickack(boost::asio::ip::tcp::socket& socket) {
+#if defined(__linux__)
+    boost::system::error_code ignored;
+    socket.set_option(quickack(true), ignored);
+#else
+    (void)socket;
+#endif
+}
+
+// Runs `io` until it is stopped or out of work. With `spin` the thread never
+// sleeps in the reactor: it polls for ready handlers in a loop, trading a
+// busy core for the wakeup latency of epoll_wait.
+inline void run(boost::asio::io_context& io, bool spin) {
+    if (!spin) {
+        io.run();
+        return;
+    }
+    while (!io.stopped()) {
+        io.poll();
+    }
+}
+
+}
@@ -1,4 +1,6 @@
 #pragma once
+#include <chrono>
+#include <cstddef>
 #include <cstdint>
 
 #pragma pack(push, 1)
@@ -10,9 +12,92 @@ struct TradeMessage {
     double quantity;
 };
 
+// One interval of a topic's trades, as sent in a BAR frame. start_ms is the
+// broker's wall clock at the start of the interval, a multiple of
+// interval_ms; vwap is sum(price * quantity) / volume (close when volume is 0).
+struct BarMessage {
+    int topic_id;
+    uint32_t interval_ms;
+    uint64_t start_ms;
+    double open;
+    double high;
+    double low;
+    double close;
+    double volume;
+    double vwap;
+    uint32_t trades;
+};
+
 #pragma pack(pop)
 
 enum class MsgType : uint8_t {
-    SUBSCRIBE = 0x01,
-    DATA      = 0x02
+    SUBSCRIBE       = 0x01,
+    DATA            = 0x02,
+    SUBSCRIBE_RANGE = 0x03, // int32 lo, int32 hi (inclusive)
+    SUBSCRIBE_MASK  = 0x04, // uint32 value, uint32 mask
+    SUBSCRIBE_ALL   = 0x05,
+    SHM_ATTACH      = 0x06, // 64-byte NUL padded shared memory segment name
+    MCAST_JOIN      = 0x07, // no body: multicast topics reach this session over UDP
+    RETRANSMIT_REQ  = 0x08, // int32 topic, uint64 first seq, uint32 count
+    RETRANSMIT      = 0x09, // broker -> subscriber: uint64 seq + one DATA frame
+    SUBSCRIBE_REPLAY = 0x0A, // int32 topic, uint8 mode (0 = seq, 1 = timestamp_ms), uint64 from
+    JOURNAL_DATA    = 0x0B, // broker -> subscriber: uint64 journal seq + one DATA frame
+    BATCH           = 0x0C, // uint16 count, then count TradeMessage records
+    DATA_TS         = 0x0D, // uint64 publish, ingress and egress stamps, uint32 stream, uint64 seq, one TradeMessage
+    UNSUBSCRIBE     = 0x0E, // then the SUBSCRIBE* frame to cancel (see subscribe_frame_size)
+    PEER_HELLO      = 0x0F, // uint32 broker id; the connection is a link between two brokers
+    SUBSCRIBE_FILTER = 0x10, // int32 topic, then the TradeFilter bounds (trade_filter.h)
+    SUBSCRIBE_BARS  = 0x11, // int32 topic, uint32 interval_ms
+    BAR             = 0x12  // broker -> subscriber: one BarMessage
 };
+
+// Size of a SUBSCRIBE* frame (not SUBSCRIBE_REPLAY) including its type byte, 0 for other types.
+inline size_t subscribe_frame_size(uint8_t type) {
+    switch (static_cast<MsgType>(type)) {
+        case MsgType::SUBSCRIBE:       return 1 + 4;
+        case MsgType::SUBSCRIBE_RANGE:
+        case MsgType::SUBSCRIBE_MASK:  return 1 + 4 + 4;
+        case MsgType::SUBSCRIBE_ALL:   return 1;
+        case MsgType::SUBSCRIBE_FILTER: return 1 + 4 + 4 * 8;
+        case MsgType::SUBSCRIBE_BARS:  return 1 + 4 + 4;
+        default:                       return 0;
+    }
+}
+
+// A BATCH from a publisher may mix topics, preferably grouped by topic. The
+// broker forwards every run of one topic as a BATCH of its own (a single
+// record as a plain DATA frame).
+constexpr size_t BATCH_HEADER_SIZE = 1 + 2;
+constexpr size_t MAX_BATCH_RECORDS = 1024;
+
+inline size_t batch_count(const uint8_t* frame) {
+    return (static_cast<size_t>(frame[1]) << 8) | frame[2];
+}
+
+// Multicast datagram: uint16 count, then count records of (uint64 per-topic
+// sequence number, DATA frame).
+constexpr size_t MCAST_RECORD_SIZE = 8 + 1 + sizeof(TradeMessage);
+constexpr size_t MCAST_MAX_DATAGRAM = 1400;
+
+// DATA_TS is a DATA frame carrying hop timestamps for latency tracing: the
+// publisher's send time, the broker's ingress time (when it parsed the frame)
+// and its egress time (when the frame was handed to the socket or ring of
+// that subscriber). Stamps are trace_clock_ns() values, 0 until taken. The
+// publisher may also number its frames: a stream id (0: not numbered) and a
+// sequence number per stream and topic, for the subscriber to count losses;
+// the broker passes both through untouched. The trade comes last, so "the
+// last sizeof(TradeMessage) bytes" holds for it just as for DATA; the journal
+// and the last-value cache keep it as DATA.
+constexpr size_t TRACE_PUBLISH_OFFSET = 1;
+constexpr size_t TRACE_INGRESS_OFFSET = TRACE_PUBLISH_OFFSET + 8;
+constexpr size_t TRACE_EGRESS_OFFSET = TRACE_INGRESS_OFFSET + 8;
+constexpr size_t TRACE_STREAM_OFFSET = TRACE_EGRESS_OFFSET + 8;
+constexpr size_t TRACE_SEQ_OFFSET = TRACE_STREAM_OFFSET + 4;
+constexpr size_t DATA_TS_FRAME_SIZE = TRACE_SEQ_OFFSET + 8 + sizeof(TradeMessage);
+
+// steady_clock in nanoseconds: CLOCK_MONOTONIC / QueryPerformanceCounter,
+// so stamps from different processes on one host can be subtracted
+inline uint64_t trace_clock_ns() {
+    return static_cast<uint64_t>(std::chrono::duration_cast<std::chrono::nanoseconds>(
+        std::chrono::steady_clock::now().time_since_epoch()).count());
+}
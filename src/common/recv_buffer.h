@@ -0,0 +1,34 @@
+#pragma once
+#include <cstdint>
+#include <cstring>
+#include <vector>
+
+// Receive buffer for stream transports. Reads append at the tail, the frame
+// parser consumes from the head, and compact() moves the unparsed remainder
+// (at most one partial frame) back to the front so the next read has the
+// whole buffer to fill.
+class RecvBuffer {
+public:
+    explicit RecvBuffer(size_t capacity) : buf_(capacity) {}
+
+    uint8_t* write_ptr() { return buf_.data() + tail_; }
+    size_t writable() const { return buf_.size() - tail_; }
+    void commit(size_t n) { tail_ += n; }
+
+    const uint8_t* read_ptr() const { return buf_.data() + head_; }
+    size_t readable() const { return tail_ - head_; }
+    void consume(size_t n) { head_ += n; }
+
+    void compact() {
+        if (head_ == 0) return;
+        size_t left = tail_ - head_;
+        if (left > 0) std::memmove(buf_.data(), buf_.data() + head_, left);
+        head_ = 0;
+        tail_ = left;
+    }
+
+private:
+    std::vector<uint8_t> buf_;
+    size_t head_ = 0;
+    size_t tail_ = 0;
+};
@@ -0,0 +1,388 @@
+#pragma once
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <new>
+#include <stdexcept>
+#include <string>
+#include <thread>
+#include <utility>
+#include <vector>
+#if defined(__linux__)
+#include <cerrno>
+#include <ctime>
+#include <fcntl.h>
+#include <linux/futex.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#endif
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "message.h"
+
+// Shared-memory transport for clients on the same host as the broker. The
+// client creates a segment in /dev/shm holding two SPSC byte rings (client to
+// broker and broker to client) that carry exactly the frames that would
+// otherwise go over TCP, and hands its name to the broker in an SHM_ATTACH
+// frame.
+//
+// Each side owns a doorbell. A side that runs out of work marks itself asleep
+// on its doorbell and futex-waits on it; the other side only makes the wake
+// syscall when that mark is set, so two busy-polling ends never enter the
+// kernel at all.
+namespace shm {
+
+constexpr uint32_t SEGMENT_MAGIC = 0x4c4c5053; // "LLPS"
+constexpr uint32_t SEGMENT_VERSION = 1;
+constexpr size_t NAME_SIZE = 64;               // SHM_ATTACH body, NUL padded
+constexpr size_t DEFAULT_RING_BYTES = 1 << 20;
+
+inline void cpu_relax() {
+#if defined(_MSC_VER)
+    _mm_pause();
+#elif defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#else
+    std::this_thread::yield();
+#endif
+}
+
+static_assert(sizeof(std::atomic<uint32_t>) == sizeof(uint32_t) && std::atomic<uint32_t>::is_always_lock_free,
+              "futex words must be plain 32-bit atomics");
+
+inline void futex_wait(std::atomic<uint32_t>* word, uint32_t expected, std::chrono::microseconds timeout) {
+#if defined(__linux__)
+    timespec ts{static_cast<time_t>(timeout.count() / 1000000), static_cast<long>(timeout.count() % 1000000) * 1000};
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAIT, expected, &ts, nullptr, 0);
+#else
+    if (word->load(std::memory_order_acquire) == expected) {
+        std::this_thread::sleep_for(std::min(timeout, std::chrono::microseconds(50)));
+    }
+#endif
+}
+
+// Sleeps until one of n words (at most MAX_WAIT_WORDS) is woken or no longer
+// holds its expected value, or the timeout. Needs futex_waitv (Linux 5.16);
+// elsewhere it only naps briefly.
+constexpr size_t MAX_WAIT_WORDS = 128;
+
+inline void futex_wait_any(std::atomic<uint32_t>* const* words, const uint32_t* expected, size_t n,
+                           std::chrono::microseconds timeout) {
+#if defined(__linux__) && defined(SYS_futex_waitv)
+    futex_waitv waiters[MAX_WAIT_WORDS] = {};
+    n = std::min(n, MAX_WAIT_WORDS);
+    for (size_t i = 0; i < n; ++i) {
+        waiters[i].val = expected[i];
+        waiters[i].uaddr = reinterpret_cast<uintptr_t>(words[i]);
+        waiters[i].flags = FUTEX_32;
+    }
+    // futex_waitv takes an absolute deadline
+    timespec ts{};
+    ::clock_gettime(CLOCK_MONOTONIC, &ts);
+    long long ns = ts.tv_nsec + static_cast<long long>(timeout.count() % 1000000) * 1000;
+    ts.tv_sec += static_cast<time_t>(timeout.count() / 1000000 + ns / 1000000000);
+    ts.tv_nsec = static_cast<long>(ns % 1000000000);
+    if (syscall(SYS_futex_waitv, waiters, static_cast<unsigned>(n), 0, &ts, CLOCK_MONOTONIC) == 0 || errno != ENOSYS) return;
+#endif
+    for (size_t i = 0; i < n; ++i) {
+        if (words[i]->load(std::memory_order_acquire) != expected[i]) return;
+    }
+    std::this_thread::sleep_for(std::min(timeout, std::chrono::microseconds(50)));
+}
+
+inline void futex_wake(std::atomic<uint32_t>* word) {
+#if defined(__linux__)
+    syscall(SYS_futex, reinterpret_cast<uint32_t*>(word), FUTEX_WAKE, 1, nullptr, nullptr, 0);
+#else
+    (void)word;
+#endif
+}
+
+struct alignas(64) Doorbell {
+    // what the sleeper is waiting for
+    static constexpr uint32_t DATA = 1;
+    static constexpr uint32_t SPACE = 2;
+
+    std::atomic<uint32_t> seq{0};
+    std::atomic<uint32_t> sleeping{0};
+
+    // called by the other side after it published something the owner may wait for
+    void notify(uint32_t what) {
+        if ((sleeping.load(std::memory_order_seq_cst) & what) == 0) return;
+        interrupt();
+    }
+
+    // wakes the owner whatever it waits for
+    void interrupt() {
+        seq.fetch_add(1, std::memory_order_seq_cst);
+        futex_wake(&seq);
+    }
+
+    // Sleeps until notified or the timeout, unless ready() already holds once
+    // the other side can see that we are asleep.
+    template <typename Ready>
+    void wait(uint32_t what, Ready&& ready, std::chrono::microseconds timeout) {
+        uint32_t seen = arm(what);
+        if (!ready()) futex_wait(&seq, seen, timeout);
+        disarm();
+    }
+
+    // The halves of wait() for a sleeper watching several doorbells: arm them
+    // all, check for work, futex_wait_any on their seq words with the values
+    // arm() returned, then disarm them all.
+    uint32_t arm(uint32_t what) {
+        uint32_t seen = seq.load(std::memory_order_acquire);
+        sleeping.store(what, std::memory_order_seq_cst);
+        return seen;
+    }
+    void disarm() { sleeping.store(0, std::memory_order_relaxed); }
+};
+
+struct RingHeader {
+    alignas(64) std::atomic<uint64_t> head{0}; // bytes ever written
+    alignas(64) std::atomic<uint64_t> tail{0}; // bytes ever read
+};
+
+struct SegmentHeader {
+    uint32_t magic;
+    uint32_t version;
+    uint64_t ring_bytes;
+    std::atomic<uint32_t> attached{0};         // set by the broker, futex word
+    Doorbell broker_bell;
+    Doorbell client_bell;
+    RingHeader to_broker;
+    RingHeader to_client;
+};
+
+// One process's view of one direction. A frame is written whole or not at all;
+// the reader gets a byte stream and does its own framing.
+class Ring {
+public:
+    Ring() = default;
+    Ring(RingHeader* hdr, uint8_t* data, uint64_t capacity, Doorbell* consumer_bell, Doorbell* producer_bell)
+        : hdr_(hdr), data_(data), mask_(capacity - 1), consumer_bell_(consumer_bell), producer_bell_(producer_bell) {
+    }
+
+    uint64_t capacity() const { return mask_ + 1; }
+
+    // producer side
+    bool try_write(const uint8_t* p, size_t n) {
+        uint64_t head = hdr_->head.load(std::memory_order_relaxed);
+        if (head + n - cached_tail_ > capacity()) {
+            cached_tail_ = hdr_->tail.load(std::memory_order_acquire);
+            if (head + n - cached_tail_ > capacity()) return false;
+        }
+        copy_in(head, p, n);
+        hdr_->head.store(head + n, std::memory_order_seq_cst);
+        consumer_bell_->notify(Doorbell::DATA);
+        return true;
+    }
+
+    bool has_space(size_t n) const {
+        return hdr_->head.load(std::memory_order_relaxed) + n - hdr_->tail.load(std::memory_order_seq_cst) <= capacity();
+    }
+
+    // consumer side: copies out up to max bytes
+    size_t read(uint8_t* out, size_t max) {
+        uint64_t tail = hdr_->tail.load(std::memory_order_relaxed);
+        if (cached_head_ == tail) {
+            cached_head_ = hdr_->head.load(std::memory_order_acquire);
+            if (cached_head_ == tail) return 0;
+        }
+        // the peer owns the other index, so never trust it beyond one ring's worth
+        size_t n = static_cast<size_t>(std::min<uint64_t>({cached_head_ - tail, max, capacity()}));
+        copy_out(tail, out, n);
+        hdr_->tail.store(tail + n, std::memory_order_seq_cst);
+        producer_bell_->notify(Doorbell::SPACE);
+        return n;
+    }
+
+    bool readable() const {
+        return hdr_->head.load(std::memory_order_seq_cst) != hdr_->tail.load(std::memory_order_relaxed);
+    }
+
+private:
+    void copy_in(uint64_t pos, const uint8_t* p, size_t n) {
+        size_t off = static_cast<size_t>(pos & mask_);
+        size_t first = std::min<size_t>(n, capacity() - off);
+        std::memcpy(data_ + off, p, first);
+        std::memcpy(data_, p + first, n - first);
+    }
+
+    void copy_out(uint64_t pos, uint8_t* out, size_t n) const {
+        size_t off = static_cast<size_t>(pos & mask_);
+        size_t first = std::min<size_t>(n, capacity() - off);
+        std::memcpy(out, data_ + off, first);
+        std::memcpy(out + first, data_, n - first);
+    }
+
+    RingHeader* hdr_ = nullptr;
+    uint8_t* data_ = nullptr;
+    uint64_t mask_ = 0;
+    Doorbell* consumer_bell_ = nullptr;
+    Doorbell* producer_bell_ = nullptr;
+    // process-local copies of the other side's index
+    uint64_t cached_tail_ = 0;
+    uint64_t cached_head_ = 0;
+};
+
+// A mapped segment. The client creates it (and removes the name once the
+// broker is attached); the broker opens it by name. Throws std::runtime_error.
+class Segment {
+public:
+    static bool supported() {
+#if defined(__linux__)
+        return true;
+#else
+        return false;
+#endif
+    }
+
+    // "/name" with nothing but letters, digits, '-', '_' and '.'
+    static bool valid_name(const std::string& name) {
+        if (name.size() < 2 || name.size() >= NAME_SIZE || name[0] != '/') return false;
+        return std::all_of(name.begin() + 1, name.end(), [](char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') || c == '-' || c == '_' || c == '.';
+        });
+    }
+
+    static Segment create(const std::string& name, size_t ring_bytes = DEFAULT_RING_BYTES) {
+        if (!valid_name(name)) throw std::runtime_error("bad shared memory name " + name);
+        uint64_t cap = 4096;
+        while (cap < ring_bytes) cap <<= 1;
+        Segment seg;
+        seg.name_ = name;
+        seg.size_ = layout_size(cap);
+#if defined(__linux__)
+        int fd = ::shm_open(name.c_str(), O_CREAT | O_EXCL | O_RDWR, 0600);
+        if (fd < 0) throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+        seg.owner_ = true;
+        if (::ftruncate(fd, static_cast<off_t>(seg.size_)) != 0) {
+            ::close(fd);
+            throw std::runtime_error("ftruncate " + name + ": " + std::strerror(errno));
+        }
+        seg.map(fd);
+#else
+        throw std::runtime_error("shared memory transport is not supported on this platform");
+#endif
+        auto* hdr = new (seg.base_) SegmentHeader();
+        hdr->magic = SEGMENT_MAGIC;
+        hdr->version = SEGMENT_VERSION;
+        hdr->ring_bytes = cap;
+        return seg;
+    }
+
+    static Segment open(const std::string& name) {
+        if (!valid_name(name)) throw std::runtime_error("bad shared memory name");
+        Segment seg;
+        seg.name_ = name;
+#if defined(__linux__)
+        int fd = ::shm_open(name.c_str(), O_RDWR, 0);
+        if (fd < 0) throw std::runtime_error("shm_open " + name + ": " + std::strerror(errno));
+        struct stat st {};
+        if (::fstat(fd, &st) != 0 || static_cast<size_t>(st.st_size) < sizeof(SegmentHeader)) {
+            ::close(fd);
+            throw std::runtime_error("shared memory segment " + name + " is too small");
+        }
+        seg.size_ = static_cast<size_t>(st.st_size);
+        seg.map(fd);
+#else
+        throw std::runtime_error("shared memory transport is not supported on this platform");
+#endif
+        const SegmentHeader* hdr = seg.header();
+        uint64_t cap = hdr->ring_bytes;
+        if (hdr->magic != SEGMENT_MAGIC || hdr->version != SEGMENT_VERSION ||
+            cap < 4096 || (cap & (cap - 1)) != 0 || cap > seg.size_ || layout_size(cap) != seg.size_) {
+            throw std::runtime_error("shared memory segment " + name + " has an unknown layout");
+        }
+        return seg;
+    }
+
+    Segment() = default;
+    Segment(Segment&& o) noexcept { *this = std::move(o); }
+    Segment& operator=(Segment&& o) noexcept {
+        std::swap(base_, o.base_);
+        std::swap(size_, o.size_);
+        std::swap(name_, o.name_);
+        std::swap(owner_, o.owner_);
+        return *this;
+    }
+    ~Segment() {
+        unlink();
+#if defined(__linux__)
+        if (base_) ::munmap(base_, size_);
+#endif
+    }
+
+    const std::string& name() const { return name_; }
+    SegmentHeader* header() const { return static_cast<SegmentHeader*>(base_); }
+
+    Ring to_broker() const {
+        return Ring(&header()->to_broker, data(0), header()->ring_bytes, &header()->broker_bell, &header()->client_bell);
+    }
+    Ring to_client() const {
+        return Ring(&header()->to_client, data(1), header()->ring_bytes, &header()->client_bell, &header()->broker_bell);
+    }
+
+    // broker: tells the client it may switch to the rings
+    void acknowledge() const {
+        header()->attached.store(1, std::memory_order_seq_cst);
+        futex_wake(&header()->attached);
+    }
+
+    // client: waits for acknowledge()
+    bool wait_attached(std::chrono::milliseconds timeout) const {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (header()->attached.load(std::memory_order_acquire) == 0) {
+            if (std::chrono::steady_clock::now() >= deadline) return false;
+            futex_wait(&header()->attached, 0, std::chrono::microseconds(1000));
+        }
+        return true;
+    }
+
+    // removes the name; the mapping stays valid for both sides
+    void unlink() {
+#if defined(__linux__)
+        if (owner_) ::shm_unlink(name_.c_str());
+#endif
+        owner_ = false;
+    }
+
+private:
+    static size_t header_size() { return (sizeof(SegmentHeader) + 63) & ~size_t(63); }
+    static size_t layout_size(uint64_t cap) { return header_size() + 2 * static_cast<size_t>(cap); }
+
+    uint8_t* data(int ring) const {
+        return static_cast<uint8_t*>(base_) + header_size() + ring * static_cast<size_t>(header()->ring_bytes);
+    }
+
+#if defined(__linux__)
+    void map(int fd) {
+        void* p = ::mmap(nullptr, size_, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+        ::close(fd);
+        if (p == MAP_FAILED) throw std::runtime_error(std::string("mmap: ") + std::strerror(errno));
+        base_ = p;
+    }
+#endif
+
+    void* base_ = nullptr;
+    size_t size_ = 0;
+    std::string name_;
+    bool owner_ = false;
+};
+
+// SHM_ATTACH frame for a segment name
+inline std::vector<uint8_t> attach_frame(const std::string& name) {
+    std::vector<uint8_t> frame(1 + NAME_SIZE, 0);
+    frame[0] = static_cast<uint8_t>(MsgType::SHM_ATTACH);
+    std::memcpy(frame.data() + 1, name.data(), std::min(name.size(), NAME_SIZE - 1));
+    return frame;
+}
+
+} // namespace shm
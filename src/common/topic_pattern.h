@@ -0,0 +1,32 @@
+#pragma once
+#include <cstdint>
+
+// Non-exact subscription: an inclusive topic range, a bitmask match
+// ((topic & mask) == (value & mask), e.g. a prefix over the high bits of the
+// id) or every topic.
+struct TopicPattern {
+    enum class Kind : uint8_t { RANGE, MASK, ALL };
+
+    Kind kind = Kind::ALL;
+    int32_t lo = 0;
+    int32_t hi = 0;
+    uint32_t value = 0;
+    uint32_t mask = 0;
+
+    static TopicPattern range(int32_t lo, int32_t hi) { return {Kind::RANGE, lo, hi, 0, 0}; }
+    static TopicPattern masked(uint32_t value, uint32_t mask) { return {Kind::MASK, 0, 0, value & mask, mask}; }
+    static TopicPattern all() { return {}; }
+
+    bool matches(int topic_id) const {
+        switch (kind) {
+            case Kind::RANGE: return topic_id >= lo && topic_id <= hi;
+            case Kind::MASK:  return (static_cast<uint32_t>(topic_id) & mask) == value;
+            case Kind::ALL:   return true;
+        }
+        return false;
+    }
+
+    bool operator==(const TopicPattern& o) const {
+        return kind == o.kind && lo == o.lo && hi == o.hi && value == o.value && mask == o.mask;
+    }
+};
@@ -0,0 +1,54 @@
+#pragma once
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include "codec.h"
+
+// Content filter of a SUBSCRIBE_FILTER: a trade passes when its price lies
+// in [price_lo, price_hi] and its quantity in [qty_lo, qty_hi]. An open side
+// is infinite, so a threshold is a band with one open side and "any price" a
+// band with both open. On the wire: the four bounds as big-endian doubles.
+struct TradeFilter {
+    static constexpr double OPEN = std::numeric_limits<double>::infinity();
+    static constexpr size_t WIRE_SIZE = 4 * sizeof(double);
+    // where the filtered fields sit in an encoded TradeMessage
+    static constexpr size_t PRICE_OFFSET = offsetof(TradeMessage, price);
+    static constexpr size_t QTY_OFFSET = offsetof(TradeMessage, quantity);
+
+    double price_lo = -OPEN;
+    double price_hi = OPEN;
+    double qty_lo = -OPEN;
+    double qty_hi = OPEN;
+
+    bool matches(double price, double qty) const {
+        return price >= price_lo && price <= price_hi && qty >= qty_lo && qty <= qty_hi;
+    }
+
+    // an encoded TradeMessage
+    bool matches(const uint8_t* trade) const {
+        return matches(codec::load_be<double>(trade + PRICE_OFFSET), codec::load_be<double>(trade + QTY_OFFSET));
+    }
+
+    // no NaN bounds, no empty band
+    bool valid() const {
+        for (double v : {price_lo, price_hi, qty_lo, qty_hi}) {
+            if (std::isnan(v)) return false;
+        }
+        return price_lo <= price_hi && qty_lo <= qty_hi;
+    }
+
+    bool operator==(const TradeFilter&) const = default;
+
+    void encode(uint8_t* out) const {
+        codec::store_be(out, price_lo);
+        codec::store_be(out + 8, price_hi);
+        codec::store_be(out + 16, qty_lo);
+        codec::store_be(out + 24, qty_hi);
+    }
+
+    static TradeFilter decode(const uint8_t* in) {
+        return {codec::load_be<double>(in), codec::load_be<double>(in + 8),
+                codec::load_be<double>(in + 16), codec::load_be<double>(in + 24)};
+    }
+};